@@ -0,0 +1,95 @@
+#include "DetectionGeometryFilter.h"
+
+DetectionGeometryFilter::DetectionGeometryFilter() :
+   MinObjectHeight( 1.2f ), MaxObjectHeight( 2.1f )
+{
+}
+
+void DetectionGeometryFilter::setObjectHeightRange(float min_height_in_meter, float max_height_in_meter)
+{
+   MinObjectHeight = std::max( std::min( min_height_in_meter, max_height_in_meter ), 0.0f );
+   MaxObjectHeight = std::max( std::max( min_height_in_meter, max_height_in_meter ), 0.0f );
+}
+
+void DetectionGeometryFilter::scoreHeights(
+   float* scores,
+   const float* heights,
+   const float* min_heights,
+   const float* max_heights,
+   int n
+)
+{
+   int i = 0;
+#ifdef USE_SSE2
+   const __m128 zero = _mm_setzero_ps();
+   const __m128 one = _mm_set1_ps( 1.0f );
+   for (; i + 4 <= n; i += 4) {
+      const __m128 height = _mm_loadu_ps( heights + i );
+      const __m128 min_height = _mm_loadu_ps( min_heights + i );
+      const __m128 max_height = _mm_loadu_ps( max_heights + i );
+      const __m128 valid = _mm_and_ps( _mm_cmpgt_ps( height, zero ), _mm_cmpgt_ps( max_height, zero ) );
+      const __m128 score = _mm_min_ps(
+         one,
+         _mm_min_ps( _mm_div_ps( height, min_height ), _mm_div_ps( max_height, height ) )
+      );
+      _mm_storeu_ps( scores + i, _mm_and_ps( score, valid ) );
+   }
+#endif
+   for (; i < n; ++i) {
+      scores[i] = heights[i] > 0.0f && max_heights[i] > 0.0f ?
+         std::min( 1.0f, std::min( heights[i] / min_heights[i], max_heights[i] / heights[i] ) ) : 0.0f;
+   }
+}
+
+void DetectionGeometryFilter::getScores(std::vector<float>& scores, const std::vector<DetectionBox>& boxes) const
+{
+   static_assert( sizeof(DetectionBox) == 4 * sizeof(float), "DetectionBox should be tightly packed." );
+
+   const int n = static_cast<int>(boxes.size());
+   scores.resize( boxes.size() );
+
+   // boxes are processed in chunks that stay in the cache between the passes
+   constexpr int chunk_size = 256;
+   float foot_rows[chunk_size], heights[chunk_size], min_heights[chunk_size], max_heights[chunk_size];
+   float ground_sampling_distances[chunk_size];
+   for (int begin = 0; begin < n; begin += chunk_size) {
+      const int count = std::min( chunk_size, n - begin );
+      const DetectionBox* chunk = boxes.data() + begin;
+
+      int i = 0;
+#ifdef USE_SSE2
+      for (; i + 4 <= count; i += 4) {
+         __m128 x = _mm_loadu_ps( &chunk[i].X );
+         __m128 y = _mm_loadu_ps( &chunk[i + 1].X );
+         __m128 w = _mm_loadu_ps( &chunk[i + 2].X );
+         __m128 h = _mm_loadu_ps( &chunk[i + 3].X );
+         _MM_TRANSPOSE4_PS( x, y, w, h );
+         _mm_storeu_ps( foot_rows + i, _mm_add_ps( y, h ) );
+         _mm_storeu_ps( heights + i, h );
+      }
+#endif
+      for (; i < count; ++i) {
+         foot_rows[i] = chunk[i].Y + chunk[i].Height;
+         heights[i] = chunk[i].Height;
+      }
+
+      GroundScaleMap::getRowScales( ground_sampling_distances, min_heights, Camera, foot_rows, count, MinObjectHeight );
+      GroundScaleMap::getRowScales( ground_sampling_distances, max_heights, Camera, foot_rows, count, MaxObjectHeight );
+      scoreHeights( scores.data() + begin, heights, min_heights, max_heights, count );
+   }
+}
+
+void DetectionGeometryFilter::getPlausibleBoxes(
+   std::vector<int>& indices,
+   const std::vector<DetectionBox>& boxes,
+   float min_score
+) const
+{
+   std::vector<float> scores;
+   getScores( scores, boxes );
+
+   indices.clear();
+   for (size_t i = 0; i < scores.size(); ++i) {
+      if (scores[i] >= min_score) indices.emplace_back( static_cast<int>(i) );
+   }
+}
\ No newline at end of file
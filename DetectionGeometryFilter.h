@@ -0,0 +1,41 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "IntegralFenceMask.h"
+#include "GroundScaleMap.h"
+
+// scores detection boxes by how plausible their pixel heights are for objects standing on the ground at their foot points
+class DetectionGeometryFilter
+{
+public:
+	DetectionGeometryFilter();
+
+	void setCamera(const PinholeCamera& camera) { Camera = camera; }
+	void setObjectHeightRange(float min_height_in_meter, float max_height_in_meter);
+	// 1 if the box height is within the expected range at its foot row, otherwise the ratio of the box height to the
+	// nearest end of the range or its inverse, whichever is below 1. 0 if the foot point is not on the visible ground.
+	void getScores(std::vector<float>& scores, const std::vector<DetectionBox>& boxes) const;
+	// indices of the boxes whose score is at least min_score
+	void getPlausibleBoxes(std::vector<int>& indices, const std::vector<DetectionBox>& boxes, float min_score) const;
+
+private:
+	PinholeCamera Camera;
+	float MinObjectHeight;
+	float MaxObjectHeight;
+
+	static void scoreHeights(
+		float* scores,
+		const float* heights,
+		const float* min_heights,
+		const float* max_heights,
+		int n
+	);
+};
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include "DistanceTransform.h"
+
+#include <limits>
+
+namespace
+{
+   // 1D lower envelope of parabolas by Felzenszwalb and Huttenlocher
+   void transformLine(float* distance, const float* f, int n, std::vector<int>& v, std::vector<float>& z)
+   {
+      constexpr float infinity = std::numeric_limits<float>::infinity();
+      int k = -1;
+      for (int q = 0; q < n; ++q) {
+         if (f[q] == infinity) continue;
+         while (k >= 0) {
+            const float s = ((f[q] + static_cast<float>(q * q)) - (f[v[k]] + static_cast<float>(v[k] * v[k]))) /
+               static_cast<float>(2 * (q - v[k]));
+            if (s > z[k]) break;
+            k--;
+         }
+         k++;
+         v[k] = q;
+         z[k] = k == 0 ? -infinity : ((f[q] + static_cast<float>(q * q)) - (f[v[k - 1]] + static_cast<float>(v[k - 1] * v[k - 1]))) /
+            static_cast<float>(2 * (q - v[k - 1]));
+         z[k + 1] = infinity;
+      }
+      if (k < 0) {
+         std::fill( distance, distance + n, infinity );
+         return;
+      }
+
+      int j = 0;
+      for (int q = 0; q < n; ++q) {
+         while (z[j + 1] < static_cast<float>(q)) j++;
+         const auto d = static_cast<float>(q - v[j]);
+         distance[q] = d * d + f[v[j]];
+      }
+   }
+}
+
+void getSquaredDistanceToSeeds(std::vector<float>& distance, const std::vector<uint8_t>& seeds, int width, int height, bool parallel)
+{
+   const size_t size = static_cast<size_t>(width) * height;
+   std::vector<float> columns(size);
+   distance.resize( size );
+
+   const auto run = [parallel](int n, const std::function<void(int, int)>& func)
+   {
+      if (parallel) parallelFor( 0, n, func );
+      else func( 0, n );
+   };
+   run(
+      width,
+      [&](int begin, int end)
+      {
+         const int n = height;
+         std::vector<float> f(n), d(n), z(n + 1);
+         std::vector<int> v(n);
+         for (int x = begin; x < end; ++x) {
+            for (int y = 0; y < height; ++y) {
+               f[y] = seeds[y * width + x] != 0 ? 0.0f : std::numeric_limits<float>::infinity();
+            }
+            transformLine( d.data(), f.data(), n, v, z );
+            for (int y = 0; y < height; ++y) columns[y * width + x] = d[y];
+         }
+      }
+   );
+   run(
+      height,
+      [&](int begin, int end)
+      {
+         std::vector<float> z(width + 1);
+         std::vector<int> v(width);
+         for (int y = begin; y < end; ++y) {
+            transformLine( distance.data() + static_cast<size_t>(y) * width, columns.data() + static_cast<size_t>(y) * width, width, v, z );
+         }
+      }
+   );
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "_Common.h"
+
+// exact squared euclidean distance of every cell to the nearest nonzero seed, or infinity if there is no seed
+void getSquaredDistanceToSeeds(std::vector<float>& distance, const std::vector<uint8_t>& seeds, int width, int height, bool parallel);
\ No newline at end of file
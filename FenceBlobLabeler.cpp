@@ -0,0 +1,196 @@
+#include "FenceBlobLabeler.h"
+
+namespace
+{
+   int findNonzero(const uint8_t* row, int x, int end)
+   {
+#ifdef USE_SSE2
+      const __m128i zero = _mm_setzero_si128();
+      for (; x + 16 <= end; x += 16) {
+         const __m128i pixels = _mm_loadu_si128( reinterpret_cast<const __m128i*>(row + x) );
+         const int zero_bits = _mm_movemask_epi8( _mm_cmpeq_epi8( pixels, zero ) );
+         if (zero_bits != 0xFFFF) break;
+      }
+#endif
+      while (x < end && row[x] == 0) ++x;
+      return x;
+   }
+
+   int findZero(const uint8_t* row, int x, int end)
+   {
+#ifdef USE_SSE2
+      const __m128i zero = _mm_setzero_si128();
+      for (; x + 16 <= end; x += 16) {
+         const __m128i pixels = _mm_loadu_si128( reinterpret_cast<const __m128i*>(row + x) );
+         if (_mm_movemask_epi8( _mm_cmpeq_epi8( pixels, zero ) ) != 0) break;
+      }
+#endif
+      while (x < end && row[x] != 0) ++x;
+      return x;
+   }
+}
+
+FenceBlobLabeler::FenceBlobLabeler() : Width( 0 ), Height( 0 )
+{
+}
+
+void FenceBlobLabeler::setFenceMask(const uint8_t* fence_mask, int width, int height)
+{
+   Width = width;
+   Height = height;
+   Spans.clear();
+   SpanRowStart.resize( height + 1 );
+   for (int y = 0; y < height; ++y) {
+      SpanRowStart[y] = static_cast<int>(Spans.size());
+      const uint8_t* row = fence_mask + static_cast<size_t>(y) * width;
+      int x = findNonzero( row, 0, width );
+      while (x < width) {
+         const uint8_t label = row[x];
+         const int begin = x;
+         while (x < width && row[x] == label) ++x;
+         Spans.emplace_back( y, begin, x, label );
+         if (x < width && row[x] == 0) x = findNonzero( row, x, width );
+      }
+   }
+   SpanRowStart[height] = static_cast<int>(Spans.size());
+}
+
+int FenceBlobLabeler::findRoot(std::vector<int>& parents, int index)
+{
+   while (parents[index] != index) {
+      parents[index] = parents[parents[index]];
+      index = parents[index];
+   }
+   return index;
+}
+
+void FenceBlobLabeler::unite(std::vector<int>& parents, int a, int b)
+{
+   a = findRoot( parents, a );
+   b = findRoot( parents, b );
+   if (a < b) parents[b] = a;
+   else if (b < a) parents[a] = b;
+}
+
+void FenceBlobLabeler::uniteAdjacentRows(
+   std::vector<int>& parents,
+   const std::vector<FenceSpan>& runs,
+   int upper_begin,
+   int upper_end,
+   int lower_begin,
+   int lower_end
+)
+{
+   int i = upper_begin, j = lower_begin;
+   while (i < upper_end && j < lower_end) {
+      const FenceSpan& upper = runs[i];
+      const FenceSpan& lower = runs[j];
+      if (upper.End < lower.Begin) ++i;
+      else if (lower.End < upper.Begin) ++j;
+      else {
+         if (upper.Label == lower.Label) unite( parents, i, j );
+         if (upper.End < lower.End) ++i;
+         else ++j;
+      }
+   }
+}
+
+void FenceBlobLabeler::labelBand(Band& band, const uint8_t* foreground) const
+{
+   band.Runs.clear();
+   band.RowStart.resize( band.LastRow - band.FirstRow + 2 );
+   for (int y = band.FirstRow; y <= band.LastRow; ++y) {
+      band.RowStart[y - band.FirstRow] = static_cast<int>(band.Runs.size());
+      const uint8_t* row = foreground + static_cast<size_t>(y) * Width;
+      for (int s = SpanRowStart[y]; s < SpanRowStart[y + 1]; ++s) {
+         const FenceSpan& span = Spans[s];
+         int x = findNonzero( row, span.Begin, span.End );
+         while (x < span.End) {
+            const int end = findZero( row, x, span.End );
+            band.Runs.emplace_back( y, x, end, span.Label );
+            x = findNonzero( row, end, span.End );
+         }
+      }
+   }
+   band.RowStart.back() = static_cast<int>(band.Runs.size());
+
+   band.Parents.resize( band.Runs.size() );
+   for (size_t i = 0; i < band.Parents.size(); ++i) band.Parents[i] = static_cast<int>(i);
+   for (int y = band.FirstRow + 1; y <= band.LastRow; ++y) {
+      const int r = y - band.FirstRow;
+      uniteAdjacentRows(
+         band.Parents, band.Runs,
+         band.RowStart[r - 1], band.RowStart[r],
+         band.RowStart[r], band.RowStart[r + 1]
+      );
+   }
+}
+
+void FenceBlobLabeler::label(std::vector<FenceBlob>& blobs, const uint8_t* foreground) const
+{
+   blobs.clear();
+   if (Spans.empty()) return;
+
+   // only the rows covered by fences are visited, so the work follows the fenced area
+   const int first_row = Spans.front().Y;
+   const int last_row = Spans.back().Y;
+   const int n_rows = last_row - first_row + 1;
+   const int n_bands = std::min( n_rows, std::max( 1, static_cast<int>(std::thread::hardware_concurrency()) ) );
+   const int rows_per_band = (n_rows + n_bands - 1) / n_bands;
+
+   std::vector<Band> bands;
+   for (int y = first_row; y <= last_row; y += rows_per_band) {
+      Band band;
+      band.FirstRow = y;
+      band.LastRow = std::min( y + rows_per_band - 1, last_row );
+      bands.emplace_back( std::move( band ) );
+   }
+   parallelFor(
+      0, static_cast<int>(bands.size()),
+      [this, &bands, foreground](int begin, int end)
+      {
+         for (int b = begin; b < end; ++b) labelBand( bands[b], foreground );
+      }
+   );
+
+   std::vector<FenceSpan> runs;
+   std::vector<int> parents;
+   std::vector<int> band_offsets;
+   for (const auto& band : bands) {
+      const int offset = static_cast<int>(runs.size());
+      band_offsets.emplace_back( offset );
+      runs.insert( runs.end(), band.Runs.begin(), band.Runs.end() );
+      for (const auto& parent : band.Parents) parents.emplace_back( parent + offset );
+   }
+   for (size_t b = 1; b < bands.size(); ++b) {
+      const Band& upper = bands[b - 1];
+      const Band& lower = bands[b];
+      const int upper_rows = upper.LastRow - upper.FirstRow + 1;
+      uniteAdjacentRows(
+         parents, runs,
+         band_offsets[b - 1] + upper.RowStart[upper_rows - 1], band_offsets[b - 1] + upper.RowStart[upper_rows],
+         band_offsets[b] + lower.RowStart[0], band_offsets[b] + lower.RowStart[1]
+      );
+   }
+
+   std::vector<int> blob_indices(runs.size(), -1);
+   for (size_t i = 0; i < runs.size(); ++i) {
+      const int root = findRoot( parents, static_cast<int>(i) );
+      const FenceSpan& run = runs[i];
+      if (blob_indices[root] < 0) {
+         blob_indices[root] = static_cast<int>(blobs.size());
+         FenceBlob blob;
+         blob.Left = run.Begin;
+         blob.Top = run.Y;
+         blob.Right = run.End - 1;
+         blob.Bottom = run.Y;
+         blob.FenceLabel = run.Label;
+         blobs.emplace_back( blob );
+      }
+      FenceBlob& blob = blobs[blob_indices[root]];
+      blob.Area += run.End - run.Begin;
+      blob.Left = std::min( blob.Left, run.Begin );
+      blob.Right = std::max( blob.Right, run.End - 1 );
+      blob.Bottom = std::max( blob.Bottom, run.Y );
+   }
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "_Common.h"
+
+struct FenceSpan
+{
+	int Y;
+	int Begin;
+	int End; // exclusive
+	uint8_t Label;
+
+	FenceSpan() : Y( 0 ), Begin( 0 ), End( 0 ), Label( 0 ) {}
+	FenceSpan(int y, int begin, int end, uint8_t label) : Y( y ), Begin( begin ), End( end ), Label( label ) {}
+};
+
+struct FenceBlob
+{
+	int Area;
+	int Left;
+	int Top;
+	int Right; // inclusive
+	int Bottom; // inclusive
+	uint8_t FenceLabel;
+
+	FenceBlob() : Area( 0 ), Left( 0 ), Top( 0 ), Right( 0 ), Bottom( 0 ), FenceLabel( 0 ) {}
+};
+
+class FenceBlobLabeler
+{
+public:
+	FenceBlobLabeler();
+
+	// fence_mask is top-down with 0 for outside and the fence label otherwise
+	void setFenceMask(const uint8_t* fence_mask, int width, int height);
+	const std::vector<FenceSpan>& getFenceSpans() const { return Spans; }
+	// 8-connected blobs of nonzero foreground pixels, where a blob never crosses fences of different labels
+	void label(std::vector<FenceBlob>& blobs, const uint8_t* foreground) const;
+
+private:
+	struct Band
+	{
+		std::vector<FenceSpan> Runs;
+		std::vector<int> RowStart; // Runs[RowStart[y - FirstRow]] is the first run of row y
+		std::vector<int> Parents;
+		int FirstRow;
+		int LastRow;
+	};
+
+	int Width;
+	int Height;
+	std::vector<FenceSpan> Spans;
+	std::vector<int> SpanRowStart; // Spans[SpanRowStart[y]] is the first span of row y
+
+	static int findRoot(std::vector<int>& parents, int index);
+	static void unite(std::vector<int>& parents, int a, int b);
+	static void uniteAdjacentRows(
+		std::vector<int>& parents,
+		const std::vector<FenceSpan>& runs,
+		int upper_begin,
+		int upper_end,
+		int lower_begin,
+		int lower_end
+	);
+	void labelBand(Band& band, const uint8_t* foreground) const;
+};
\ No newline at end of file
@@ -0,0 +1,387 @@
+#include "FenceContour.h"
+
+namespace
+{
+   enum CellEdge { TOP = 0, RIGHT, BOTTOM, LEFT, NONE };
+
+   // oriented segments for each marching squares case with the fence on the left, where the corner bits are
+   // 8 for top-left, 4 for top-right, 2 for bottom-right and 1 for bottom-left
+   constexpr CellEdge SegmentTable[16][4] = {
+      { NONE, NONE, NONE, NONE },
+      { BOTTOM, LEFT, NONE, NONE },
+      { RIGHT, BOTTOM, NONE, NONE },
+      { RIGHT, LEFT, NONE, NONE },
+      { TOP, RIGHT, NONE, NONE },
+      { TOP, LEFT, BOTTOM, RIGHT },
+      { TOP, BOTTOM, NONE, NONE },
+      { TOP, LEFT, NONE, NONE },
+      { LEFT, TOP, NONE, NONE },
+      { BOTTOM, TOP, NONE, NONE },
+      { RIGHT, TOP, LEFT, BOTTOM },
+      { RIGHT, TOP, NONE, NONE },
+      { LEFT, RIGHT, NONE, NONE },
+      { BOTTOM, RIGHT, NONE, NONE },
+      { LEFT, BOTTOM, NONE, NONE },
+      { NONE, NONE, NONE, NONE }
+   };
+
+   struct Segment
+   {
+      int64_t From;
+      int64_t To;
+
+      Segment(int64_t from, int64_t to) : From( from ), To( to ) {}
+   };
+
+   class EdgeGrid
+   {
+   public:
+      explicit EdgeGrid(int width) : GridWidth( width + 2 ) {}
+
+      // corners are pixel centers, and the grid is padded by one so that contours touching the border close
+      int64_t getEdge(int x, int y, CellEdge edge) const
+      {
+         switch (edge) {
+            case TOP: return 2 * getCorner( x, y );
+            case RIGHT: return 2 * getCorner( x + 1, y ) + 1;
+            case BOTTOM: return 2 * getCorner( x, y + 1 );
+            default: return 2 * getCorner( x, y ) + 1;
+         }
+      }
+
+      glm::vec2 getPoint(int64_t edge) const
+      {
+         const int64_t corner = edge / 2;
+         const auto x = static_cast<float>(corner % GridWidth - 1);
+         const auto y = static_cast<float>(corner / GridWidth - 1);
+         return edge % 2 == 0 ? glm::vec2(x + 1.0f, y + 0.5f) : glm::vec2(x + 0.5f, y + 1.0f);
+      }
+
+   private:
+      int64_t GridWidth;
+
+      int64_t getCorner(int x, int y) const { return (static_cast<int64_t>(y) + 1) * GridWidth + x + 1; }
+   };
+
+   bool isUniformBlock(const uint8_t* upper_row, const uint8_t* lower_row, int x, uint8_t label)
+   {
+#ifdef USE_SSE2
+      const __m128i labels = _mm_set1_epi8( static_cast<char>(label) );
+      const int upper = _mm_movemask_epi8(
+         _mm_cmpeq_epi8( _mm_loadu_si128( reinterpret_cast<const __m128i*>(upper_row + x) ), labels )
+      );
+      const int lower = _mm_movemask_epi8(
+         _mm_cmpeq_epi8( _mm_loadu_si128( reinterpret_cast<const __m128i*>(lower_row + x) ), labels )
+      );
+      return upper == lower && (upper == 0 || upper == 0xFFFF);
+#else
+      const bool inside = upper_row[x] == label;
+      for (int i = 0; i < 16; ++i) {
+         if ((upper_row[x + i] == label) != inside || (lower_row[x + i] == label) != inside) return false;
+      }
+      return true;
+#endif
+   }
+
+   void getSegments(
+      std::vector<Segment>& segments,
+      const EdgeGrid& grid,
+      const uint8_t* fence_mask,
+      int width,
+      int height,
+      uint8_t label,
+      int first_cell_row,
+      int last_cell_row
+   )
+   {
+      const auto inside = [fence_mask, width, height, label](int x, int y)
+      {
+         return x >= 0 && y >= 0 && x < width && y < height && fence_mask[y * width + x] == label;
+      };
+
+      for (int y = first_cell_row; y <= last_cell_row; ++y) {
+         const bool interior_row = y >= 0 && y + 1 < height;
+         const uint8_t* upper_row = fence_mask + static_cast<size_t>(std::max( y, 0 )) * width;
+         const uint8_t* lower_row = upper_row + width;
+         for (int x = -1; x < width; ++x) {
+            if (interior_row && x >= 0 && x + 16 <= width && isUniformBlock( upper_row, lower_row, x, label )) {
+               x += 14;
+               continue;
+            }
+
+            const int cell_case =
+               (inside( x, y ) ? 8 : 0) | (inside( x + 1, y ) ? 4 : 0) |
+               (inside( x + 1, y + 1 ) ? 2 : 0) | (inside( x, y + 1 ) ? 1 : 0);
+            const CellEdge* edges = SegmentTable[cell_case];
+            for (int i = 0; i < 4 && edges[i] != NONE; i += 2) {
+               segments.emplace_back( grid.getEdge( x, y, edges[i] ), grid.getEdge( x, y, edges[i + 1] ) );
+            }
+         }
+      }
+   }
+
+   float getDistanceToSegment(const glm::vec2& point, const glm::vec2& a, const glm::vec2& b)
+   {
+      const glm::vec2 ab = b - a;
+      const float length_squared = dot( ab, ab );
+      if (length_squared == 0.0f) return distance( point, a );
+      const float t = std::clamp( dot( point - a, ab ) / length_squared, 0.0f, 1.0f );
+      return distance( point, a + t * ab );
+   }
+
+   int getFarthestPoint(float& max_distance, const std::vector<glm::vec2>& points, int first, int last)
+   {
+      const auto n = static_cast<int>(points.size());
+      const glm::vec2& a = points[first % n];
+      const glm::vec2& b = points[last % n];
+      int farthest = -1;
+      max_distance = -1.0f;
+      for (int i = first + 1; i < last; ++i) {
+         const float d = getDistanceToSegment( points[i % n], a, b );
+         if (d > max_distance) {
+            max_distance = d;
+            farthest = i;
+         }
+      }
+      return farthest;
+   }
+
+   void simplifyPolygon(std::vector<glm::vec2>& points, float tolerance)
+   {
+      const auto n = static_cast<int>(points.size());
+      if (n < 4) return;
+
+      // a closed polygon is split into two chains at the point farthest from the first one
+      int split = 0;
+      for (int i = 1; i < n; ++i) {
+         if (distance( points[i], points[0] ) > distance( points[split], points[0] )) split = i;
+      }
+
+      std::vector<bool> keep(n, false);
+      keep[0] = keep[split] = true;
+      std::vector<std::pair<int, int>> chains = { { 0, split }, { split, n } };
+      while (!chains.empty()) {
+         const auto [first, last] = chains.back();
+         chains.pop_back();
+
+         float max_distance;
+         const int farthest = getFarthestPoint( max_distance, points, first, last );
+         if (farthest >= 0 && max_distance > tolerance) {
+            keep[farthest] = true;
+            chains.emplace_back( first, farthest );
+            chains.emplace_back( farthest, last );
+         }
+      }
+      if (std::count( keep.begin(), keep.end(), true ) < 3) {
+         float max_distance;
+         const int farthest = getFarthestPoint( max_distance, points, split, n );
+         if (farthest >= 0) keep[farthest] = true;
+      }
+
+      std::vector<glm::vec2> simplified;
+      for (int i = 0; i < n; ++i) {
+         if (keep[i]) simplified.emplace_back( points[i] );
+      }
+      points.swap( simplified );
+   }
+
+   void writeVarint(std::vector<uint8_t>& data, uint64_t value)
+   {
+      while (value >= 0x80) {
+         data.emplace_back( static_cast<uint8_t>(value | 0x80) );
+         value >>= 7;
+      }
+      data.emplace_back( static_cast<uint8_t>(value) );
+   }
+
+   bool readVarint(uint64_t& value, const std::vector<uint8_t>& data, size_t& offset)
+   {
+      value = 0;
+      for (int shift = 0; shift < 64 && offset < data.size(); shift += 7) {
+         const uint8_t byte = data[offset++];
+         value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+         if ((byte & 0x80) == 0) return true;
+      }
+      return false;
+   }
+
+   uint64_t encodeZigzag(int64_t value) { return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); }
+   int64_t decodeZigzag(uint64_t value) { return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1); }
+}
+
+void extractFenceContours(std::vector<FencePolygon>& polygons, const uint8_t* fence_mask, int width, int height)
+{
+   polygons.clear();
+
+   bool exists[256] = { false, };
+   const int size = width * height;
+   for (int i = 0; i < size; ++i) exists[fence_mask[i]] = true;
+
+   const EdgeGrid grid(width);
+   const int n_cell_rows = height + 1;
+   const int n_bands = std::min( n_cell_rows, std::max( 1, static_cast<int>(std::thread::hardware_concurrency()) ) );
+   const int rows_per_band = (n_cell_rows + n_bands - 1) / n_bands;
+   for (int label = 1; label < 256; ++label) {
+      if (!exists[label]) continue;
+
+      std::vector<std::vector<Segment>> band_segments(n_bands);
+      parallelFor(
+         0, n_bands,
+         [&](int begin, int end)
+         {
+            for (int b = begin; b < end; ++b) {
+               const int first_cell_row = b * rows_per_band - 1;
+               const int last_cell_row = std::min( first_cell_row + rows_per_band - 1, height - 1 );
+               getSegments(
+                  band_segments[b], grid, fence_mask, width, height,
+                  static_cast<uint8_t>(label), first_cell_row, last_cell_row
+               );
+            }
+         }
+      );
+
+      std::unordered_map<int64_t, int64_t> next_edges;
+      for (const auto& segments : band_segments) {
+         for (const auto& segment : segments) next_edges.emplace( segment.From, segment.To );
+      }
+      for (const auto& segments : band_segments) {
+         for (const auto& segment : segments) {
+            auto it = next_edges.find( segment.From );
+            if (it == next_edges.end()) continue;
+
+            FencePolygon polygon(static_cast<uint8_t>(label));
+            while (it != next_edges.end()) {
+               polygon.Points.emplace_back( grid.getPoint( it->first ) );
+               const int64_t next_edge = it->second;
+               next_edges.erase( it );
+               it = next_edges.find( next_edge );
+            }
+            polygons.emplace_back( std::move( polygon ) );
+         }
+      }
+   }
+}
+
+void simplifyFenceContours(std::vector<FencePolygon>& polygons, float tolerance_in_pixel)
+{
+   parallelFor(
+      0, static_cast<int>(polygons.size()),
+      [&polygons, tolerance_in_pixel](int begin, int end)
+      {
+         for (int i = begin; i < end; ++i) simplifyPolygon( polygons[i].Points, tolerance_in_pixel );
+      }
+   );
+}
+
+void encodeFenceContours(std::vector<uint8_t>& data, const std::vector<FencePolygon>& polygons, int width, int height)
+{
+   data = { 'V', 'F', 'C', '1' };
+   writeVarint( data, static_cast<uint64_t>(width) );
+   writeVarint( data, static_cast<uint64_t>(height) );
+   writeVarint( data, polygons.size() );
+   for (const auto& polygon : polygons) {
+      data.emplace_back( polygon.Label );
+      writeVarint( data, polygon.Points.size() );
+
+      int64_t previous_x = 0, previous_y = 0;
+      for (const auto& point : polygon.Points) {
+         const int64_t x = std::llround( point.x * 2.0f );
+         const int64_t y = std::llround( point.y * 2.0f );
+         writeVarint( data, encodeZigzag( x - previous_x ) );
+         writeVarint( data, encodeZigzag( y - previous_y ) );
+         previous_x = x;
+         previous_y = y;
+      }
+   }
+}
+
+bool decodeFenceContours(std::vector<FencePolygon>& polygons, int& width, int& height, const std::vector<uint8_t>& data)
+{
+   polygons.clear();
+   if (data.size() < 4 || std::memcmp( data.data(), "VFC1", 4 ) != 0) return false;
+
+   size_t offset = 4;
+   // the size scales every point when rasterized, so an empty or unrepresentable one makes the file invalid
+   constexpr auto max_size = static_cast<uint64_t>(std::numeric_limits<int>::max());
+   uint64_t value, n_polygons;
+   if (!readVarint( value, data, offset ) || value == 0 || value > max_size) return false;
+   width = static_cast<int>(value);
+   if (!readVarint( value, data, offset ) || value == 0 || value > max_size) return false;
+   height = static_cast<int>(value);
+   if (!readVarint( n_polygons, data, offset )) return false;
+
+   for (uint64_t p = 0; p < n_polygons; ++p) {
+      if (offset >= data.size()) return false;
+      FencePolygon polygon(data[offset++]);
+
+      uint64_t n_points;
+      if (!readVarint( n_points, data, offset ) || n_points > data.size()) return false;
+
+      int64_t x = 0, y = 0;
+      for (uint64_t i = 0; i < n_points; ++i) {
+         uint64_t dx, dy;
+         if (!readVarint( dx, data, offset ) || !readVarint( dy, data, offset )) return false;
+         x += decodeZigzag( dx );
+         y += decodeZigzag( dy );
+         polygon.Points.emplace_back( static_cast<float>(x) * 0.5f, static_cast<float>(y) * 0.5f );
+      }
+      polygons.emplace_back( std::move( polygon ) );
+   }
+   return true;
+}
+
+void rasterizeFenceContours(
+   std::vector<uint8_t>& fence_mask,
+   const std::vector<FencePolygon>& polygons,
+   int source_width,
+   int source_height,
+   int width,
+   int height
+)
+{
+   if (width <= 0 || height <= 0 || source_width <= 0 || source_height <= 0) {
+      fence_mask.clear();
+      return;
+   }
+
+   fence_mask.assign( static_cast<size_t>(width) * height, 0 );
+   const glm::vec2 to_target(
+      static_cast<float>(width) / static_cast<float>(source_width),
+      static_cast<float>(height) / static_cast<float>(source_height)
+   );
+
+   std::map<uint8_t, std::vector<std::pair<glm::vec2, glm::vec2>>> label_edges;
+   for (const auto& polygon : polygons) {
+      auto& edges = label_edges[polygon.Label];
+      const size_t n = polygon.Points.size();
+      for (size_t i = 0; i < n; ++i) {
+         edges.emplace_back( polygon.Points[i] * to_target, polygon.Points[(i + 1) % n] * to_target );
+      }
+   }
+
+   parallelFor(
+      0, height,
+      [&](int begin, int end)
+      {
+         std::vector<float> crossings;
+         for (int y = begin; y < end; ++y) {
+            const float center_y = static_cast<float>(y) + 0.5f;
+            uint8_t* row = fence_mask.data() + static_cast<size_t>(y) * width;
+            for (const auto& [label, edges] : label_edges) {
+               crossings.clear();
+               for (const auto& [a, b] : edges) {
+                  if ((a.y <= center_y && center_y < b.y) || (b.y <= center_y && center_y < a.y)) {
+                     crossings.emplace_back( a.x + (center_y - a.y) * (b.x - a.x) / (b.y - a.y) );
+                  }
+               }
+               std::sort( crossings.begin(), crossings.end() );
+               for (size_t i = 0; i + 1 < crossings.size(); i += 2) {
+                  const int x0 = std::max( static_cast<int>(std::ceil( crossings[i] - 0.5f )), 0 );
+                  const int x1 = std::min( static_cast<int>(std::ceil( crossings[i + 1] - 0.5f )), width );
+                  if (x0 < x1) std::memset( row + x0, label, x1 - x0 );
+               }
+            }
+         }
+      }
+   );
+}
\ No newline at end of file
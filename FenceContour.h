@@ -0,0 +1,40 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "_Common.h"
+
+struct FencePolygon
+{
+	uint8_t Label;
+	std::vector<glm::vec2> Points; // closed, in continuous image coordinates where pixel (x, y) covers [x, x + 1) x [y, y + 1)
+
+	FencePolygon() : Label( 0 ) {}
+	explicit FencePolygon(uint8_t label) : Label( label ) {}
+};
+
+// marching squares over every fence label of a top-down mask, where diagonal pixels of a label are connected
+void extractFenceContours(std::vector<FencePolygon>& polygons, const uint8_t* fence_mask, int width, int height);
+// Douglas-Peucker with the given maximum deviation in pixels, run in parallel over polygons
+void simplifyFenceContours(std::vector<FencePolygon>& polygons, float tolerance_in_pixel);
+
+// the vector format stores half-pixel coordinates as zigzag varint deltas, after a "VFC1" tag, the mask size
+// and the polygon count
+void encodeFenceContours(std::vector<uint8_t>& data, const std::vector<FencePolygon>& polygons, int width, int height);
+bool decodeFenceContours(std::vector<FencePolygon>& polygons, int& width, int& height, const std::vector<uint8_t>& data);
+// even-odd fill of each label at any target resolution, which leaves the mask empty if a size is not positive
+void rasterizeFenceContours(
+	std::vector<uint8_t>& fence_mask,
+	const std::vector<FencePolygon>& polygons,
+	int source_width,
+	int source_height,
+	int width,
+	int height
+);
\ No newline at end of file
@@ -0,0 +1,274 @@
+#include "FenceCropPlanner.h"
+
+FenceCropPlanner::FenceCropPlanner() :
+   CropWidth( 640 ), CropHeight( 640 ), Overlap( 64 ), BatchSize( 8 ), FrameWidth( 0 ), FrameHeight( 0 )
+{
+}
+
+void FenceCropPlanner::reset()
+{
+   PreviousMask.clear();
+   Crops.clear();
+   Regions.clear();
+}
+
+void FenceCropPlanner::setCropSize(int width, int height, int overlap)
+{
+   CropWidth = std::max( width, 1 );
+   CropHeight = std::max( height, 1 );
+   Overlap = std::clamp( overlap, 0, std::min( CropWidth, CropHeight ) - 1 );
+   reset();
+}
+
+void FenceCropPlanner::setBatchSize(int batch_size)
+{
+   BatchSize = std::max( batch_size, 1 );
+}
+
+int FenceCropPlanner::getBatchCount() const
+{
+   return (static_cast<int>(Crops.size()) + BatchSize - 1) / BatchSize;
+}
+
+int FenceCropPlanner::getActiveCropCount() const
+{
+   return static_cast<int>(std::count_if( Crops.begin(), Crops.end(), [](const FenceCrop& crop) { return crop.Active; } ));
+}
+
+void FenceCropPlanner::getCropStarts(std::vector<int>& starts, int begin, int end, int crop_size, int overlap, int frame_size)
+{
+   starts.clear();
+   const int length = end - begin;
+   if (length <= crop_size) {
+      starts.emplace_back( std::clamp( begin - (crop_size - length) / 2, 0, std::max( frame_size - crop_size, 0 ) ) );
+      return;
+   }
+
+   // the fewest crops whose spacing never exceeds crop_size - overlap, spread evenly over the extent
+   const int step = crop_size - overlap;
+   const int n = (length - overlap + step - 1) / step;
+   for (int k = 0; k < n; ++k) {
+      starts.emplace_back( begin + static_cast<int>(static_cast<int64_t>(k) * (length - crop_size) / (n - 1)) );
+   }
+}
+
+int FenceCropPlanner::getCropCount(int left, int top, int right, int bottom) const
+{
+   const auto count = [this](int length, int crop_size)
+   {
+      if (length <= crop_size) return 1;
+      const int step = crop_size - Overlap;
+      return (length - Overlap + step - 1) / step;
+   };
+   return count( right - left, CropWidth ) * count( bottom - top, CropHeight );
+}
+
+void FenceCropPlanner::mergeRegions(std::vector<Region>& regions) const
+{
+   // nearby regions share crops whenever their union does not need more crops than both of them apart.
+   // a gap adds a crop per crop size - overlap pixels, so regions farther apart than two crops minus the overlap
+   // along either axis never merge, and a sweep over the regions sorted by their left edges pairs up only those nearby
+   const int reach_x = 2 * CropWidth - Overlap;
+   const int reach_y = 2 * CropHeight - Overlap;
+   bool merged = true;
+   while (merged) {
+      merged = false;
+      std::sort( regions.begin(), regions.end(), [](const Region& a, const Region& b) { return a.Left < b.Left; } );
+      std::vector<bool> removed(regions.size(), false);
+      for (size_t i = 0; i < regions.size(); ++i) {
+         if (removed[i]) continue;
+
+         Region& a = regions[i];
+         for (size_t j = i + 1; j < regions.size() && regions[j].Left - a.Right <= reach_x; ++j) {
+            const Region& b = regions[j];
+            if (removed[j] || b.Top - a.Bottom > reach_y || a.Top - b.Bottom > reach_y) continue;
+
+            const Region united(
+               std::min( a.Left, b.Left ), std::min( a.Top, b.Top ),
+               std::max( a.Right, b.Right ), std::max( a.Bottom, b.Bottom )
+            );
+            if (getCropCount( united.Left, united.Top, united.Right, united.Bottom ) <=
+                getCropCount( a.Left, a.Top, a.Right, a.Bottom ) + getCropCount( b.Left, b.Top, b.Right, b.Bottom )) {
+               // the grown region may now merge with those it was too far from, so they are checked again
+               a = united;
+               removed[j] = true;
+               merged = true;
+               j = i;
+            }
+         }
+      }
+      size_t n = 0;
+      for (size_t i = 0; i < regions.size(); ++i) {
+         if (removed[i]) continue;
+         if (n != i) regions[n] = std::move( regions[i] );
+         n++;
+      }
+      regions.resize( n );
+   }
+}
+
+bool FenceCropPlanner::getDirtyRect(Region& dirty, const uint8_t* fence_mask) const
+{
+   dirty = Region(FrameWidth, FrameHeight, 0, 0);
+   for (int y = 0; y < FrameHeight; ++y) {
+      const uint8_t* row = fence_mask + static_cast<size_t>(y) * FrameWidth;
+      const uint8_t* previous_row = PreviousMask.data() + static_cast<size_t>(y) * FrameWidth;
+      int x = 0;
+#ifdef USE_SSE2
+      for (; x + 16 <= FrameWidth; x += 16) {
+         const __m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>(row + x) );
+         const __m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i*>(previous_row + x) );
+         if (_mm_movemask_epi8( _mm_cmpeq_epi8( a, b ) ) != 0xFFFF) break;
+      }
+#endif
+      while (x < FrameWidth && row[x] == previous_row[x]) ++x;
+      if (x == FrameWidth) continue;
+
+      int last = FrameWidth - 1;
+      while (row[last] == previous_row[last]) --last;
+      dirty.Left = std::min( dirty.Left, x );
+      dirty.Right = std::max( dirty.Right, last + 1 );
+      dirty.Top = std::min( dirty.Top, y );
+      dirty.Bottom = y + 1;
+   }
+   return dirty.Left < dirty.Right;
+}
+
+bool FenceCropPlanner::hasFencePixel(const uint8_t* fence_mask, int x, int y) const
+{
+   const int right = std::min( x + CropWidth, FrameWidth );
+   const int bottom = std::min( y + CropHeight, FrameHeight );
+   for (int j = y; j < bottom; ++j) {
+      const uint8_t* row = fence_mask + static_cast<size_t>(j) * FrameWidth;
+      int i = x;
+#ifdef USE_SSE2
+      const __m128i zero = _mm_setzero_si128();
+      for (; i + 16 <= right; i += 16) {
+         const __m128i pixels = _mm_loadu_si128( reinterpret_cast<const __m128i*>(row + i) );
+         if (_mm_movemask_epi8( _mm_cmpeq_epi8( pixels, zero ) ) != 0xFFFF) return true;
+      }
+#endif
+      for (; i < right; ++i) {
+         if (row[i] != 0) return true;
+      }
+   }
+   return false;
+}
+
+int FenceCropPlanner::allocateSlot()
+{
+   for (size_t i = 0; i < Crops.size(); ++i) {
+      if (!Crops[i].Active) return static_cast<int>(i);
+   }
+   Crops.emplace_back();
+   return static_cast<int>(Crops.size()) - 1;
+}
+
+void FenceCropPlanner::planRegion(Region& region, const uint8_t* fence_mask)
+{
+   std::vector<int> xs, ys;
+   getCropStarts( xs, region.Left, region.Right, CropWidth, Overlap, FrameWidth );
+   getCropStarts( ys, region.Top, region.Bottom, CropHeight, Overlap, FrameHeight );
+   for (const int y : ys) {
+      for (const int x : xs) {
+         // crops over gaps between the fences of a merged region are dropped
+         if (!hasFencePixel( fence_mask, x, y )) continue;
+
+         const int slot = allocateSlot();
+         Crops[slot] = FenceCrop(x, y);
+         region.Slots.emplace_back( slot );
+         ChangedSlots.emplace_back( slot );
+      }
+   }
+}
+
+bool FenceCropPlanner::update(const uint8_t* fence_mask, int width, int height)
+{
+   ChangedSlots.clear();
+   if (width != FrameWidth || height != FrameHeight) {
+      for (size_t i = 0; i < Crops.size(); ++i) {
+         if (Crops[i].Active) ChangedSlots.emplace_back( static_cast<int>(i) );
+      }
+      reset();
+      FrameWidth = width;
+      FrameHeight = height;
+   }
+
+   Region dirty(0, 0, FrameWidth, FrameHeight);
+   if (!PreviousMask.empty() && !getDirtyRect( dirty, fence_mask )) return false;
+   PreviousMask.assign( fence_mask, fence_mask + static_cast<size_t>(width) * height );
+
+   std::vector<FenceBlob> blobs;
+   Labeler.setFenceMask( fence_mask, width, height );
+   Labeler.label( blobs, fence_mask );
+   std::vector<Region> regions;
+   for (const auto& blob : blobs) regions.emplace_back( blob.Left, blob.Top, blob.Right + 1, blob.Bottom + 1 );
+   mergeRegions( regions );
+
+   // regions away from the edit keep their crops and slots
+   std::vector<bool> kept(Regions.size(), false);
+   std::vector<bool> planned(regions.size(), false);
+   for (size_t i = 0; i < regions.size(); ++i) {
+      Region& region = regions[i];
+      const bool touched = region.Left < dirty.Right && dirty.Left < region.Right &&
+         region.Top < dirty.Bottom && dirty.Top < region.Bottom;
+      if (touched) continue;
+
+      for (size_t j = 0; j < Regions.size(); ++j) {
+         const Region& previous = Regions[j];
+         if (!kept[j] && previous.Left == region.Left && previous.Top == region.Top &&
+             previous.Right == region.Right && previous.Bottom == region.Bottom) {
+            region.Slots = previous.Slots;
+            kept[j] = true;
+            planned[i] = true;
+            break;
+         }
+      }
+   }
+   for (size_t j = 0; j < Regions.size(); ++j) {
+      if (kept[j]) continue;
+      for (const int slot : Regions[j].Slots) {
+         Crops[slot] = FenceCrop();
+         ChangedSlots.emplace_back( slot );
+      }
+   }
+   for (size_t i = 0; i < regions.size(); ++i) {
+      if (!planned[i]) planRegion( regions[i], fence_mask );
+   }
+   while (!Crops.empty() && !Crops.back().Active) Crops.pop_back();
+
+   std::sort( ChangedSlots.begin(), ChangedSlots.end() );
+   ChangedSlots.erase( std::unique( ChangedSlots.begin(), ChangedSlots.end() ), ChangedSlots.end() );
+   Regions = std::move( regions );
+   return !ChangedSlots.empty();
+}
+
+void FenceCropPlanner::gatherBatch(uint8_t* batch_buffer, int batch_index, const uint8_t* frame, int channels) const
+{
+   const size_t crop_row_size = static_cast<size_t>(CropWidth) * channels;
+   const size_t crop_size = crop_row_size * CropHeight;
+   for (int s = 0; s < BatchSize; ++s) {
+      uint8_t* crop_buffer = batch_buffer + s * crop_size;
+      const auto slot = static_cast<size_t>(batch_index) * BatchSize + s;
+      if (slot >= Crops.size() || !Crops[slot].Active) {
+         std::memset( crop_buffer, 0, crop_size );
+         continue;
+      }
+
+      // crops larger than the frame are padded with zero
+      const FenceCrop& crop = Crops[slot];
+      const int copy_width = std::min( CropWidth, FrameWidth - crop.X );
+      const int copy_height = std::min( CropHeight, FrameHeight - crop.Y );
+      const size_t copy_row_size = static_cast<size_t>(copy_width) * channels;
+      for (int y = 0; y < CropHeight; ++y) {
+         uint8_t* destination = crop_buffer + y * crop_row_size;
+         if (y >= copy_height) {
+            std::memset( destination, 0, crop_row_size );
+            continue;
+         }
+         const uint8_t* source = frame + (static_cast<size_t>(crop.Y + y) * FrameWidth + crop.X) * channels;
+         std::memcpy( destination, source, copy_row_size );
+         if (copy_row_size < crop_row_size) std::memset( destination + copy_row_size, 0, crop_row_size - copy_row_size );
+      }
+   }
+}
\ No newline at end of file
@@ -0,0 +1,81 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "FenceBlobLabeler.h"
+
+struct FenceCrop
+{
+	int X; // top-left corner in image coordinates
+	int Y;
+	bool Active; // false for a free slot of the batch layout
+
+	FenceCrop() : X( 0 ), Y( 0 ), Active( false ) {}
+	FenceCrop(int x, int y) : X( x ), Y( y ), Active( true ) {}
+};
+
+// plans fixed-size detector crops that cover every fenced pixel. crops live in stable slots, where slot i is
+// the (i % batch size)-th input of the (i / batch size)-th batch, so a fence edit only rewrites the slots it touches.
+class FenceCropPlanner
+{
+public:
+	FenceCropPlanner();
+
+	// overlap is the minimum number of pixels shared by neighboring crops of the same fence region
+	void setCropSize(int width, int height, int overlap);
+	void setBatchSize(int batch_size);
+	// fence_mask is top-down with 0 for outside, and it returns whether any crop changed
+	bool update(const uint8_t* fence_mask, int width, int height);
+	int getCropWidth() const { return CropWidth; }
+	int getCropHeight() const { return CropHeight; }
+	int getBatchSize() const { return BatchSize; }
+	int getBatchCount() const;
+	int getActiveCropCount() const;
+	const std::vector<FenceCrop>& getCrops() const { return Crops; }
+	// slots rewritten by the last update
+	const std::vector<int>& getChangedSlots() const { return ChangedSlots; }
+	// copies the crops of a batch from an interleaved top-down frame into batch_buffer as consecutive
+	// crop height x crop width x channels blocks, where free slots are filled with zero
+	void gatherBatch(uint8_t* batch_buffer, int batch_index, const uint8_t* frame, int channels) const;
+
+private:
+	struct Region
+	{
+		int Left;
+		int Top;
+		int Right; // exclusive
+		int Bottom; // exclusive
+		std::vector<int> Slots;
+
+		Region() : Left( 0 ), Top( 0 ), Right( 0 ), Bottom( 0 ) {}
+		Region(int left, int top, int right, int bottom) : Left( left ), Top( top ), Right( right ), Bottom( bottom ) {}
+	};
+
+	int CropWidth;
+	int CropHeight;
+	int Overlap;
+	int BatchSize;
+	int FrameWidth;
+	int FrameHeight;
+	std::vector<uint8_t> PreviousMask;
+	std::vector<FenceCrop> Crops;
+	std::vector<Region> Regions;
+	std::vector<int> ChangedSlots;
+	FenceBlobLabeler Labeler;
+
+	void reset();
+	static void getCropStarts(std::vector<int>& starts, int begin, int end, int crop_size, int overlap, int frame_size);
+	int getCropCount(int left, int top, int right, int bottom) const;
+	void mergeRegions(std::vector<Region>& regions) const;
+	bool getDirtyRect(Region& dirty, const uint8_t* fence_mask) const;
+	bool hasFencePixel(const uint8_t* fence_mask, int x, int y) const;
+	int allocateSlot();
+	void planRegion(Region& region, const uint8_t* fence_mask);
+};
\ No newline at end of file
@@ -0,0 +1,238 @@
+#include "FenceMaskComparator.h"
+#include "FenceMaskFile.h"
+#include "DistanceTransform.h"
+
+#include <filesystem>
+#include <limits>
+
+namespace
+{
+   struct PixelCounts
+   {
+      int Reference;
+      int Candidate;
+      int Intersection;
+
+      PixelCounts() : Reference( 0 ), Candidate( 0 ), Intersection( 0 ) {}
+   };
+
+   PixelCounts countLabelPixels(const uint8_t* reference, const uint8_t* candidate, int n, uint8_t label)
+   {
+      PixelCounts counts;
+      int i = 0;
+#if defined(USE_AVX2)
+      const __m256i labels = _mm256_set1_epi8( static_cast<char>(label) );
+      for (; i + 32 <= n; i += 32) {
+         const __m256i in_reference = _mm256_cmpeq_epi8(
+            _mm256_loadu_si256( reinterpret_cast<const __m256i*>(reference + i) ), labels
+         );
+         const __m256i in_candidate = _mm256_cmpeq_epi8(
+            _mm256_loadu_si256( reinterpret_cast<const __m256i*>(candidate + i) ), labels
+         );
+         counts.Reference += countBits( static_cast<uint>(_mm256_movemask_epi8( in_reference )) );
+         counts.Candidate += countBits( static_cast<uint>(_mm256_movemask_epi8( in_candidate )) );
+         counts.Intersection += countBits(
+            static_cast<uint>(_mm256_movemask_epi8( _mm256_and_si256( in_reference, in_candidate ) ))
+         );
+      }
+#elif defined(USE_SSE2)
+      const __m128i labels = _mm_set1_epi8( static_cast<char>(label) );
+      for (; i + 16 <= n; i += 16) {
+         const __m128i in_reference = _mm_cmpeq_epi8(
+            _mm_loadu_si128( reinterpret_cast<const __m128i*>(reference + i) ), labels
+         );
+         const __m128i in_candidate = _mm_cmpeq_epi8(
+            _mm_loadu_si128( reinterpret_cast<const __m128i*>(candidate + i) ), labels
+         );
+         counts.Reference += countBits( static_cast<uint>(_mm_movemask_epi8( in_reference )) );
+         counts.Candidate += countBits( static_cast<uint>(_mm_movemask_epi8( in_candidate )) );
+         counts.Intersection += countBits( static_cast<uint>(_mm_movemask_epi8( _mm_and_si128( in_reference, in_candidate ) )) );
+      }
+#endif
+      for (; i < n; ++i) {
+         const bool in_reference = reference[i] == label;
+         const bool in_candidate = candidate[i] == label;
+         counts.Reference += in_reference ? 1 : 0;
+         counts.Candidate += in_candidate ? 1 : 0;
+         counts.Intersection += in_reference && in_candidate ? 1 : 0;
+      }
+      return counts;
+   }
+
+   void getDiffImage(uint8_t* diff_image, const uint8_t* reference, const uint8_t* candidate, int n)
+   {
+      int i = 0;
+#ifdef USE_SSE2
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i missing = _mm_set1_epi8( static_cast<char>(128) );
+      const __m128i extra = _mm_set1_epi8( 127 );
+      for (; i + 16 <= n; i += 16) {
+         const __m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>(reference + i) );
+         const __m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i*>(candidate + i) );
+         const __m128i value = _mm_or_si128( missing, _mm_and_si128( _mm_cmpeq_epi8( a, zero ), extra ) );
+         _mm_storeu_si128( reinterpret_cast<__m128i*>(diff_image + i), _mm_andnot_si128( _mm_cmpeq_epi8( a, b ), value ) );
+      }
+#endif
+      for (; i < n; ++i) {
+         if (reference[i] == candidate[i]) diff_image[i] = 0;
+         else diff_image[i] = reference[i] != 0 ? 128 : 255;
+      }
+   }
+
+   void getBoundary(std::vector<uint8_t>& boundary, const uint8_t* mask, int width, int height, uint8_t label)
+   {
+      boundary.assign( static_cast<size_t>(width) * height, 0 );
+      for (int y = 0; y < height; ++y) {
+         for (int x = 0; x < width; ++x) {
+            const int i = y * width + x;
+            if (mask[i] != label) continue;
+            boundary[i] =
+               (x > 0 && mask[i - 1] != label) || (x + 1 < width && mask[i + 1] != label) ||
+               (y > 0 && mask[i - width] != label) || (y + 1 < height && mask[i + width] != label) ? 1 : 0;
+         }
+      }
+   }
+
+   float getDirectedDisplacement(const std::vector<uint8_t>& from, const std::vector<float>& squared_distance)
+   {
+      float max_squared_distance = 0.0f;
+      for (size_t i = 0; i < from.size(); ++i) {
+         if (from[i] != 0) max_squared_distance = std::max( max_squared_distance, squared_distance[i] );
+      }
+      return std::sqrt( max_squared_distance );
+   }
+
+   void compare(
+      std::vector<FenceMaskDifference>& differences,
+      std::vector<uint8_t>* diff_image,
+      const uint8_t* reference,
+      const uint8_t* candidate,
+      int width,
+      int height,
+      bool parallel
+   )
+   {
+      differences.clear();
+      const int size = width * height;
+      bool exists[256] = { false, };
+      for (int i = 0; i < size; ++i) exists[reference[i]] = exists[candidate[i]] = true;
+
+      const int n_chunks = parallel ? std::max( 1, static_cast<int>(std::thread::hardware_concurrency()) ) : 1;
+      const int chunk_size = (size + n_chunks - 1) / n_chunks;
+      for (int label = 1; label < 256; ++label) {
+         if (!exists[label]) continue;
+
+         std::vector<PixelCounts> partial_counts(n_chunks);
+         const auto count = [&](int begin, int end)
+         {
+            for (int c = begin; c < end; ++c) {
+               const int offset = c * chunk_size;
+               const int n = std::min( chunk_size, size - offset );
+               if (n > 0) partial_counts[c] = countLabelPixels( reference + offset, candidate + offset, n, static_cast<uint8_t>(label) );
+            }
+         };
+         if (parallel) parallelFor( 0, n_chunks, count );
+         else count( 0, n_chunks );
+
+         FenceMaskDifference difference;
+         difference.Label = static_cast<uint8_t>(label);
+         for (const auto& counts : partial_counts) {
+            difference.ReferencePixels += counts.Reference;
+            difference.CandidatePixels += counts.Candidate;
+            difference.IntersectionPixels += counts.Intersection;
+         }
+         const int union_pixels = difference.ReferencePixels + difference.CandidatePixels - difference.IntersectionPixels;
+         difference.XorPixels = union_pixels - difference.IntersectionPixels;
+         difference.IoU = union_pixels > 0 ? static_cast<float>(difference.IntersectionPixels) / static_cast<float>(union_pixels) : 1.0f;
+
+         // identical fences need no distance transform, which keeps the common case of equivalent masks cheap
+         if (difference.ReferencePixels == 0 || difference.CandidatePixels == 0) {
+            difference.MaxBoundaryDisplacement = std::numeric_limits<float>::infinity();
+         }
+         else if (difference.XorPixels > 0) {
+            std::vector<uint8_t> reference_boundary, candidate_boundary;
+            getBoundary( reference_boundary, reference, width, height, difference.Label );
+            getBoundary( candidate_boundary, candidate, width, height, difference.Label );
+
+            std::vector<float> squared_distance;
+            getSquaredDistanceToSeeds( squared_distance, candidate_boundary, width, height, parallel );
+            const float forward = getDirectedDisplacement( reference_boundary, squared_distance );
+            getSquaredDistanceToSeeds( squared_distance, reference_boundary, width, height, parallel );
+            const float backward = getDirectedDisplacement( candidate_boundary, squared_distance );
+            difference.MaxBoundaryDisplacement = std::max( forward, backward );
+         }
+         differences.emplace_back( difference );
+      }
+
+      if (diff_image != nullptr) {
+         diff_image->resize( size );
+         getDiffImage( diff_image->data(), reference, candidate, size );
+      }
+   }
+}
+
+void compareFenceMasks(
+   std::vector<FenceMaskDifference>& differences,
+   std::vector<uint8_t>* diff_image,
+   const uint8_t* reference,
+   const uint8_t* candidate,
+   int width,
+   int height
+)
+{
+   compare( differences, diff_image, reference, candidate, width, height, true );
+}
+
+void compareFenceMaskDirectories(
+   std::vector<FenceMaskComparison>& comparisons,
+   const std::string& reference_directory,
+   const std::string& candidate_directory,
+   const std::string& diff_directory
+)
+{
+   namespace fs = std::filesystem;
+
+   comparisons.clear();
+   std::error_code error;
+   for (const auto& entry : fs::directory_iterator( reference_directory, error )) {
+      if (!entry.is_regular_file()) continue;
+      FenceMaskComparison comparison;
+      comparison.Name = entry.path().filename().string();
+      comparisons.emplace_back( comparison );
+   }
+   std::sort(
+      comparisons.begin(), comparisons.end(),
+      [](const FenceMaskComparison& a, const FenceMaskComparison& b) { return a.Name < b.Name; }
+   );
+   if (!diff_directory.empty()) fs::create_directories( diff_directory, error );
+
+   // a directory has far more files than there are cores, so files are spread over the workers and each
+   // comparison stays on one thread
+   parallelFor(
+      0, static_cast<int>(comparisons.size()),
+      [&](int begin, int end)
+      {
+         for (int i = begin; i < end; ++i) {
+            FenceMaskComparison& comparison = comparisons[i];
+            int reference_width, reference_height, candidate_width, candidate_height;
+            std::vector<uint8_t> reference, candidate;
+            if (!readFenceMask( reference, reference_width, reference_height, (fs::path(reference_directory) / comparison.Name).string() ) ||
+                !readFenceMask( candidate, candidate_width, candidate_height, (fs::path(candidate_directory) / comparison.Name).string() ) ||
+                reference_width != candidate_width || reference_height != candidate_height) {
+               continue;
+            }
+
+            std::vector<uint8_t> diff_image;
+            compare(
+               comparison.Differences, diff_directory.empty() ? nullptr : &diff_image,
+               reference.data(), candidate.data(), reference_width, reference_height, false
+            );
+            comparison.Compared = true;
+            if (!diff_directory.empty()) {
+               const std::string diff_path = (fs::path(diff_directory) / fs::path(comparison.Name).replace_extension( ".png" )).string();
+               writeFenceMask( diff_image.data(), reference_width, reference_height, diff_path );
+            }
+         }
+      }
+   );
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "_Common.h"
+
+struct FenceMaskDifference
+{
+	uint8_t Label;
+	int ReferencePixels;
+	int CandidatePixels;
+	int IntersectionPixels;
+	int XorPixels;
+	float IoU;
+	float MaxBoundaryDisplacement; // in pixels, and infinity if the fence exists in only one mask
+
+	FenceMaskDifference() :
+		Label( 0 ), ReferencePixels( 0 ), CandidatePixels( 0 ), IntersectionPixels( 0 ), XorPixels( 0 ), IoU( 1.0f ),
+		MaxBoundaryDisplacement( 0.0f ) {}
+};
+
+struct FenceMaskComparison
+{
+	std::string Name;
+	bool Compared;
+	std::vector<FenceMaskDifference> Differences;
+
+	FenceMaskComparison() : Compared( false ) {}
+};
+
+// diff_image, if given, is 0 where the masks agree, 128 where the reference fence is missing or relabeled in the
+// candidate, and 255 where the candidate has a fence over the reference background
+void compareFenceMasks(
+	std::vector<FenceMaskDifference>& differences,
+	std::vector<uint8_t>* diff_image,
+	const uint8_t* reference,
+	const uint8_t* candidate,
+	int width,
+	int height
+);
+// compares the masks with the same file name in both directories, in parallel over files,
+// and writes the diff images into diff_directory unless it is empty
+void compareFenceMaskDirectories(
+	std::vector<FenceMaskComparison>& comparisons,
+	const std::string& reference_directory,
+	const std::string& candidate_directory,
+	const std::string& diff_directory
+);
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include "FenceMaskFile.h"
+
+bool readFenceMask(std::vector<uint8_t>& mask, int& width, int& height, const std::string& file_path)
+{
+   const FREE_IMAGE_FORMAT format = FreeImage_GetFileType( file_path.c_str(), 0 );
+   if (format == FIF_UNKNOWN) return false;
+
+   FIBITMAP* image = FreeImage_Load( format, file_path.c_str() );
+   if (image == nullptr) return false;
+
+   FIBITMAP* image_8bit = image;
+   if (FreeImage_GetBPP( image ) != 8 || FreeImage_GetColorType( image ) != FIC_MINISBLACK) {
+      image_8bit = FreeImage_ConvertToGreyscale( image );
+   }
+
+   width = static_cast<int>(FreeImage_GetWidth( image_8bit ));
+   height = static_cast<int>(FreeImage_GetHeight( image_8bit ));
+   mask.resize( static_cast<size_t>(width) * height );
+   for (int y = 0; y < height; ++y) {
+      const BYTE* scanline = FreeImage_GetScanLine( image_8bit, height - 1 - y );
+      std::memcpy( mask.data() + static_cast<size_t>(y) * width, scanline, width );
+   }
+
+   if (image_8bit != image) FreeImage_Unload( image_8bit );
+   FreeImage_Unload( image );
+   return true;
+}
+
+bool writeFenceMask(const uint8_t* mask, int width, int height, const std::string& file_path)
+{
+   FIBITMAP* fence_image = FreeImage_ConvertFromRawBits(
+      const_cast<uint8_t*>(mask),
+      width,
+      height,
+      width,
+      8,
+      0, 
+      0, 
+      0,
+      true
+   );
+   const bool saved = FreeImage_Save( FIF_PNG, fence_image, file_path.c_str() ) != 0;
+   FreeImage_Unload( fence_image );
+   return saved;
+}
+
+bool readFloatMap(std::vector<float>& map, int& width, int& height, const std::string& file_path)
+{
+   FIBITMAP* image = FreeImage_Load( FIF_TIFF, file_path.c_str() );
+   if (image == nullptr) return false;
+   if (FreeImage_GetImageType( image ) != FIT_FLOAT) {
+      FreeImage_Unload( image );
+      return false;
+   }
+
+   width = static_cast<int>(FreeImage_GetWidth( image ));
+   height = static_cast<int>(FreeImage_GetHeight( image ));
+   map.resize( static_cast<size_t>(width) * height );
+   for (int y = 0; y < height; ++y) {
+      const BYTE* scanline = FreeImage_GetScanLine( image, height - 1 - y );
+      std::memcpy( map.data() + static_cast<size_t>(y) * width, scanline, width * sizeof(float) );
+   }
+   FreeImage_Unload( image );
+   return true;
+}
+
+bool writeFloatMap(const float* map, int width, int height, const std::string& file_path)
+{
+   FIBITMAP* image = FreeImage_AllocateT( FIT_FLOAT, width, height );
+   if (image == nullptr) return false;
+
+   for (int y = 0; y < height; ++y) {
+      BYTE* scanline = FreeImage_GetScanLine( image, height - 1 - y );
+      std::memcpy( scanline, map + static_cast<size_t>(y) * width, width * sizeof(float) );
+   }
+   const bool saved = FreeImage_Save( FIF_TIFF, image, file_path.c_str() ) != 0;
+   FreeImage_Unload( image );
+   return saved;
+}
+
+bool readFenceContours(std::vector<FencePolygon>& polygons, int& width, int& height, const std::string& file_path)
+{
+   std::ifstream file(file_path, std::ios::binary);
+   if (!file.is_open()) return false;
+
+   const std::vector<uint8_t> data{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+   return decodeFenceContours( polygons, width, height, data );
+}
+
+bool writeFenceContours(const std::vector<FencePolygon>& polygons, int width, int height, const std::string& file_path)
+{
+   std::ofstream file(file_path, std::ios::binary);
+   if (!file.is_open()) return false;
+
+   std::vector<uint8_t> data;
+   encodeFenceContours( data, polygons, width, height );
+   file.write( reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()) );
+   return file.good();
+}
\ No newline at end of file
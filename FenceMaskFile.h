@@ -0,0 +1,21 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "FenceContour.h"
+
+// masks are top-down, one byte per pixel, without row padding
+bool readFenceMask(std::vector<uint8_t>& mask, int& width, int& height, const std::string& file_path);
+bool writeFenceMask(const uint8_t* mask, int width, int height, const std::string& file_path);
+// float maps are top-down like the masks and stored as 32-bit float TIFF
+bool readFloatMap(std::vector<float>& map, int& width, int& height, const std::string& file_path);
+bool writeFloatMap(const float* map, int width, int height, const std::string& file_path);
+bool readFenceContours(std::vector<FencePolygon>& polygons, int& width, int& height, const std::string& file_path);
+bool writeFenceContours(const std::vector<FencePolygon>& polygons, int width, int height, const std::string& file_path);
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include "FenceMaskPyramid.h"
+
+FenceMaskPyramid::FenceMaskPyramid() : TileSize( 32 ), ReductionPolicy( Reduction::ANY )
+{
+}
+
+void FenceMaskPyramid::reduceRows(
+   std::vector<int>& tile_counts,
+   FenceMaskLevel& level,
+   FenceMaskLevel* next_level,
+   int first_row,
+   int last_row
+) const
+{
+   const int width = level.Width;
+   const bool any = ReductionPolicy == Reduction::ANY;
+   for (int y = first_row; y < last_row; y += 2) {
+      const bool has_lower_row = y + 1 < level.Height;
+      const uint8_t* upper_row = level.Mask.data() + static_cast<size_t>(y) * width;
+      const uint8_t* lower_row = has_lower_row ? upper_row + width : upper_row;
+      uint8_t* reduced_row = next_level != nullptr ? next_level->Mask.data() + static_cast<size_t>(y / 2) * next_level->Width : nullptr;
+      int* tile_row = tile_counts.data() + static_cast<size_t>(y / TileSize) * level.TilesX;
+
+      int x = 0;
+#ifdef USE_SSE2
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i low_bytes = _mm_set1_epi16( 0x00FF );
+      for (; x + 16 <= width; x += 16) {
+         const __m128i upper = _mm_loadu_si128( reinterpret_cast<const __m128i*>(upper_row + x) );
+         const __m128i lower = _mm_loadu_si128( reinterpret_cast<const __m128i*>(lower_row + x) );
+
+         int fenced = 16 - countBits( static_cast<uint>(_mm_movemask_epi8( _mm_cmpeq_epi8( upper, zero ) )) );
+         if (has_lower_row) fenced += 16 - countBits( static_cast<uint>(_mm_movemask_epi8( _mm_cmpeq_epi8( lower, zero ) )) );
+         tile_row[x / TileSize] += fenced;
+
+         if (reduced_row != nullptr) {
+            const __m128i vertical = any ? _mm_max_epu8( upper, lower ) : _mm_min_epu8( upper, lower );
+            const __m128i odd = _mm_srli_epi16( vertical, 8 );
+            const __m128i block = _mm_and_si128( any ? _mm_max_epu8( vertical, odd ) : _mm_min_epu8( vertical, odd ), low_bytes );
+            _mm_storel_epi64( reinterpret_cast<__m128i*>(reduced_row + x / 2), _mm_packus_epi16( block, block ) );
+         }
+      }
+#endif
+      for (; x < width; x += 2) {
+         const bool has_right_column = x + 1 < width;
+         uint8_t value = upper_row[x];
+         tile_row[x / TileSize] += upper_row[x] != 0 ? 1 : 0;
+         if (has_right_column) {
+            value = any ? std::max( value, upper_row[x + 1] ) : std::min( value, upper_row[x + 1] );
+            tile_row[(x + 1) / TileSize] += upper_row[x + 1] != 0 ? 1 : 0;
+         }
+         if (has_lower_row) {
+            value = any ? std::max( value, lower_row[x] ) : std::min( value, lower_row[x] );
+            tile_row[x / TileSize] += lower_row[x] != 0 ? 1 : 0;
+            if (has_right_column) {
+               value = any ? std::max( value, lower_row[x + 1] ) : std::min( value, lower_row[x + 1] );
+               tile_row[(x + 1) / TileSize] += lower_row[x + 1] != 0 ? 1 : 0;
+            }
+         }
+         if (reduced_row != nullptr) reduced_row[x / 2] = value;
+      }
+   }
+}
+
+void FenceMaskPyramid::reduceLevel(FenceMaskLevel& level, FenceMaskLevel* next_level) const
+{
+   // one pass over a level both counts its tiles and writes the next level
+   std::vector<int> tile_counts(static_cast<size_t>(level.TilesX) * level.TilesY, 0);
+   parallelFor(
+      0, level.TilesY,
+      [&](int begin, int end)
+      {
+         reduceRows( tile_counts, level, next_level, begin * TileSize, std::min( end * TileSize, level.Height ) );
+      }
+   );
+
+   level.Tiles.resize( tile_counts.size() );
+   for (int ty = 0; ty < level.TilesY; ++ty) {
+      const int tile_height = std::min( TileSize, level.Height - ty * TileSize );
+      for (int tx = 0; tx < level.TilesX; ++tx) {
+         const int tile_width = std::min( TileSize, level.Width - tx * TileSize );
+         const int count = tile_counts[ty * level.TilesX + tx];
+         TileOccupancy& occupancy = level.Tiles[ty * level.TilesX + tx];
+         if (count == 0) occupancy = TileOccupancy::EMPTY;
+         else if (count == tile_width * tile_height) occupancy = TileOccupancy::FULL;
+         else occupancy = TileOccupancy::MIXED;
+      }
+   }
+}
+
+void FenceMaskPyramid::build(const uint8_t* fence_mask, int width, int height, int n_levels, int tile_size, Reduction reduction)
+{
+   TileSize = std::max( 16, (tile_size + 15) / 16 * 16 );
+   ReductionPolicy = reduction;
+
+   Levels.clear();
+   for (int w = width, h = height; static_cast<int>(Levels.size()) < std::max( n_levels, 1 ); w = (w + 1) / 2, h = (h + 1) / 2) {
+      FenceMaskLevel level;
+      level.Width = w;
+      level.Height = h;
+      level.TilesX = (w + TileSize - 1) / TileSize;
+      level.TilesY = (h + TileSize - 1) / TileSize;
+      level.Mask.resize( static_cast<size_t>(w) * h );
+      Levels.emplace_back( std::move( level ) );
+      if (w == 1 && h == 1) break;
+   }
+
+   std::memcpy( Levels[0].Mask.data(), fence_mask, Levels[0].Mask.size() );
+   for (size_t i = 0; i < Levels.size(); ++i) {
+      reduceLevel( Levels[i], i + 1 < Levels.size() ? &Levels[i + 1] : nullptr );
+   }
+}
+
+TileOccupancy FenceMaskPyramid::getTileOccupancy(int level, int x, int y) const
+{
+   const FenceMaskLevel& mask_level = Levels[level];
+   return mask_level.Tiles[(y / TileSize) * mask_level.TilesX + x / TileSize];
+}
\ No newline at end of file
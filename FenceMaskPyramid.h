@@ -0,0 +1,50 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "_Common.h"
+
+enum class TileOccupancy : uint8_t { EMPTY, FULL, MIXED };
+
+struct FenceMaskLevel
+{
+	int Width;
+	int Height;
+	int TilesX;
+	int TilesY;
+	std::vector<uint8_t> Mask;
+	std::vector<TileOccupancy> Tiles;
+
+	FenceMaskLevel() : Width( 0 ), Height( 0 ), TilesX( 0 ), TilesY( 0 ) {}
+};
+
+class FenceMaskPyramid
+{
+public:
+	// ANY keeps the largest label of each 2x2 block, and ALL keeps the smallest one only if the whole block is fenced
+	enum class Reduction { ANY, ALL };
+
+	FenceMaskPyramid();
+
+	// tile_size is rounded up to a multiple of 16 so that a SIMD chunk never straddles two tiles
+	void build(const uint8_t* fence_mask, int width, int height, int n_levels, int tile_size, Reduction reduction);
+	int getTileSize() const { return TileSize; }
+	const std::vector<FenceMaskLevel>& getLevels() const { return Levels; }
+	// x and y are pixel coordinates of the level
+	TileOccupancy getTileOccupancy(int level, int x, int y) const;
+
+private:
+	int TileSize;
+	Reduction ReductionPolicy;
+	std::vector<FenceMaskLevel> Levels;
+
+	void reduceLevel(FenceMaskLevel& level, FenceMaskLevel* next_level) const;
+	void reduceRows(std::vector<int>& tile_counts, FenceMaskLevel& level, FenceMaskLevel* next_level, int first_row, int last_row) const;
+};
\ No newline at end of file
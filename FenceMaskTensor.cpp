@@ -0,0 +1,208 @@
+#include "FenceMaskTensor.h"
+
+namespace
+{
+   struct ResamplingTable
+   {
+      std::vector<int> First;
+      std::vector<int> Second;
+      std::vector<float> Weights; // of Second
+   };
+
+   void getResamplingTable(ResamplingTable& table, int source_size, int target_size, TensorResampling resampling)
+   {
+      table.First.resize( target_size );
+      table.Second.resize( target_size );
+      table.Weights.resize( target_size );
+      const double ratio = static_cast<double>(source_size) / static_cast<double>(target_size);
+      for (int i = 0; i < target_size; ++i) {
+         const double center = (i + 0.5) * ratio;
+         if (resampling == TensorResampling::NEAREST) {
+            table.First[i] = table.Second[i] = std::min( static_cast<int>(center), source_size - 1 );
+            table.Weights[i] = 0.0f;
+            continue;
+         }
+
+         const double position = std::max( center - 0.5, 0.0 );
+         const int first = std::min( static_cast<int>(position), source_size - 1 );
+         table.First[i] = first;
+         table.Second[i] = std::min( first + 1, source_size - 1 );
+         table.Weights[i] = static_cast<float>(position - first);
+      }
+   }
+
+   // resamples the values of a mask row, or 255 where it equals the label, straight from the bytes
+   void resampleRow(float* target, const uint8_t* row, int width, int label, const ResamplingTable& table)
+   {
+      const auto getValue = [row, label](int x)
+      {
+         if (label >= 0) return row[x] == label ? 255.0f : 0.0f;
+         return static_cast<float>(row[x]);
+      };
+
+      const int n = static_cast<int>(table.First.size());
+      int i = 0;
+#ifdef USE_AVX2
+      // a gather reads 4 bytes from each index, so it stops where that would run past the row
+      const __m256i byte_mask = _mm256_set1_epi32( 0xFF );
+      const __m256i label8 = _mm256_set1_epi32( label );
+      const auto* source = reinterpret_cast<const int*>(row);
+      for (; i + 8 <= n && table.Second[i + 7] + 4 <= width; i += 8) {
+         __m256i first = _mm256_and_si256(
+            _mm256_i32gather_epi32( source, _mm256_loadu_si256( reinterpret_cast<const __m256i*>(table.First.data() + i) ), 1 ),
+            byte_mask
+         );
+         __m256i second = _mm256_and_si256(
+            _mm256_i32gather_epi32( source, _mm256_loadu_si256( reinterpret_cast<const __m256i*>(table.Second.data() + i) ), 1 ),
+            byte_mask
+         );
+         if (label >= 0) {
+            first = _mm256_and_si256( _mm256_cmpeq_epi32( first, label8 ), byte_mask );
+            second = _mm256_and_si256( _mm256_cmpeq_epi32( second, label8 ), byte_mask );
+         }
+         const __m256 a = _mm256_cvtepi32_ps( first );
+         const __m256 b = _mm256_cvtepi32_ps( second );
+         const __m256 weight = _mm256_loadu_ps( table.Weights.data() + i );
+         _mm256_storeu_ps( target + i, _mm256_add_ps( a, _mm256_mul_ps( weight, _mm256_sub_ps( b, a ) ) ) );
+      }
+#endif
+      for (; i < n; ++i) {
+         const float first = getValue( table.First[i] );
+         target[i] = first + table.Weights[i] * (getValue( table.Second[i] ) - first);
+      }
+   }
+
+   void blendRows(
+      void* output,
+      TensorElementType element_type,
+      const float* upper,
+      const float* lower,
+      float weight,
+      float scale,
+      float bias,
+      int n
+   )
+   {
+      int i = 0;
+      auto* output32 = static_cast<float*>(output);
+      auto* output16 = static_cast<uint16_t*>(output);
+#ifdef USE_SSE2
+      const __m128 weight4 = _mm_set1_ps( weight );
+      const __m128 scale4 = _mm_set1_ps( scale );
+      const __m128 bias4 = _mm_set1_ps( bias );
+      const bool to_half = element_type == TensorElementType::FLOAT16;
+#ifdef USE_F16C
+      const bool vectorized = true;
+#else
+      const bool vectorized = !to_half;
+#endif
+      for (; vectorized && i + 4 <= n; i += 4) {
+         const __m128 a = _mm_loadu_ps( upper + i );
+         const __m128 b = _mm_loadu_ps( lower + i );
+         const __m128 value = _mm_add_ps( _mm_mul_ps( _mm_add_ps( a, _mm_mul_ps( weight4, _mm_sub_ps( b, a ) ) ), scale4 ), bias4 );
+#ifdef USE_F16C
+         if (to_half) {
+            _mm_storel_epi64( reinterpret_cast<__m128i*>(output16 + i), _mm_cvtps_ph( value, _MM_FROUND_TO_NEAREST_INT ) );
+            continue;
+         }
+#endif
+         _mm_storeu_ps( output32 + i, value );
+      }
+#endif
+      for (; i < n; ++i) {
+         const float value = (upper[i] + weight * (lower[i] - upper[i])) * scale + bias;
+         if (element_type == TensorElementType::FLOAT16) output16[i] = convertToHalf( value );
+         else output32[i] = value;
+      }
+   }
+}
+
+uint16_t convertToHalf(float value)
+{
+   uint32_t bits;
+   std::memcpy( &bits, &value, sizeof(bits) );
+   const auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+   bits &= 0x7FFFFFFFu;
+   if (bits >= 0x47800000u) return sign | (bits > 0x7F800000u ? 0x7E00u : 0x7C00u);
+
+   // rounding to the nearest even in both the subnormal and the normal range
+   uint32_t half, remainder, halfway;
+   if (bits < 0x38800000u) {
+      if (bits < 0x33000000u) return sign;
+      const uint32_t shift = 126u - (bits >> 23);
+      const uint32_t mantissa = (bits & 0x7FFFFFu) | 0x800000u;
+      half = mantissa >> shift;
+      remainder = mantissa & ((1u << shift) - 1u);
+      halfway = 1u << (shift - 1u);
+   }
+   else {
+      half = (bits - 0x38000000u) >> 13;
+      remainder = bits & 0x1FFFu;
+      halfway = 0x1000u;
+   }
+   if (remainder > halfway || (remainder == halfway && (half & 1u) != 0)) half++;
+   return static_cast<uint16_t>(sign | half);
+}
+
+size_t getFenceTensorSize(const FenceTensorFormat& format, int n_channels)
+{
+   const size_t element_size = format.ElementType == TensorElementType::FLOAT16 ? sizeof(uint16_t) : sizeof(float);
+   return static_cast<size_t>(n_channels) * format.Width * format.Height * element_size;
+}
+
+void exportFenceTensor(
+   void* tensor,
+   const FenceTensorFormat& format,
+   const uint8_t* mask,
+   int width,
+   int height,
+   const std::vector<uint8_t>& labels,
+   bool one_hot
+)
+{
+   // a one-hot tensor of a mask without labels has no channels, and an empty size has nothing to resample
+   const int n_channels = one_hot ? static_cast<int>(labels.size()) : 1;
+   if (n_channels == 0 || format.Width <= 0 || format.Height <= 0 || width <= 0 || height <= 0) return;
+
+   ResamplingTable columns, rows;
+   getResamplingTable( columns, width, format.Width, format.Resampling );
+   getResamplingTable( rows, height, format.Height, format.Resampling );
+
+   const size_t element_size = format.ElementType == TensorElementType::FLOAT16 ? sizeof(uint16_t) : sizeof(float);
+   const size_t row_size = static_cast<size_t>(format.Width) * element_size;
+   const size_t plane_size = row_size * format.Height;
+
+   // each needed mask row is resampled horizontally once per band and stays in the cache
+   // until the output rows that blend it are written, so there is no intermediate image
+   parallelFor(
+      0, format.Height,
+      [&](int begin, int end)
+      {
+         std::vector<float> resampled[2] = { std::vector<float>(format.Width), std::vector<float>(format.Width) };
+         for (int c = 0; c < n_channels; ++c) {
+            const int label = one_hot ? labels[c] : -1;
+            int cached_rows[2] = { -1, -1 };
+            // a newly needed row replaces the cached row that the current output row does not use
+            const auto getResampledRow = [&](int y, int other_y) -> const float*
+            {
+               for (int k = 0; k < 2; ++k) {
+                  if (cached_rows[k] == y) return resampled[k].data();
+               }
+               const int slot = cached_rows[0] == other_y ? 1 : 0;
+               resampleRow( resampled[slot].data(), mask + static_cast<size_t>(y) * width, width, label, columns );
+               cached_rows[slot] = y;
+               return resampled[slot].data();
+            };
+
+            auto* plane = static_cast<uint8_t*>(tensor) + c * plane_size;
+            for (int j = begin; j < end; ++j) {
+               const float* upper = getResampledRow( rows.First[j], rows.Second[j] );
+               const float* lower = getResampledRow( rows.Second[j], rows.First[j] );
+               blendRows(
+                  plane + j * row_size, format.ElementType, upper, lower, rows.Weights[j], format.Scale, format.Bias, format.Width
+               );
+            }
+         }
+      }
+   );
+}
\ No newline at end of file
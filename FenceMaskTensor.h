@@ -0,0 +1,47 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "_Common.h"
+
+enum class TensorElementType { FLOAT32, FLOAT16 };
+enum class TensorResampling { NEAREST, BILINEAR };
+
+struct FenceTensorFormat
+{
+	int Width;
+	int Height;
+	TensorElementType ElementType;
+	TensorResampling Resampling;
+	float Scale; // every element is (resampled value in [0, 255]) * Scale + Bias
+	float Bias;
+
+	FenceTensorFormat() :
+		Width( 0 ), Height( 0 ), ElementType( TensorElementType::FLOAT32 ), Resampling( TensorResampling::BILINEAR ),
+		Scale( 1.0f / 255.0f ), Bias( 0.0f ) {}
+	FenceTensorFormat(int width, int height, TensorElementType element_type, TensorResampling resampling) :
+		Width( width ), Height( height ), ElementType( element_type ), Resampling( resampling ),
+		Scale( 1.0f / 255.0f ), Bias( 0.0f ) {}
+};
+
+size_t getFenceTensorSize(const FenceTensorFormat& format, int n_channels);
+// writes the CHW planes of one batch item into tensor, whose size is getFenceTensorSize bytes. without one_hot,
+// the single channel holds the mask values, and otherwise each channel c holds 255 where the mask equals labels[c].
+// the mask is top-down and resampled with pixel centers aligned, which matches the usual image resize of the networks.
+void exportFenceTensor(
+	void* tensor,
+	const FenceTensorFormat& format,
+	const uint8_t* mask,
+	int width,
+	int height,
+	const std::vector<uint8_t>& labels,
+	bool one_hot
+);
+uint16_t convertToHalf(float value);
\ No newline at end of file
@@ -0,0 +1,141 @@
+#include "FenceMotionDetector.h"
+
+FenceMotionDetector::FenceMotionDetector() :
+   Width( 0 ), Height( 0 ), LearningRateShift( 4 ), Threshold( 25 ), Initialized( false ), LabelIndices( 256, -1 )
+{
+}
+
+void FenceMotionDetector::setFenceMask(const uint8_t* fence_mask, int width, int height)
+{
+   Width = width;
+   Height = height;
+   SpanBuilder.setFenceMask( fence_mask, width, height );
+
+   Labels.clear();
+   FenceAreas.clear();
+   std::fill( LabelIndices.begin(), LabelIndices.end(), -1 );
+   for (const auto& span : SpanBuilder.getFenceSpans()) {
+      if (LabelIndices[span.Label] < 0) {
+         LabelIndices[span.Label] = static_cast<int>(Labels.size());
+         Labels.emplace_back( span.Label );
+         FenceAreas.emplace_back( 0 );
+      }
+      FenceAreas[LabelIndices[span.Label]] += span.End - span.Begin;
+   }
+   SpanMotionCounts.resize( SpanBuilder.getFenceSpans().size() );
+   Background.resize( static_cast<size_t>(width) * height );
+   Initialized = false;
+}
+
+void FenceMotionDetector::setParameters(int learning_rate_shift, uint8_t threshold)
+{
+   LearningRateShift = std::clamp( learning_rate_shift, 1, 8 );
+   Threshold = threshold;
+}
+
+void FenceMotionDetector::initializeSpan(const FenceSpan& span, const uint8_t* luma)
+{
+   const size_t offset = static_cast<size_t>(span.Y) * Width;
+   for (int x = span.Begin; x < span.End; ++x) {
+      Background[offset + x] = static_cast<uint16_t>(luma[offset + x] << 8);
+   }
+}
+
+int FenceMotionDetector::updateSpan(const FenceSpan& span, const uint8_t* luma)
+{
+   // background' = background - background / 2^k + pixel * 2^(8 - k), which never leaves 16 bits
+   const size_t offset = static_cast<size_t>(span.Y) * Width;
+   const uint8_t* frame = luma + offset;
+   uint16_t* background = Background.data() + offset;
+   const int shift = LearningRateShift;
+
+   int count = 0;
+   int x = span.Begin;
+#ifdef USE_SSE2
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i threshold = _mm_set1_epi8( static_cast<char>(Threshold) );
+   const __m128i decay_shift = _mm_cvtsi32_si128( shift );
+   const __m128i gain_shift = _mm_cvtsi32_si128( 8 - shift );
+   for (; x + 16 <= span.End; x += 16) {
+      const __m128i pixels = _mm_loadu_si128( reinterpret_cast<const __m128i*>(frame + x) );
+      __m128i background_low = _mm_loadu_si128( reinterpret_cast<const __m128i*>(background + x) );
+      __m128i background_high = _mm_loadu_si128( reinterpret_cast<const __m128i*>(background + x + 8) );
+
+      const __m128i background_8bit = _mm_packus_epi16(
+         _mm_srli_epi16( background_low, 8 ),
+         _mm_srli_epi16( background_high, 8 )
+      );
+      const __m128i difference = _mm_or_si128(
+         _mm_subs_epu8( pixels, background_8bit ),
+         _mm_subs_epu8( background_8bit, pixels )
+      );
+      const int still = _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_subs_epu8( difference, threshold ), zero ) );
+      count += 16 - countBits( static_cast<uint64_t>(still) );
+
+      background_low = _mm_add_epi16(
+         _mm_sub_epi16( background_low, _mm_srl_epi16( background_low, decay_shift ) ),
+         _mm_sll_epi16( _mm_unpacklo_epi8( pixels, zero ), gain_shift )
+      );
+      background_high = _mm_add_epi16(
+         _mm_sub_epi16( background_high, _mm_srl_epi16( background_high, decay_shift ) ),
+         _mm_sll_epi16( _mm_unpackhi_epi8( pixels, zero ), gain_shift )
+      );
+      _mm_storeu_si128( reinterpret_cast<__m128i*>(background + x), background_low );
+      _mm_storeu_si128( reinterpret_cast<__m128i*>(background + x + 8), background_high );
+   }
+#endif
+   for (; x < span.End; ++x) {
+      const int difference = std::abs( static_cast<int>(frame[x]) - (background[x] >> 8) );
+      if (difference > Threshold) count++;
+      background[x] = static_cast<uint16_t>(background[x] - (background[x] >> shift) + (frame[x] << (8 - shift)));
+   }
+   return count;
+}
+
+void FenceMotionDetector::detect(std::vector<float>& scores, const uint8_t* luma)
+{
+   const std::vector<FenceSpan>& spans = SpanBuilder.getFenceSpans();
+   scores.assign( Labels.size(), 0.0f );
+   if (!Initialized) {
+      for (const auto& span : spans) initializeSpan( span, luma );
+      Initialized = true;
+      return;
+   }
+
+   parallelFor(
+      0, static_cast<int>(spans.size()),
+      [this, &spans, luma](int begin, int end)
+      {
+         for (int s = begin; s < end; ++s) SpanMotionCounts[s] = updateSpan( spans[s], luma );
+      }
+   );
+
+   std::vector<int> motion_counts(Labels.size(), 0);
+   for (size_t s = 0; s < spans.size(); ++s) motion_counts[LabelIndices[spans[s].Label]] += SpanMotionCounts[s];
+   for (size_t i = 0; i < Labels.size(); ++i) {
+      scores[i] = static_cast<float>(motion_counts[i]) / static_cast<float>(FenceAreas[i]);
+   }
+}
+
+int FenceMotionDetector::processVideo(
+   const std::string& file_path,
+   RawVideoFormat format,
+   const std::function<void(int, const std::vector<float>&)>& callback
+)
+{
+   // the frame size comes from the fence mask, so nothing can be read before setFenceMask
+   if (Width <= 0 || Height <= 0) return -1;
+
+   MappedFile video;
+   if (!video.open( file_path )) return -1;
+
+   // only the luma plane at the head of each frame is read
+   const size_t frame_size = getRawFrameSize( Width, Height, format );
+   const auto n_frames = static_cast<int>(video.size() / frame_size);
+   std::vector<float> scores;
+   for (int i = 0; i < n_frames; ++i) {
+      detect( scores, video.data() + frame_size * i );
+      callback( i, scores );
+   }
+   return n_frames;
+}
\ No newline at end of file
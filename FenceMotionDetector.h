@@ -0,0 +1,52 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "FenceBlobLabeler.h"
+#include "MappedFile.h"
+#include "RawVideo.h"
+
+class FenceMotionDetector
+{
+public:
+	FenceMotionDetector();
+
+	// fence_mask is top-down with 0 for outside and the fence label otherwise
+	void setFenceMask(const uint8_t* fence_mask, int width, int height);
+	// the background moves toward each frame by 1/2^learning_rate_shift
+	void setParameters(int learning_rate_shift, uint8_t threshold);
+	void reset() { Initialized = false; }
+	const std::vector<uint8_t>& getLabels() const { return Labels; }
+
+	// scores[i] is the fraction of moving pixels in the fence of getLabels()[i]
+	void detect(std::vector<float>& scores, const uint8_t* luma);
+	// returns the number of processed frames, or -1 if no fence mask is set or the video cannot be mapped
+	int processVideo(
+		const std::string& file_path,
+		RawVideoFormat format,
+		const std::function<void(int, const std::vector<float>&)>& callback
+	);
+
+private:
+	int Width;
+	int Height;
+	int LearningRateShift;
+	uint8_t Threshold;
+	bool Initialized;
+	FenceBlobLabeler SpanBuilder;
+	std::vector<uint8_t> Labels;
+	std::vector<int> LabelIndices; // index in Labels for each label value
+	std::vector<int> FenceAreas;
+	std::vector<int> SpanMotionCounts;
+	std::vector<uint16_t> Background; // 8.8 fixed point
+
+	int updateSpan(const FenceSpan& span, const uint8_t* luma);
+	void initializeSpan(const FenceSpan& span, const uint8_t* luma);
+};
\ No newline at end of file
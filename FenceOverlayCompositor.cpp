@@ -0,0 +1,213 @@
+#include "FenceOverlayCompositor.h"
+
+namespace
+{
+   // BT.601 limited range, which is what cameras put in NV12 and I420 streams
+   glm::vec3 getYUV(const glm::vec3& rgb)
+   {
+      const glm::vec3 yuv(
+         16.0f + 65.481f * rgb.r + 128.553f * rgb.g + 24.966f * rgb.b,
+         128.0f - 37.797f * rgb.r - 74.203f * rgb.g + 112.0f * rgb.b,
+         128.0f + 112.0f * rgb.r - 93.786f * rgb.g - 18.214f * rgb.b
+      );
+      return clamp( round( yuv ), glm::vec3(0.0f), glm::vec3(255.0f) );
+   }
+}
+
+FenceOverlayCompositor::FenceOverlayCompositor(const glm::vec3& fence_color) :
+   Width( 0 ), Height( 0 ), Prepared( false ), FillOpacity( 0.4f ), OutlineOpacity( 1.0f ), Colors( 256, fence_color )
+{
+}
+
+void FenceOverlayCompositor::setFenceColor(uint8_t label, const glm::vec3& color)
+{
+   Colors[label] = color;
+   Prepared = false;
+}
+
+void FenceOverlayCompositor::setOpacity(float fill_opacity, float outline_opacity)
+{
+   FillOpacity = std::clamp( fill_opacity, 0.0f, 1.0f );
+   OutlineOpacity = std::clamp( outline_opacity, 0.0f, 1.0f );
+   Prepared = false;
+}
+
+void FenceOverlayCompositor::setFenceMask(const uint8_t* fence_mask, int width, int height)
+{
+   Width = width;
+   Height = height;
+   FenceMask.assign( fence_mask, fence_mask + static_cast<size_t>(width) * height );
+   Prepared = false;
+}
+
+bool FenceOverlayCompositor::isOutline(int x, int y) const
+{
+   const uint8_t label = FenceMask[y * Width + x];
+   return (x > 0 && FenceMask[y * Width + x - 1] != label) ||
+      (x + 1 < Width && FenceMask[y * Width + x + 1] != label) ||
+      (y > 0 && FenceMask[(y - 1) * Width + x] != label) ||
+      (y + 1 < Height && FenceMask[(y + 1) * Width + x] != label);
+}
+
+void FenceOverlayCompositor::prepare()
+{
+   std::vector<glm::vec3> yuv_colors(Colors.size());
+   for (size_t i = 0; i < Colors.size(); ++i) yuv_colors[i] = getYUV( Colors[i] );
+   const auto fill_alpha = static_cast<uint8_t>(std::lrint( FillOpacity * 255.0f ));
+   const auto outline_alpha = static_cast<uint8_t>(std::lrint( OutlineOpacity * 255.0f ));
+
+   // the luma alpha is kept for the whole frame while preparing, since the chroma planes are reduced from it
+   std::vector<uint8_t> alpha(FenceMask.size(), 0);
+   LumaPlane = OverlayPlane();
+   for (int y = 0; y < Height; ++y) {
+      int x = 0;
+      while (x < Width) {
+         if (FenceMask[y * Width + x] == 0) {
+            ++x;
+            continue;
+         }
+         const int begin = x;
+         LumaPlane.Spans.emplace_back( y, begin, begin, static_cast<int>(LumaPlane.Alpha.size()) );
+         for (; x < Width && FenceMask[y * Width + x] != 0; ++x) {
+            alpha[y * Width + x] = isOutline( x, y ) ? outline_alpha : fill_alpha;
+            LumaPlane.Alpha.emplace_back( alpha[y * Width + x] );
+            LumaPlane.Target.emplace_back( static_cast<uint8_t>(yuv_colors[FenceMask[y * Width + x]].x) );
+         }
+         LumaPlane.Spans.back().End = x;
+      }
+   }
+
+   // each chroma sample blends toward the alpha-weighted color of its 2x2 luma block by the mean alpha of the block
+   const int chroma_width = (Width + 1) / 2;
+   const int chroma_height = (Height + 1) / 2;
+   UPlane = OverlayPlane();
+   VPlane = OverlayPlane();
+   UVPlane = OverlayPlane();
+   for (int cy = 0; cy < chroma_height; ++cy) {
+      bool in_span = false;
+      for (int cx = 0; cx < chroma_width; ++cx) {
+         int n_samples = 0, alpha_sum = 0;
+         glm::vec2 weighted_uv(0.0f);
+         for (int y = 2 * cy; y < std::min( 2 * cy + 2, Height ); ++y) {
+            for (int x = 2 * cx; x < std::min( 2 * cx + 2, Width ); ++x) {
+               const int a = alpha[y * Width + x];
+               const glm::vec3& color = yuv_colors[FenceMask[y * Width + x]];
+               n_samples++;
+               alpha_sum += a;
+               weighted_uv += static_cast<float>(a) * glm::vec2(color.y, color.z);
+            }
+         }
+
+         const int chroma_alpha = (alpha_sum + n_samples / 2) / n_samples;
+         if (chroma_alpha == 0) {
+            in_span = false;
+            continue;
+         }
+         if (!in_span) {
+            UPlane.Spans.emplace_back( cy, cx, cx, static_cast<int>(UPlane.Alpha.size()) );
+            UVPlane.Spans.emplace_back( cy, 2 * cx, 2 * cx, static_cast<int>(UVPlane.Alpha.size()) );
+            in_span = true;
+         }
+         const glm::vec2 uv = round( weighted_uv / static_cast<float>(alpha_sum) );
+         UPlane.Spans.back().End = cx + 1;
+         UPlane.Alpha.emplace_back( static_cast<uint8_t>(chroma_alpha) );
+         UPlane.Target.emplace_back( static_cast<uint8_t>(uv.x) );
+         VPlane.Target.emplace_back( static_cast<uint8_t>(uv.y) );
+         UVPlane.Spans.back().End = 2 * cx + 2;
+         UVPlane.Alpha.insert( UVPlane.Alpha.end(), 2, static_cast<uint8_t>(chroma_alpha) );
+         UVPlane.Target.emplace_back( static_cast<uint8_t>(uv.x) );
+         UVPlane.Target.emplace_back( static_cast<uint8_t>(uv.y) );
+      }
+   }
+   VPlane.Spans = UPlane.Spans;
+   VPlane.Alpha = UPlane.Alpha;
+   Prepared = true;
+}
+
+void FenceOverlayCompositor::blend(uint8_t* destination, const uint8_t* alpha, const uint8_t* target, int n)
+{
+   // destination = (destination * (256 - a) + target * a) / 256 with a in [0, 256], which stays in 16 bits
+   int i = 0;
+#ifdef USE_SSE2
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i one = _mm_set1_epi16( 256 );
+   for (; i + 16 <= n; i += 16) {
+      const __m128i d = _mm_loadu_si128( reinterpret_cast<const __m128i*>(destination + i) );
+      const __m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>(alpha + i) );
+      const __m128i t = _mm_loadu_si128( reinterpret_cast<const __m128i*>(target + i) );
+
+      __m128i a_low = _mm_unpacklo_epi8( a, zero );
+      __m128i a_high = _mm_unpackhi_epi8( a, zero );
+      a_low = _mm_add_epi16( a_low, _mm_srli_epi16( a_low, 7 ) );
+      a_high = _mm_add_epi16( a_high, _mm_srli_epi16( a_high, 7 ) );
+
+      const __m128i low = _mm_srli_epi16(
+         _mm_add_epi16(
+            _mm_mullo_epi16( _mm_unpacklo_epi8( d, zero ), _mm_sub_epi16( one, a_low ) ),
+            _mm_mullo_epi16( _mm_unpacklo_epi8( t, zero ), a_low )
+         ), 8
+      );
+      const __m128i high = _mm_srli_epi16(
+         _mm_add_epi16(
+            _mm_mullo_epi16( _mm_unpackhi_epi8( d, zero ), _mm_sub_epi16( one, a_high ) ),
+            _mm_mullo_epi16( _mm_unpackhi_epi8( t, zero ), a_high )
+         ), 8
+      );
+      _mm_storeu_si128( reinterpret_cast<__m128i*>(destination + i), _mm_packus_epi16( low, high ) );
+   }
+#endif
+   for (; i < n; ++i) {
+      const int a = alpha[i] + (alpha[i] >> 7);
+      destination[i] = static_cast<uint8_t>((destination[i] * (256 - a) + target[i] * a) >> 8);
+   }
+}
+
+void FenceOverlayCompositor::blendPlane(uint8_t* plane, int stride, const OverlayPlane& overlay)
+{
+   // the spans cover only the fences, so blending them serially costs less than starting threads every frame
+   for (const auto& span : overlay.Spans) {
+      blend(
+         plane + static_cast<size_t>(span.Y) * stride + span.Begin,
+         overlay.Alpha.data() + span.Offset,
+         overlay.Target.data() + span.Offset,
+         span.End - span.Begin
+      );
+   }
+}
+
+void FenceOverlayCompositor::compositeI420(uint8_t* y_plane, int y_stride, uint8_t* u_plane, uint8_t* v_plane, int chroma_stride)
+{
+   if (!Prepared) prepare();
+   blendPlane( y_plane, y_stride, LumaPlane );
+   blendPlane( u_plane, chroma_stride, UPlane );
+   blendPlane( v_plane, chroma_stride, VPlane );
+}
+
+void FenceOverlayCompositor::compositeNV12(uint8_t* y_plane, int y_stride, uint8_t* uv_plane, int uv_stride)
+{
+   if (!Prepared) prepare();
+   blendPlane( y_plane, y_stride, LumaPlane );
+   blendPlane( uv_plane, uv_stride, UVPlane );
+}
+
+void FenceOverlayCompositor::composite(uint8_t* frame, RawVideoFormat format)
+{
+   const int chroma_width = (Width + 1) / 2;
+   const int chroma_height = (Height + 1) / 2;
+   uint8_t* chroma = frame + static_cast<size_t>(Width) * Height;
+   switch (format) {
+      case RawVideoFormat::I420:
+         compositeI420(
+            frame, Width,
+            chroma, chroma + static_cast<size_t>(chroma_width) * chroma_height, chroma_width
+         );
+         break;
+      case RawVideoFormat::NV12:
+         compositeNV12( frame, Width, chroma, 2 * chroma_width );
+         break;
+      default:
+         if (!Prepared) prepare();
+         blendPlane( frame, Width, LumaPlane );
+         break;
+   }
+}
\ No newline at end of file
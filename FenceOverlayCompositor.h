@@ -0,0 +1,64 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "RawVideo.h"
+
+class FenceOverlayCompositor
+{
+public:
+	explicit FenceOverlayCompositor(const glm::vec3& fence_color);
+
+	// colors are RGB in [0, 1] and apply from the next composite()
+	void setFenceColor(uint8_t label, const glm::vec3& color);
+	void setOpacity(float fill_opacity, float outline_opacity);
+	// fence_mask is top-down with 0 for outside and the fence label otherwise
+	void setFenceMask(const uint8_t* fence_mask, int width, int height);
+
+	void compositeI420(uint8_t* y_plane, int y_stride, uint8_t* u_plane, uint8_t* v_plane, int chroma_stride);
+	void compositeNV12(uint8_t* y_plane, int y_stride, uint8_t* uv_plane, int uv_stride);
+	// frame is tightly packed as in a raw video file
+	void composite(uint8_t* frame, RawVideoFormat format);
+
+private:
+	struct OverlaySpan
+	{
+		int Y;
+		int Begin;
+		int End; // exclusive
+		int Offset; // index of Begin in the packed alpha and target arrays
+
+		OverlaySpan(int y, int begin, int end, int offset) : Y( y ), Begin( begin ), End( end ), Offset( offset ) {}
+	};
+
+	struct OverlayPlane
+	{
+		std::vector<OverlaySpan> Spans;
+		std::vector<uint8_t> Alpha;
+		std::vector<uint8_t> Target;
+	};
+
+	int Width;
+	int Height;
+	bool Prepared;
+	float FillOpacity;
+	float OutlineOpacity;
+	std::vector<glm::vec3> Colors;
+	std::vector<uint8_t> FenceMask;
+	OverlayPlane LumaPlane;
+	OverlayPlane UPlane;
+	OverlayPlane VPlane;
+	OverlayPlane UVPlane; // U and V interleaved for NV12
+
+	bool isOutline(int x, int y) const;
+	void prepare();
+	static void blendPlane(uint8_t* plane, int stride, const OverlayPlane& overlay);
+	static void blend(uint8_t* destination, const uint8_t* alpha, const uint8_t* target, int n);
+};
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include "FenceQPMap.h"
+#include "DistanceTransform.h"
+
+FenceQPMap::FenceQPMap() :
+   BlockSize( 16 ), InsideQPOffset( -6 ), OutsideQPOffset( 6 ), FalloffDistance( 128.0f ), BlocksX( 0 ), BlocksY( 0 )
+{
+}
+
+void FenceQPMap::setBlockSize(int block_size)
+{
+   BlockSize = block_size <= 16 ? 16 : block_size <= 32 ? 32 : 64;
+}
+
+void FenceQPMap::setQPOffsets(int inside_qp_offset, int outside_qp_offset, float falloff_distance_in_pixel)
+{
+   InsideQPOffset = std::clamp( inside_qp_offset, -51, 51 );
+   OutsideQPOffset = std::clamp( outside_qp_offset, -51, 51 );
+   FalloffDistance = std::max( falloff_distance_in_pixel, 0.0f );
+}
+
+void FenceQPMap::countBlockRow(std::vector<int>& counts, const uint8_t* fence_mask, int width, int height, int block_row) const
+{
+   int* block_counts = counts.data() + static_cast<size_t>(block_row) * BlocksX;
+   const int last_row = std::min( (block_row + 1) * BlockSize, height );
+   for (int y = block_row * BlockSize; y < last_row; ++y) {
+      const uint8_t* row = fence_mask + static_cast<size_t>(y) * width;
+      int x = 0;
+#ifdef USE_SSE2
+      // the block size is a multiple of 16, so a chunk never straddles two blocks
+      const __m128i zero = _mm_setzero_si128();
+      for (; x + 16 <= width; x += 16) {
+         const __m128i pixels = _mm_loadu_si128( reinterpret_cast<const __m128i*>(row + x) );
+         block_counts[x / BlockSize] += 16 - countBits( static_cast<uint>(_mm_movemask_epi8( _mm_cmpeq_epi8( pixels, zero ) )) );
+      }
+#endif
+      for (; x < width; ++x) block_counts[x / BlockSize] += row[x] != 0 ? 1 : 0;
+   }
+}
+
+void FenceQPMap::build(const uint8_t* fence_mask, int width, int height)
+{
+   BlocksX = (width + BlockSize - 1) / BlockSize;
+   BlocksY = (height + BlockSize - 1) / BlockSize;
+   const size_t n_blocks = static_cast<size_t>(BlocksX) * BlocksY;
+
+   std::vector<int> counts(n_blocks, 0);
+   parallelFor(
+      0, BlocksY,
+      [&](int begin, int end)
+      {
+         for (int by = begin; by < end; ++by) countBlockRow( counts, fence_mask, width, height, by );
+      }
+   );
+
+   std::vector<uint8_t> fenced_blocks(n_blocks);
+   Coverages.resize( n_blocks );
+   for (int by = 0; by < BlocksY; ++by) {
+      const int block_height = std::min( BlockSize, height - by * BlockSize );
+      for (int bx = 0; bx < BlocksX; ++bx) {
+         const int block_width = std::min( BlockSize, width - bx * BlockSize );
+         const size_t i = static_cast<size_t>(by) * BlocksX + bx;
+         Coverages[i] = static_cast<uint8_t>((counts[i] * 255 + block_width * block_height / 2) / (block_width * block_height));
+         fenced_blocks[i] = counts[i] > 0 ? 1 : 0;
+      }
+   }
+
+   std::vector<float> squared_distances;
+   getSquaredDistanceToSeeds( squared_distances, fenced_blocks, BlocksX, BlocksY, false );
+   QPOffsets.resize( n_blocks );
+   for (size_t i = 0; i < n_blocks; ++i) {
+      float weight = 1.0f;
+      if (fenced_blocks[i] == 0) {
+         const float distance = std::sqrt( squared_distances[i] ) * static_cast<float>(BlockSize);
+         weight = FalloffDistance > 0.0f ? std::max( 1.0f - distance / FalloffDistance, 0.0f ) : 0.0f;
+      }
+      QPOffsets[i] = static_cast<int8_t>(std::lround(
+         static_cast<float>(OutsideQPOffset) + static_cast<float>(InsideQPOffset - OutsideQPOffset) * weight
+      ));
+   }
+}
+
+bool FenceQPMap::writeQPOffsets(const std::string& file_path) const
+{
+   std::ofstream file(file_path, std::ios::binary);
+   if (!file.is_open()) return false;
+
+   file.write( reinterpret_cast<const char*>(QPOffsets.data()), static_cast<std::streamsize>(QPOffsets.size()) );
+   return file.good();
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "_Common.h"
+
+// per-block fence coverage and QP offsets for video encoders, where blocks are macroblocks or CTUs
+class FenceQPMap
+{
+public:
+	FenceQPMap();
+
+	// 16, 32 or 64
+	void setBlockSize(int block_size);
+	// fenced blocks get inside_qp_offset, and the offset of the others rises linearly with the distance to the nearest
+	// fenced block until it reaches outside_qp_offset at falloff_distance pixels
+	void setQPOffsets(int inside_qp_offset, int outside_qp_offset, float falloff_distance_in_pixel);
+	// fence_mask is top-down with 0 for outside, and blocks at the right and bottom edges may be partial
+	void build(const uint8_t* fence_mask, int width, int height);
+	int getBlockSize() const { return BlockSize; }
+	int getBlocksX() const { return BlocksX; }
+	int getBlocksY() const { return BlocksY; }
+	// row-major fraction of fenced pixels in each block in [0, 255]
+	const std::vector<uint8_t>& getCoverages() const { return Coverages; }
+	// row-major QP offsets
+	const std::vector<int8_t>& getQPOffsets() const { return QPOffsets; }
+	// raw row-major int8 QP offsets, which is the form the encoder ROI interfaces take
+	bool writeQPOffsets(const std::string& file_path) const;
+
+private:
+	int BlockSize;
+	int InsideQPOffset;
+	int OutsideQPOffset;
+	float FalloffDistance;
+	int BlocksX;
+	int BlocksY;
+	std::vector<uint8_t> Coverages;
+	std::vector<int8_t> QPOffsets;
+
+	void countBlockRow(std::vector<int>& counts, const uint8_t* fence_mask, int width, int height, int block_row) const;
+};
\ No newline at end of file
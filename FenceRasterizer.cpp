@@ -0,0 +1,331 @@
+#include "FenceRasterizer.h"
+#include "FenceSpatialIndex.h"
+
+FenceRasterizer::FenceRasterizer() : ImageToGround( 1.0 ), HorizonRow( 0.0f )
+{
+}
+
+void FenceRasterizer::setCamera(const PinholeCamera& camera)
+{
+   Camera = camera;
+   ImageToGround = camera.getImageToGroundHomography();
+   HorizonRow = camera.getHorizonRow();
+}
+
+bool FenceRasterizer::getConic(FenceConic& conic, const GroundFence& fence) const
+{
+   // a disc at the depth y below the camera looks like the disc scaled by CameraHeight / y on the ground plane,
+   // which is the plane ImageToGround maps to
+   if (fence.Center.y <= 0.0f) return false;
+   const double to_ground = static_cast<double>(Camera.CameraHeight) / static_cast<double>(fence.Center.y);
+   const double cx = fence.Center.x * to_ground;
+   const double cz = fence.Center.z * to_ground;
+   const double r = fence.Radius * to_ground;
+   const glm::dmat3 circle(
+      1.0, 0.0, -cx,
+      0.0, 1.0, -cz,
+      -cx, -cz, cx * cx + cz * cz - r * r
+   );
+   conic.Q = transpose( ImageToGround ) * circle * ImageToGround;
+
+   double scale = 0.0;
+   for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j < 3; ++j) scale = std::max( scale, std::abs( conic.Q[i][j] ) );
+   }
+   if (scale == 0.0) return false;
+   conic.Q /= scale;
+
+   const int first_ground_row = std::clamp( static_cast<int>(std::floor( HorizonRow )), 0, Camera.Height );
+   conic.Left = 0;
+   conic.Top = first_ground_row;
+   conic.Right = Camera.Width;
+   conic.Bottom = Camera.Height;
+
+   // the rim polygon around the circle is clipped to the view frustum first, so only the part of the fence in front of
+   // the camera is bounded, and a fence reaching behind the camera never makes the box cover the whole frame
+   constexpr int rim_points = 128;
+   const float rim_radius = fence.Radius / cosf( glm::pi<float>() / static_cast<float>(rim_points) );
+   std::vector<glm::vec3> polygon, clipped;
+   polygon.reserve( rim_points + 8 );
+   for (int i = 0; i < rim_points; ++i) {
+      const float theta = glm::two_pi<float>() * static_cast<float>(i) / static_cast<float>(rim_points);
+      polygon.emplace_back(
+         fence.Center.x + rim_radius * cosf( theta ),
+         fence.Center.y,
+         fence.Center.z + rim_radius * sinf( theta )
+      );
+   }
+   const ViewFrustum frustum(Camera);
+   for (int p = 0; p < frustum.PlaneCount && !polygon.empty(); ++p) {
+      const glm::vec4& plane = frustum.Planes[p];
+      clipped.clear();
+      for (size_t i = 0; i < polygon.size(); ++i) {
+         const glm::vec3& a = polygon[i];
+         const glm::vec3& b = polygon[(i + 1) % polygon.size()];
+         const float da = dot( glm::vec3(plane), a ) + plane.w;
+         const float db = dot( glm::vec3(plane), b ) + plane.w;
+         if (da >= 0.0f) clipped.emplace_back( a );
+         if ((da >= 0.0f) != (db >= 0.0f)) clipped.emplace_back( a + (b - a) * (da / (da - db)) );
+      }
+      polygon.swap( clipped );
+   }
+   if (polygon.empty()) return false;
+
+   glm::vec2 min_point(std::numeric_limits<float>::max()), max_point(std::numeric_limits<float>::lowest());
+   for (const auto& point : polygon) {
+      glm::vec2 image_point;
+      if (!Camera.getImagePoint( image_point, point )) return conic.Top < conic.Bottom;
+      min_point = min( min_point, image_point );
+      max_point = max( max_point, image_point );
+   }
+   conic.Left = std::max( static_cast<int>(std::floor( min_point.x )) - 2, 0 );
+   conic.Top = std::max( static_cast<int>(std::floor( min_point.y )) - 2, first_ground_row );
+   conic.Right = std::min( static_cast<int>(std::ceil( max_point.x )) + 2, Camera.Width );
+   conic.Bottom = std::min( static_cast<int>(std::ceil( max_point.y )) + 2, Camera.Height );
+   return conic.Left < conic.Right && conic.Top < conic.Bottom;
+}
+
+void FenceRasterizer::getLabels(std::vector<uint8_t>& labels, const std::vector<GroundFence>& fences) const
+{
+   labels.assign( static_cast<size_t>(Camera.Width) * Camera.Height, 0 );
+   for (const auto& fence : fences) {
+      FenceConic conic;
+      if (!getConic( conic, fence )) continue;
+
+      parallelFor(
+         conic.Top, conic.Bottom,
+         [&](int begin, int end)
+         {
+            for (int y = begin; y < end; ++y) {
+               const double v = y + 0.5;
+               if (v <= HorizonRow) continue;
+
+               uint8_t* row = labels.data() + static_cast<size_t>(y) * Camera.Width;
+               for (int x = conic.Left; x < conic.Right; ++x) {
+                  const glm::dvec3 p(x + 0.5, v, 1.0);
+                  if (dot( p, conic.Q * p ) < 0.0) row[x] = fence.Label;
+               }
+            }
+         }
+      );
+   }
+}
+
+int FenceRasterizer::countInsideSamples(
+   const float* du,
+   const float* dv,
+   int n_samples,
+   float value,
+   float gradient_u,
+   float gradient_v,
+   float quu,
+   float quv,
+   float qvv
+)
+{
+   int count = 0;
+   int k = 0;
+#ifdef USE_SSE2
+   const __m128 f0 = _mm_set1_ps( value );
+   const __m128 gu = _mm_set1_ps( gradient_u );
+   const __m128 gv = _mm_set1_ps( gradient_v );
+   const __m128 a = _mm_set1_ps( quu );
+   const __m128 b = _mm_set1_ps( 2.0f * quv );
+   const __m128 c = _mm_set1_ps( qvv );
+   const __m128 zero = _mm_setzero_ps();
+   for (; k + 4 <= n_samples; k += 4) {
+      const __m128 x = _mm_loadu_ps( du + k );
+      const __m128 y = _mm_loadu_ps( dv + k );
+      const __m128 linear = _mm_add_ps( f0, _mm_add_ps( _mm_mul_ps( gu, x ), _mm_mul_ps( gv, y ) ) );
+      const __m128 quadratic = _mm_add_ps(
+         _mm_mul_ps( x, _mm_add_ps( _mm_mul_ps( a, x ), _mm_mul_ps( b, y ) ) ),
+         _mm_mul_ps( c, _mm_mul_ps( y, y ) )
+      );
+      count += countBits( static_cast<uint>(_mm_movemask_ps( _mm_cmplt_ps( _mm_add_ps( linear, quadratic ), zero ) )) );
+   }
+#endif
+   for (; k < n_samples; ++k) {
+      const float f = value + gradient_u * du[k] + gradient_v * dv[k] +
+         quu * du[k] * du[k] + 2.0f * quv * du[k] * dv[k] + qvv * dv[k] * dv[k];
+      if (f < 0.0f) count++;
+   }
+   return count;
+}
+
+void FenceRasterizer::getCoverage(std::vector<uint8_t>& coverage, const std::vector<GroundFence>& fences, int samples_per_axis) const
+{
+   coverage.assign( static_cast<size_t>(Camera.Width) * Camera.Height, 0 );
+
+   const int n = std::max( samples_per_axis, 1 );
+   const int n_samples = n * n;
+   std::vector<float> du(n_samples), dv(n_samples);
+   for (int j = 0; j < n; ++j) {
+      for (int i = 0; i < n; ++i) {
+         du[j * n + i] = (static_cast<float>(i) + 0.5f) / static_cast<float>(n) - 0.5f;
+         dv[j * n + i] = (static_cast<float>(j) + 0.5f) / static_cast<float>(n) - 0.5f;
+      }
+   }
+
+   for (const auto& fence : fences) {
+      FenceConic conic;
+      if (!getConic( conic, fence )) continue;
+
+      const auto quu = static_cast<float>(conic.Q[0][0]);
+      const auto quv = static_cast<float>(conic.Q[1][0]);
+      const auto qvv = static_cast<float>(conic.Q[1][1]);
+      parallelFor(
+         conic.Top, conic.Bottom,
+         [&](int begin, int end)
+         {
+            for (int y = begin; y < end; ++y) {
+               // pixels cut by the horizon are left uncovered
+               const double v = y + 0.5;
+               if (v - 0.5 <= HorizonRow) continue;
+
+               uint8_t* row = coverage.data() + static_cast<size_t>(y) * Camera.Width;
+               for (int x = conic.Left; x < conic.Right; ++x) {
+                  const glm::dvec3 p(x + 0.5, v, 1.0);
+                  const glm::dvec3 qp = conic.Q * p;
+                  const double value = dot( p, qp );
+                  const double gradient_u = 2.0 * qp.x;
+                  const double gradient_v = 2.0 * qp.y;
+                  const double gradient = std::sqrt( gradient_u * gradient_u + gradient_v * gradient_v );
+
+                  // the first order distance to the edge decides pixels that are entirely inside or outside
+                  uint8_t pixel_coverage;
+                  if (value < -gradient) pixel_coverage = 255;
+                  else if (value > gradient) pixel_coverage = 0;
+                  else {
+                     const int inside = countInsideSamples(
+                        du.data(), dv.data(), n_samples, static_cast<float>(value),
+                        static_cast<float>(gradient_u), static_cast<float>(gradient_v), quu, quv, qvv
+                     );
+                     pixel_coverage = static_cast<uint8_t>((inside * 255 + n_samples / 2) / n_samples);
+                  }
+                  row[x] = std::max( row[x], pixel_coverage );
+               }
+            }
+         }
+      );
+   }
+}
+
+void FenceRasterizer::getLowestVisibleHeights(
+   float* heights,
+   const glm::vec3& row_ray,
+   const glm::vec3& column_step,
+   const GroundFence& fence,
+   const float* obstacle_distances
+) const
+{
+   // the ray t * r of a pixel passes over the disc for t in [t0, t1] and meets the plane of its base at Center.y / r.y,
+   // so the lowest point of the volume it sees is at the far end of that interval when it looks down,
+   // and an obstacle ends the interval where the ray meets it
+   const float cx = fence.Center.x;
+   const float cz = fence.Center.z;
+   const float c = cx * cx + cz * cz - fence.Radius * fence.Radius;
+   const float base_depth = fence.Center.y;
+   constexpr float infinity = std::numeric_limits<float>::infinity();
+
+   int x = 0;
+#ifdef USE_SSE2
+   const __m128 zero = _mm_setzero_ps();
+   const __m128 infinity4 = _mm_set1_ps( infinity );
+   const __m128 cx4 = _mm_set1_ps( cx );
+   const __m128 cz4 = _mm_set1_ps( cz );
+   const __m128 c4 = _mm_set1_ps( c );
+   const __m128 base_depth4 = _mm_set1_ps( base_depth );
+   const __m128 offsets = _mm_setr_ps( 0.5f, 1.5f, 2.5f, 3.5f );
+   for (; x + 4 <= Camera.Width; x += 4) {
+      const __m128 u = _mm_add_ps( _mm_set1_ps( static_cast<float>(x) ), offsets );
+      const __m128 rx = _mm_add_ps( _mm_set1_ps( row_ray.x ), _mm_mul_ps( u, _mm_set1_ps( column_step.x ) ) );
+      const __m128 ry = _mm_add_ps( _mm_set1_ps( row_ray.y ), _mm_mul_ps( u, _mm_set1_ps( column_step.y ) ) );
+      const __m128 rz = _mm_add_ps( _mm_set1_ps( row_ray.z ), _mm_mul_ps( u, _mm_set1_ps( column_step.z ) ) );
+
+      const __m128 a = _mm_add_ps( _mm_mul_ps( rx, rx ), _mm_mul_ps( rz, rz ) );
+      const __m128 b = _mm_add_ps( _mm_mul_ps( rx, cx4 ), _mm_mul_ps( rz, cz4 ) );
+      const __m128 discriminant = _mm_sub_ps( _mm_mul_ps( b, b ), _mm_mul_ps( a, c4 ) );
+      const __m128 root = _mm_sqrt_ps( _mm_max_ps( discriminant, zero ) );
+      const __m128 t0 = _mm_div_ps( _mm_sub_ps( b, root ), a );
+      const __m128 t1 = _mm_div_ps( _mm_add_ps( b, root ), a );
+
+      const __m128 down = _mm_cmpgt_ps( ry, zero );
+      const __m128 t_ground = _mm_or_ps(
+         _mm_and_ps( down, _mm_div_ps( base_depth4, ry ) ),
+         _mm_andnot_ps( down, infinity4 )
+      );
+      const __m128 near_t = _mm_max_ps( t0, zero );
+      const __m128 obstacle_t = obstacle_distances != nullptr ? _mm_loadu_ps( obstacle_distances + x ) : infinity4;
+      const __m128 far_t = _mm_min_ps( _mm_min_ps( t1, t_ground ), obstacle_t );
+      const __m128 valid = _mm_and_ps(
+         _mm_and_ps( _mm_cmpge_ps( discriminant, zero ), _mm_cmpgt_ps( a, zero ) ),
+         _mm_cmple_ps( near_t, far_t )
+      );
+      const __m128 lowest_t = _mm_or_ps( _mm_and_ps( down, far_t ), _mm_andnot_ps( down, near_t ) );
+      const __m128 height = _mm_max_ps( _mm_sub_ps( base_depth4, _mm_mul_ps( lowest_t, ry ) ), zero );
+      _mm_storeu_ps( heights + x, _mm_or_ps( _mm_and_ps( valid, height ), _mm_andnot_ps( valid, infinity4 ) ) );
+   }
+#endif
+   for (; x < Camera.Width; ++x) {
+      const glm::vec3 r = row_ray + (static_cast<float>(x) + 0.5f) * column_step;
+      const float a = r.x * r.x + r.z * r.z;
+      const float b = r.x * cx + r.z * cz;
+      const float discriminant = b * b - a * c;
+      heights[x] = infinity;
+      if (discriminant < 0.0f || a <= 0.0f) continue;
+
+      const float root = std::sqrt( discriminant );
+      const bool down = r.y > 0.0f;
+      const float near_t = std::max( (b - root) / a, 0.0f );
+      const float obstacle_t = obstacle_distances != nullptr ? obstacle_distances[x] : infinity;
+      const float far_t = std::min( { (b + root) / a, down ? base_depth / r.y : infinity, obstacle_t } );
+      if (near_t > far_t) continue;
+      heights[x] = std::max( base_depth - (down ? far_t : near_t) * r.y, 0.0f );
+   }
+}
+
+void FenceRasterizer::getVolumeMasks(
+   std::vector<std::vector<uint8_t>>& masks,
+   const std::vector<GroundFence>& fences,
+   const std::vector<float>& object_heights,
+   const float* obstacle_distances
+) const
+{
+   const size_t size = static_cast<size_t>(Camera.Width) * Camera.Height;
+   masks.resize( object_heights.size() );
+   for (auto& mask : masks) mask.assign( size, 0 );
+
+   const glm::mat3 rotation(Camera.ToWorldCoordinate);
+   const glm::vec3 column_step = rotation[0];
+   // the ray of an object's foot on the ground is numerically a hair off the ground
+   constexpr float height_tolerance = 1e-3f;
+   parallelFor(
+      0, Camera.Height,
+      [&](int begin, int end)
+      {
+         std::vector<float> heights(Camera.Width);
+         for (int y = begin; y < end; ++y) {
+            const glm::vec3 row_ray = rotation * glm::vec3(
+               -0.5f * static_cast<float>(Camera.Width),
+               static_cast<float>(y) + 0.5f - 0.5f * static_cast<float>(Camera.Height),
+               Camera.FocalLength
+            );
+            const size_t offset = static_cast<size_t>(y) * Camera.Width;
+            for (const auto& fence : fences) {
+               if (fence.Center.y <= 0.0f) continue;
+               getLowestVisibleHeights(
+                  heights.data(), row_ray, column_step, fence,
+                  obstacle_distances != nullptr ? obstacle_distances + offset : nullptr
+               );
+               for (size_t k = 0; k < object_heights.size(); ++k) {
+                  const float visible_height = object_heights[k] + height_tolerance;
+                  uint8_t* row = masks[k].data() + offset;
+                  for (int x = 0; x < Camera.Width; ++x) {
+                     if (heights[x] <= visible_height) row[x] = fence.Label;
+                  }
+               }
+            }
+         }
+      }
+   );
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "PinholeCamera.h"
+
+struct GroundFence
+{
+	glm::vec3 Center; // world coordinates on the ground, whose y may follow the terrain below the camera
+	float Radius;
+	uint8_t Label;
+
+	GroundFence() : Center( 0.0f ), Radius( 0.0f ), Label( 255 ) {}
+	GroundFence(const glm::vec3& center, float radius, uint8_t label) : Center( center ), Radius( radius ), Label( label ) {}
+};
+
+// rasterizes fence discs on the ground exactly on the CPU, where each disc is a conic in the image.
+// a disc lies flat at the height of its center, as on the terrain in the GL captures, but nothing hides it.
+class FenceRasterizer
+{
+public:
+	FenceRasterizer();
+
+	void setCamera(const PinholeCamera& camera);
+	// top-down label of the last fence containing each pixel center
+	void getLabels(std::vector<uint8_t>& labels, const std::vector<GroundFence>& fences) const;
+	// top-down fraction of each pixel inside any fence in [0, 255], where only pixels within a pixel of a fence edge
+	// take samples_per_axis^2 samples, so the cost follows the fence perimeter rather than its area
+	void getCoverage(std::vector<uint8_t>& coverage, const std::vector<GroundFence>& fences, int samples_per_axis) const;
+	// one top-down label mask per object height, which marks the pixels where any part of an upright object of that
+	// height standing inside a fence can appear, that is, the image of the fence volume from the ground to the height.
+	// every pixel finds the lowest height at which it sees each volume once, so all heights come from a single sweep.
+	// obstacle_distances, if any, holds the top-down ray parameter of the first obstacle of each pixel, which hides
+	// the volume behind it, in units of the pixel ray (x - cx, y - cy, f) turned to the world
+	void getVolumeMasks(
+		std::vector<std::vector<uint8_t>>& masks,
+		const std::vector<GroundFence>& fences,
+		const std::vector<float>& object_heights,
+		const float* obstacle_distances = nullptr
+	) const;
+
+private:
+	struct FenceConic
+	{
+		glm::dmat3 Q; // inside where (u, v, 1) Q (u, v, 1)^T < 0
+		int Left;
+		int Top;
+		int Right; // exclusive
+		int Bottom; // exclusive
+	};
+
+	PinholeCamera Camera;
+	glm::dmat3 ImageToGround;
+	float HorizonRow;
+
+	bool getConic(FenceConic& conic, const GroundFence& fence) const;
+	void getLowestVisibleHeights(
+		float* heights,
+		const glm::vec3& row_ray,
+		const glm::vec3& column_step,
+		const GroundFence& fence,
+		const float* obstacle_distances
+	) const;
+	static int countInsideSamples(
+		const float* du,
+		const float* dv,
+		int n_samples,
+		float value,
+		float gradient_u,
+		float gradient_v,
+		float quu,
+		float quv,
+		float qvv
+	);
+};
\ No newline at end of file
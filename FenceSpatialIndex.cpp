@@ -0,0 +1,164 @@
+#include "FenceSpatialIndex.h"
+
+namespace
+{
+   // drops the planes the box is entirely inside of from the mask, and returns false if it is entirely outside one
+   bool clipBox(uint& plane_mask, const ViewFrustum& frustum, const glm::vec3& min_point, const glm::vec3& max_point)
+   {
+      for (int i = 0; i < frustum.PlaneCount; ++i) {
+         const uint bit = 1u << i;
+         if ((plane_mask & bit) == 0) continue;
+
+         const glm::vec4& plane = frustum.Planes[i];
+         const glm::vec3 normal(plane);
+         const glm::vec3 farthest(
+            normal.x >= 0.0f ? max_point.x : min_point.x,
+            normal.y >= 0.0f ? max_point.y : min_point.y,
+            normal.z >= 0.0f ? max_point.z : min_point.z
+         );
+         if (dot( normal, farthest ) + plane.w < 0.0f) return false;
+
+         const glm::vec3 nearest(
+            normal.x >= 0.0f ? min_point.x : max_point.x,
+            normal.y >= 0.0f ? min_point.y : max_point.y,
+            normal.z >= 0.0f ? min_point.z : max_point.z
+         );
+         if (dot( normal, nearest ) + plane.w >= 0.0f) plane_mask &= ~bit;
+      }
+      return true;
+   }
+}
+
+ViewFrustum::ViewFrustum(const glm::mat4& view_projection) : Planes{}, PlaneCount( 6 )
+{
+   const glm::vec4 row0(view_projection[0][0], view_projection[1][0], view_projection[2][0], view_projection[3][0]);
+   const glm::vec4 row1(view_projection[0][1], view_projection[1][1], view_projection[2][1], view_projection[3][1]);
+   const glm::vec4 row2(view_projection[0][2], view_projection[1][2], view_projection[2][2], view_projection[3][2]);
+   const glm::vec4 row3(view_projection[0][3], view_projection[1][3], view_projection[2][3], view_projection[3][3]);
+   Planes[0] = row3 + row0;
+   Planes[1] = row3 - row0;
+   Planes[2] = row3 + row1;
+   Planes[3] = row3 - row1;
+   Planes[4] = row3 + row2;
+   Planes[5] = row3 - row2;
+}
+
+ViewFrustum::ViewFrustum(const PinholeCamera& camera) : Planes{}, PlaneCount( 5 )
+{
+   const glm::vec3 origin(camera.ToWorldCoordinate[3]);
+   const glm::mat3 to_world(camera.ToWorldCoordinate);
+   const float half_width = static_cast<float>(camera.Width) * 0.5f;
+   const float half_height = static_cast<float>(camera.Height) * 0.5f;
+   const glm::vec3 corners[4] = {
+      to_world * glm::vec3(-half_width, -half_height, camera.FocalLength),
+      to_world * glm::vec3(half_width, -half_height, camera.FocalLength),
+      to_world * glm::vec3(half_width, half_height, camera.FocalLength),
+      to_world * glm::vec3(-half_width, half_height, camera.FocalLength)
+   };
+   const glm::vec3 forward = to_world * glm::vec3(0.0f, 0.0f, 1.0f);
+   for (int i = 0; i < 4; ++i) {
+      glm::vec3 normal = cross( corners[i], corners[(i + 1) % 4] );
+      if (dot( normal, forward ) < 0.0f) normal = -normal;
+      Planes[i] = glm::vec4(normal, -dot( normal, origin ));
+   }
+   Planes[4] = glm::vec4(forward, -dot( forward, origin ));
+}
+
+bool ViewFrustum::intersects(const glm::vec3& min_point, const glm::vec3& max_point) const
+{
+   uint plane_mask = (1u << PlaneCount) - 1;
+   return clipBox( plane_mask, *this, min_point, max_point );
+}
+
+FenceSpatialIndex::FenceSpatialIndex() = default;
+
+void FenceSpatialIndex::build(const std::vector<GroundFence>& fences)
+{
+   Nodes.clear();
+   const auto n = static_cast<int>(fences.size());
+   Order.resize( n );
+   FenceMin.resize( n );
+   FenceMax.resize( n );
+   if (n == 0) return;
+
+   std::vector<glm::vec3> centers(n);
+   for (int i = 0; i < n; ++i) {
+      const GroundFence& fence = fences[i];
+      Order[i] = i;
+      centers[i] = fence.Center;
+      FenceMin[i] = fence.Center - glm::vec3(fence.Radius, 0.0f, fence.Radius);
+      FenceMax[i] = fence.Center + glm::vec3(fence.Radius, 0.0f, fence.Radius);
+   }
+   Nodes.reserve( 2 * static_cast<size_t>(n) );
+   Nodes.emplace_back();
+   buildNode( centers, 0, 0, n, 0 );
+}
+
+void FenceSpatialIndex::buildNode(std::vector<glm::vec3>& centers, int node_index, int begin, int end, int depth)
+{
+   glm::vec3 min_point(std::numeric_limits<float>::max()), max_point(std::numeric_limits<float>::lowest());
+   glm::vec3 min_center = min_point, max_center = max_point;
+   for (int i = begin; i < end; ++i) {
+      const int fence = Order[i];
+      min_point = min( min_point, FenceMin[fence] );
+      max_point = max( max_point, FenceMax[fence] );
+      min_center = min( min_center, centers[fence] );
+      max_center = max( max_center, centers[fence] );
+   }
+   Nodes[node_index].Min = min_point;
+   Nodes[node_index].Max = max_point;
+
+   const glm::vec3 extent = max_center - min_center;
+   if (end - begin <= MaxLeafSize || depth >= MaxDepth || (extent.x <= 0.0f && extent.y <= 0.0f && extent.z <= 0.0f)) {
+      Nodes[node_index].Start = begin;
+      Nodes[node_index].Count = end - begin;
+      return;
+   }
+
+   // the fences are spread over the ground, so the median split along the longest axis keeps the tree balanced
+   const int axis = extent.x >= extent.z ? (extent.x >= extent.y ? 0 : 1) : (extent.z >= extent.y ? 2 : 1);
+   const int middle = begin + (end - begin) / 2;
+   std::nth_element(
+      Order.begin() + begin, Order.begin() + middle, Order.begin() + end,
+      [&centers, axis](int a, int b) { return centers[a][axis] < centers[b][axis]; }
+   );
+
+   const auto left = static_cast<int>(Nodes.size());
+   Nodes.resize( Nodes.size() + 2 );
+   Nodes[node_index].Start = left;
+   Nodes[node_index].Count = 0;
+   buildNode( centers, left, begin, middle, depth + 1 );
+   buildNode( centers, left + 1, middle, end, depth + 1 );
+}
+
+void FenceSpatialIndex::getVisibleFences(std::vector<int>& visible, const ViewFrustum& frustum, float height) const
+{
+   visible.clear();
+   if (Nodes.empty()) return;
+
+   // a node entirely inside some planes never tests them again below, and one inside all of them takes every fence
+   const glm::vec3 lift(0.0f, height, 0.0f);
+   std::pair<int, uint> stack[MaxDepth + 2];
+   int top = 0;
+   stack[top++] = { 0, (1u << frustum.PlaneCount) - 1 };
+   while (top > 0) {
+      const auto [node_index, parent_mask] = stack[--top];
+      const Node& node = Nodes[node_index];
+      uint plane_mask = parent_mask;
+      if (plane_mask != 0 && !clipBox( plane_mask, frustum, node.Min - lift, node.Max )) continue;
+
+      if (node.Count == 0) {
+         stack[top++] = { node.Start + 1, plane_mask };
+         stack[top++] = { node.Start, plane_mask };
+         continue;
+      }
+      for (int i = node.Start; i < node.Start + node.Count; ++i) {
+         const int fence = Order[i];
+         uint fence_mask = plane_mask;
+         if (fence_mask == 0 || clipBox( fence_mask, frustum, FenceMin[fence] - lift, FenceMax[fence] )) {
+            visible.emplace_back( fence );
+         }
+      }
+   }
+   std::sort( visible.begin(), visible.end() );
+}
\ No newline at end of file
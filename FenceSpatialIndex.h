@@ -0,0 +1,60 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "FenceRasterizer.h"
+
+// the planes bounding what a camera sees, where a point p is inside every plane with dot( plane, (p, 1) ) >= 0
+struct ViewFrustum
+{
+	glm::vec4 Planes[6];
+	int PlaneCount;
+
+	// the six planes of the clip volume of an OpenGL view-projection matrix
+	explicit ViewFrustum(const glm::mat4& view_projection);
+	// the four image borders and the image plane through the camera center, without any far limit
+	explicit ViewFrustum(const PinholeCamera& camera);
+
+	// false only if the box is entirely outside a plane, so a few boxes near the corners pass without being visible
+	bool intersects(const glm::vec3& min_point, const glm::vec3& max_point) const;
+};
+
+// a bounding volume hierarchy over fences in world coordinates, which finds the fences in a view frustum
+// in time proportional to the visible ones rather than to all of them
+class FenceSpatialIndex
+{
+public:
+	FenceSpatialIndex();
+
+	bool empty() const { return Nodes.empty(); }
+	void build(const std::vector<GroundFence>& fences);
+	int getFenceCount() const { return static_cast<int>(Order.size()); }
+	// ascending indices of the fences whose volume from the ground up to height meets the frustum
+	void getVisibleFences(std::vector<int>& visible, const ViewFrustum& frustum, float height) const;
+
+private:
+	static constexpr int MaxLeafSize = 4;
+	static constexpr int MaxDepth = 64;
+
+	struct Node
+	{
+		glm::vec3 Min; // Min.y is the highest ground under the fences, which the query lifts by the fence height
+		int Start; // the first fence of a leaf in Order, or the left child of an inner node whose right child follows it
+		glm::vec3 Max;
+		int Count; // 0 for inner nodes
+	};
+
+	std::vector<Node> Nodes;
+	std::vector<int> Order;
+	std::vector<glm::vec3> FenceMin;
+	std::vector<glm::vec3> FenceMax;
+
+	void buildNode(std::vector<glm::vec3>& centers, int node_index, int begin, int end, int depth);
+};
\ No newline at end of file
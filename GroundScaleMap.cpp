@@ -0,0 +1,111 @@
+#include "GroundScaleMap.h"
+
+GroundScaleMap::GroundScaleMap() : Width( 0 ), Height( 0 ), Step( 1 ), ObjectHeightInMeter( PersonHeight )
+{
+}
+
+void GroundScaleMap::getRowScales(
+   float* ground_sampling_distances,
+   float* object_heights,
+   const PinholeCamera& camera,
+   const float* rows,
+   int n_rows,
+   float object_height_in_meter
+)
+{
+   // for the ray r = (u - cx, v - cy, f) of a pixel, its world y component is ry = (v - cy)cos(tilt) + f sin(tilt).
+   // the ground area of a pixel is h^2 f / ry^3 for the camera height h, and an object of height o standing there
+   // spans o ry (f cos(tilt) - (v - cy)sin(tilt)) / (h f - o ry sin(tilt)) pixels.
+   const float sin_tilt = sinf( camera.TiltAngle );
+   const float cos_tilt = cosf( camera.TiltAngle );
+   const float center_y = static_cast<float>(camera.Height) * 0.5f;
+   const float f = camera.FocalLength;
+   const float gsd_scale = camera.CameraHeight * sqrtf( f );
+   const float head_limit = camera.CameraHeight * f;
+   const float object_sin_tilt = object_height_in_meter * sin_tilt;
+
+   int i = 0;
+#ifdef USE_SSE2
+   const __m128 zero = _mm_setzero_ps();
+   const __m128 sin_tilt4 = _mm_set1_ps( sin_tilt );
+   const __m128 cos_tilt4 = _mm_set1_ps( cos_tilt );
+   const __m128 center_y4 = _mm_set1_ps( center_y );
+   const __m128 f_sin_tilt = _mm_set1_ps( f * sin_tilt );
+   const __m128 f_cos_tilt = _mm_set1_ps( f * cos_tilt );
+   const __m128 gsd_scale4 = _mm_set1_ps( gsd_scale );
+   const __m128 head_limit4 = _mm_set1_ps( head_limit );
+   const __m128 object_sin_tilt4 = _mm_set1_ps( object_sin_tilt );
+   const __m128 object_height4 = _mm_set1_ps( object_height_in_meter );
+   for (; i + 4 <= n_rows; i += 4) {
+      const __m128 dv = _mm_sub_ps( _mm_loadu_ps( rows + i ), center_y4 );
+      const __m128 ry = _mm_add_ps( _mm_mul_ps( dv, cos_tilt4 ), f_sin_tilt );
+      const __m128 on_ground = _mm_cmpgt_ps( ry, zero );
+      const __m128 safe_ry = _mm_max_ps( ry, _mm_set1_ps( std::numeric_limits<float>::min() ) );
+      const __m128 gsd = _mm_div_ps( gsd_scale4, _mm_mul_ps( safe_ry, _mm_sqrt_ps( safe_ry ) ) );
+      _mm_storeu_ps( ground_sampling_distances + i, _mm_and_ps( gsd, on_ground ) );
+
+      const __m128 denominator = _mm_sub_ps( head_limit4, _mm_mul_ps( object_sin_tilt4, ry ) );
+      const __m128 numerator = _mm_mul_ps(
+         _mm_mul_ps( object_height4, ry ),
+         _mm_sub_ps( f_cos_tilt, _mm_mul_ps( dv, sin_tilt4 ) )
+      );
+      const __m128 valid = _mm_and_ps( on_ground, _mm_cmpgt_ps( denominator, zero ) );
+      _mm_storeu_ps( object_heights + i, _mm_and_ps( _mm_div_ps( numerator, denominator ), valid ) );
+   }
+#endif
+   for (; i < n_rows; ++i) {
+      const float dv = rows[i] - center_y;
+      const float ry = dv * cos_tilt + f * sin_tilt;
+      if (ry <= 0.0f) {
+         ground_sampling_distances[i] = 0.0f;
+         object_heights[i] = 0.0f;
+         continue;
+      }
+      ground_sampling_distances[i] = gsd_scale / (ry * sqrtf( ry ));
+
+      const float denominator = head_limit - object_sin_tilt * ry;
+      object_heights[i] = denominator > 0.0f ?
+         object_height_in_meter * ry * (f * cos_tilt - dv * sin_tilt) / denominator : 0.0f;
+   }
+}
+
+void GroundScaleMap::build(const PinholeCamera& camera, int step, float object_height_in_meter)
+{
+   Step = std::max( step, 1 );
+   Width = (camera.Width + Step - 1) / Step;
+   Height = (camera.Height + Step - 1) / Step;
+   ObjectHeightInMeter = object_height_in_meter;
+
+   std::vector<float> rows(Height);
+   for (int j = 0; j < Height; ++j) rows[j] = (static_cast<float>(j) + 0.5f) * static_cast<float>(Step);
+   RowGroundSamplingDistances.resize( Height );
+   RowObjectHeights.resize( Height );
+   getRowScales(
+      RowGroundSamplingDistances.data(), RowObjectHeights.data(), camera, rows.data(), Height, object_height_in_meter
+   );
+
+   GroundSamplingDistances.resize( static_cast<size_t>(Width) * Height );
+   ObjectHeights.resize( static_cast<size_t>(Width) * Height );
+   for (int j = 0; j < Height; ++j) {
+      const size_t offset = static_cast<size_t>(j) * Width;
+      std::fill_n( GroundSamplingDistances.begin() + offset, Width, RowGroundSamplingDistances[j] );
+      std::fill_n( ObjectHeights.begin() + offset, Width, RowObjectHeights[j] );
+   }
+}
+
+int GroundScaleMap::getMapRow(float y) const
+{
+   return std::clamp( static_cast<int>(std::floor( y / static_cast<float>(Step) )), 0, Height - 1 );
+}
+
+float GroundScaleMap::getGroundSamplingDistance(float y) const
+{
+   if (Height == 0) return 0.0f;
+   return RowGroundSamplingDistances[getMapRow( y )];
+}
+
+float GroundScaleMap::getObjectHeight(float y) const
+{
+   if (Height == 0) return 0.0f;
+   return RowObjectHeights[getMapRow( y )];
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "PinholeCamera.h"
+
+// per-pixel ground sampling distance and pixel height of an upright object standing on the ground there.
+// the camera has no roll, so both are functions of the image row only and are computed in closed form per row.
+class GroundScaleMap
+{
+public:
+	static constexpr float PersonHeight = 1.7f;
+
+	GroundScaleMap();
+
+	// every cell of the map covers step x step image pixels and is evaluated at its center
+	void build(const PinholeCamera& camera, int step = 1, float object_height_in_meter = PersonHeight);
+	int getWidth() const { return Width; }
+	int getHeight() const { return Height; }
+	int getStep() const { return Step; }
+	float getObjectHeightInMeter() const { return ObjectHeightInMeter; }
+	// top-down meters per pixel, which is the square root of the ground area a pixel covers, and 0 above the horizon
+	const std::vector<float>& getGroundSamplingDistances() const { return GroundSamplingDistances; }
+	// top-down object heights in pixels, and 0 where the foot is not on the visible ground or the head is behind the camera
+	const std::vector<float>& getObjectHeights() const { return ObjectHeights; }
+	// lookups by the image row y, as the scales do not change along a row
+	float getGroundSamplingDistance(float y) const;
+	float getObjectHeight(float y) const;
+
+	static void getRowScales(
+		float* ground_sampling_distances,
+		float* object_heights,
+		const PinholeCamera& camera,
+		const float* rows,
+		int n_rows,
+		float object_height_in_meter
+	);
+
+private:
+	int Width;
+	int Height;
+	int Step;
+	float ObjectHeightInMeter;
+	std::vector<float> RowGroundSamplingDistances;
+	std::vector<float> RowObjectHeights;
+	std::vector<float> GroundSamplingDistances;
+	std::vector<float> ObjectHeights;
+
+	int getMapRow(float y) const;
+};
\ No newline at end of file
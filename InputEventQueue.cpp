@@ -0,0 +1,33 @@
+#include "InputEventQueue.h"
+
+InputEventQueue::InputEventQueue() : Head( 0 ), Tail( 0 ), Events{}
+{
+   static_assert( (Capacity & (Capacity - 1)) == 0, "the capacity should be a power of two" );
+}
+
+bool InputEventQueue::push(const InputEvent& event)
+{
+   const size_t tail = Tail.load( std::memory_order_relaxed );
+   if (tail - Head.load( std::memory_order_acquire ) == Capacity) return false;
+
+   // the release store publishes the event together with the new tail
+   Events[tail & (Capacity - 1)] = event;
+   Tail.store( tail + 1, std::memory_order_release );
+   return true;
+}
+
+bool InputEventQueue::pop(InputEvent& event)
+{
+   const size_t head = Head.load( std::memory_order_relaxed );
+   if (head == Tail.load( std::memory_order_acquire )) return false;
+
+   // the slot is handed back to the producer only after it has been read
+   event = Events[head & (Capacity - 1)];
+   Head.store( head + 1, std::memory_order_release );
+   return true;
+}
+
+bool InputEventQueue::empty() const
+{
+   return Head.load( std::memory_order_acquire ) == Tail.load( std::memory_order_acquire );
+}
\ No newline at end of file
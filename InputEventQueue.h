@@ -0,0 +1,49 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "_Common.h"
+
+#include <atomic>
+
+// a window event as the callbacks see it, with whatever they have to read on the main thread
+struct InputEvent
+{
+	enum class Type : uint8_t { KEY, MOUSE_BUTTON, MOUSE_WHEEL, RESIZE, REFRESH, CLOSE };
+
+	Type EventType;
+	int Code;   // the key or the mouse button
+	int Action;
+	int Mods;
+	double X;   // the cursor position, the wheel offsets or the framebuffer size
+	double Y;
+};
+
+// a lock-free ring buffer between one producer thread and one consumer thread,
+// whose positions only grow and wrap around the power-of-two capacity with a mask
+class InputEventQueue
+{
+public:
+	static constexpr size_t Capacity = 1024;
+
+	InputEventQueue();
+
+	// only the producer pushes, and it returns false without the event if the queue is full
+	bool push(const InputEvent& event);
+	// only the consumer pops
+	bool pop(InputEvent& event);
+	bool empty() const;
+
+private:
+	// the positions lie on cache lines of their own, so the two threads never write to the same line
+	alignas(64) std::atomic<size_t> Head; // the next event to pop
+	alignas(64) std::atomic<size_t> Tail; // where the next event goes
+	InputEvent Events[Capacity];
+};
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include "IntegralFenceMask.h"
+
+IntegralFenceMask::IntegralFenceMask() : Width( 0 ), Height( 0 ), TableWidth( 0 )
+{
+}
+
+void IntegralFenceMask::buildTable(std::vector<uint>& table, const uint8_t* mask, uint8_t label) const
+{
+   table.assign( static_cast<size_t>(TableWidth) * (Height + 1), 0 );
+   for (int y = 0; y < Height; ++y) {
+      const uint8_t* mask_row = mask + static_cast<size_t>(y) * Width;
+      const uint* upper_row = table.data() + static_cast<size_t>(y) * TableWidth;
+      uint* row = table.data() + static_cast<size_t>(y + 1) * TableWidth;
+
+      uint row_sum = 0;
+      if (label == AnyFence) {
+         for (int x = 0; x < Width; ++x) {
+            row_sum += mask_row[x] != 0 ? 1 : 0;
+            row[x + 1] = row_sum;
+         }
+      }
+      else {
+         for (int x = 0; x < Width; ++x) {
+            row_sum += mask_row[x] == label ? 1 : 0;
+            row[x + 1] = row_sum;
+         }
+      }
+
+      int x = 1;
+#ifdef USE_SSE2
+      for (; x + 4 <= TableWidth; x += 4) {
+         const __m128i upper = _mm_loadu_si128( reinterpret_cast<const __m128i*>(upper_row + x) );
+         const __m128i current = _mm_loadu_si128( reinterpret_cast<const __m128i*>(row + x) );
+         _mm_storeu_si128( reinterpret_cast<__m128i*>(row + x), _mm_add_epi32( upper, current ) );
+      }
+#endif
+      for (; x < TableWidth; ++x) row[x] += upper_row[x];
+   }
+}
+
+void IntegralFenceMask::build(const uint8_t* mask, int width, int height)
+{
+   Width = width;
+   Height = height;
+   TableWidth = width + 1;
+
+   uint histogram[256] = { 0, };
+   const int size = width * height;
+   for (int i = 0; i < size; ++i) histogram[mask[i]]++;
+
+   Labels.clear();
+   for (int label = 1; label < 256; ++label) {
+      if (histogram[label] > 0) Labels.emplace_back( static_cast<uint8_t>(label) );
+   }
+
+   Tables.resize( Labels.size() > 1 ? Labels.size() + 1 : 1 );
+   parallelFor(
+      0, static_cast<int>(Tables.size()),
+      [this, mask](int begin, int end)
+      {
+         for (int i = begin; i < end; ++i) {
+            buildTable( Tables[i], mask, i == 0 ? AnyFence : Labels[i - 1] );
+         }
+      }
+   );
+}
+
+const uint* IntegralFenceMask::getTable(uint8_t label) const
+{
+   if (Tables.empty()) return nullptr;
+   if (label == AnyFence) return Tables[0].data();
+
+   const auto it = std::find( Labels.begin(), Labels.end(), label );
+   if (it == Labels.end()) return nullptr;
+   if (Labels.size() == 1) return Tables[0].data();
+   return Tables[std::distance( Labels.begin(), it ) + 1].data();
+}
+
+uint IntegralFenceMask::getFencePixelCount(int x0, int y0, int x1, int y1, uint8_t label) const
+{
+   const uint* table = getTable( label );
+   if (table == nullptr) return 0;
+
+   x0 = std::clamp( x0, 0, Width );
+   x1 = std::clamp( x1, 0, Width );
+   y0 = std::clamp( y0, 0, Height );
+   y1 = std::clamp( y1, 0, Height );
+   if (x0 >= x1 || y0 >= y1) return 0;
+
+   return table[y1 * TableWidth + x1] - table[y0 * TableWidth + x1] - table[y1 * TableWidth + x0] + table[y0 * TableWidth + x0];
+}
+
+float IntegralFenceMask::getRatio(const uint* table, const DetectionBox& box, float strip_height_ratio) const
+{
+   const int x0 = static_cast<int>(std::lrint( box.X ));
+   const int x1 = static_cast<int>(std::lrint( box.X + box.Width ));
+   const int y0 = static_cast<int>(std::lrint( box.Y + box.Height * (1.0f - strip_height_ratio) ));
+   const int y1 = static_cast<int>(std::lrint( box.Y + box.Height ));
+   if (x1 <= x0 || y1 <= y0) return 0.0f;
+
+   const int cx0 = std::clamp( x0, 0, Width );
+   const int cx1 = std::clamp( x1, 0, Width );
+   const int cy0 = std::clamp( y0, 0, Height );
+   const int cy1 = std::clamp( y1, 0, Height );
+   const uint count =
+      table[cy1 * TableWidth + cx1] - table[cy0 * TableWidth + cx1] - table[cy1 * TableWidth + cx0] + table[cy0 * TableWidth + cx0];
+   return static_cast<float>(count) / static_cast<float>((x1 - x0) * (y1 - y0));
+}
+
+void IntegralFenceMask::getRatios(
+   std::vector<float>& ratios,
+   const std::vector<DetectionBox>& boxes,
+   float strip_height_ratio,
+   uint8_t label
+) const
+{
+   ratios.resize( boxes.size() );
+   const uint* table = getTable( label );
+   if (table == nullptr) {
+      std::fill( ratios.begin(), ratios.end(), 0.0f );
+      return;
+   }
+
+   const int n = static_cast<int>(boxes.size());
+   int i = 0;
+#ifdef USE_AVX2
+   static_assert( sizeof(DetectionBox) == 4 * sizeof(float), "DetectionBox should be tightly packed." );
+
+   const __m256i box_stride = _mm256_setr_epi32( 0, 4, 8, 12, 16, 20, 24, 28 );
+   const __m256 strip_offset = _mm256_set1_ps( 1.0f - strip_height_ratio );
+   const __m256i zero = _mm256_setzero_si256();
+   const __m256i max_x = _mm256_set1_epi32( Width );
+   const __m256i max_y = _mm256_set1_epi32( Height );
+   const __m256i table_width = _mm256_set1_epi32( TableWidth );
+   const auto* table_data = reinterpret_cast<const int*>(table);
+   for (; i + 8 <= n; i += 8) {
+      const float* base = &boxes[i].X;
+      const __m256 x = _mm256_i32gather_ps( base, box_stride, 4 );
+      const __m256 y = _mm256_i32gather_ps( base + 1, box_stride, 4 );
+      const __m256 w = _mm256_i32gather_ps( base + 2, box_stride, 4 );
+      const __m256 h = _mm256_i32gather_ps( base + 3, box_stride, 4 );
+
+      const __m256i x0 = _mm256_cvtps_epi32( x );
+      const __m256i x1 = _mm256_cvtps_epi32( _mm256_add_ps( x, w ) );
+      const __m256i y0 = _mm256_cvtps_epi32( _mm256_add_ps( y, _mm256_mul_ps( h, strip_offset ) ) );
+      const __m256i y1 = _mm256_cvtps_epi32( _mm256_add_ps( y, h ) );
+      const __m256i box_width = _mm256_sub_epi32( x1, x0 );
+      const __m256i box_height = _mm256_sub_epi32( y1, y0 );
+      const __m256i valid = _mm256_and_si256(
+         _mm256_cmpgt_epi32( box_width, zero ),
+         _mm256_cmpgt_epi32( box_height, zero )
+      );
+
+      const __m256i cx0 = _mm256_min_epi32( _mm256_max_epi32( x0, zero ), max_x );
+      const __m256i cx1 = _mm256_min_epi32( _mm256_max_epi32( x1, zero ), max_x );
+      const __m256i row0 = _mm256_mullo_epi32( _mm256_min_epi32( _mm256_max_epi32( y0, zero ), max_y ), table_width );
+      const __m256i row1 = _mm256_mullo_epi32( _mm256_min_epi32( _mm256_max_epi32( y1, zero ), max_y ), table_width );
+
+      const __m256i a = _mm256_i32gather_epi32( table_data, _mm256_add_epi32( row0, cx0 ), 4 );
+      const __m256i b = _mm256_i32gather_epi32( table_data, _mm256_add_epi32( row0, cx1 ), 4 );
+      const __m256i c = _mm256_i32gather_epi32( table_data, _mm256_add_epi32( row1, cx0 ), 4 );
+      const __m256i d = _mm256_i32gather_epi32( table_data, _mm256_add_epi32( row1, cx1 ), 4 );
+      const __m256i count = _mm256_add_epi32( _mm256_sub_epi32( _mm256_sub_epi32( d, b ), c ), a );
+
+      const __m256 area = _mm256_cvtepi32_ps( _mm256_mullo_epi32( box_width, box_height ) );
+      const __m256 ratio = _mm256_div_ps( _mm256_cvtepi32_ps( count ), area );
+      _mm256_storeu_ps( ratios.data() + i, _mm256_and_ps( ratio, _mm256_castsi256_ps( valid ) ) );
+   }
+#endif
+   for (; i < n; ++i) ratios[i] = getRatio( table, boxes[i], strip_height_ratio );
+}
+
+void IntegralFenceMask::getOverlapRatios(
+   std::vector<float>& ratios,
+   const std::vector<DetectionBox>& boxes,
+   uint8_t label
+) const
+{
+   getRatios( ratios, boxes, 1.0f, label );
+}
+
+void IntegralFenceMask::getBottomStripOverlapRatios(
+   std::vector<float>& ratios,
+   const std::vector<DetectionBox>& boxes,
+   float strip_height_ratio,
+   uint8_t label
+) const
+{
+   getRatios( ratios, boxes, std::clamp( strip_height_ratio, 0.0f, 1.0f ), label );
+}
\ No newline at end of file
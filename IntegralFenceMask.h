@@ -0,0 +1,64 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "_Common.h"
+
+struct DetectionBox
+{
+	float X; // top-left corner in image coordinates
+	float Y;
+	float Width;
+	float Height;
+
+	DetectionBox() : X( 0.0f ), Y( 0.0f ), Width( 0.0f ), Height( 0.0f ) {}
+	DetectionBox(float x, float y, float width, float height) : X( x ), Y( y ), Width( width ), Height( height ) {}
+};
+
+class IntegralFenceMask
+{
+public:
+	static constexpr uint8_t AnyFence = 0;
+
+	IntegralFenceMask();
+
+	// mask is top-down with 0 for outside and the fence label otherwise
+	void build(const uint8_t* mask, int width, int height);
+	const std::vector<uint8_t>& getLabels() const { return Labels; }
+	uint getFencePixelCount(int x0, int y0, int x1, int y1, uint8_t label = AnyFence) const;
+	void getOverlapRatios(
+		std::vector<float>& ratios,
+		const std::vector<DetectionBox>& boxes,
+		uint8_t label = AnyFence
+	) const;
+	void getBottomStripOverlapRatios(
+		std::vector<float>& ratios,
+		const std::vector<DetectionBox>& boxes,
+		float strip_height_ratio,
+		uint8_t label = AnyFence
+	) const;
+
+private:
+	int Width;
+	int Height;
+	int TableWidth;
+	std::vector<uint8_t> Labels;
+	std::vector<std::vector<uint>> Tables; // [0] for any fence, [i] for Labels[i - 1] if there are several labels
+
+	const uint* getTable(uint8_t label) const;
+	void buildTable(std::vector<uint>& table, const uint8_t* mask, uint8_t label) const;
+	void getRatios(
+		std::vector<float>& ratios,
+		const std::vector<DetectionBox>& boxes,
+		float strip_height_ratio,
+		uint8_t label
+	) const;
+	float getRatio(const uint* table, const DetectionBox& box, float strip_height_ratio) const;
+};
\ No newline at end of file
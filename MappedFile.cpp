@@ -0,0 +1,90 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile() : Data( nullptr ), Size( 0 ), FileHandle( INVALID_HANDLE_VALUE ), MappingHandle( nullptr )
+{
+}
+#else
+MappedFile::MappedFile() : Data( nullptr ), Size( 0 ), FileDescriptor( -1 )
+{
+}
+#endif
+
+MappedFile::~MappedFile()
+{
+   close();
+}
+
+bool MappedFile::open(const std::string& file_path)
+{
+   close();
+#ifdef _WIN32
+   FileHandle = CreateFileA(
+      file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr
+   );
+   if (FileHandle == INVALID_HANDLE_VALUE) return false;
+
+   LARGE_INTEGER file_size;
+   if (!GetFileSizeEx( FileHandle, &file_size ) || file_size.QuadPart == 0) {
+      close();
+      return false;
+   }
+   Size = static_cast<size_t>(file_size.QuadPart);
+
+   MappingHandle = CreateFileMappingA( FileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr );
+   if (MappingHandle == nullptr) {
+      close();
+      return false;
+   }
+   Data = static_cast<const uint8_t*>(MapViewOfFile( MappingHandle, FILE_MAP_READ, 0, 0, 0 ));
+#else
+   FileDescriptor = ::open( file_path.c_str(), O_RDONLY );
+   if (FileDescriptor < 0) return false;
+
+   struct stat file_status{};
+   if (fstat( FileDescriptor, &file_status ) != 0 || file_status.st_size == 0) {
+      close();
+      return false;
+   }
+   Size = static_cast<size_t>(file_status.st_size);
+
+   void* mapped = mmap( nullptr, Size, PROT_READ, MAP_PRIVATE, FileDescriptor, 0 );
+   if (mapped != MAP_FAILED) {
+      madvise( mapped, Size, MADV_SEQUENTIAL );
+      Data = static_cast<const uint8_t*>(mapped);
+   }
+#endif
+   if (Data == nullptr) {
+      close();
+      return false;
+   }
+   return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+   if (Data != nullptr) UnmapViewOfFile( Data );
+   if (MappingHandle != nullptr) CloseHandle( MappingHandle );
+   if (FileHandle != INVALID_HANDLE_VALUE) CloseHandle( FileHandle );
+   MappingHandle = nullptr;
+   FileHandle = INVALID_HANDLE_VALUE;
+#else
+   if (Data != nullptr) munmap( const_cast<uint8_t*>(Data), Size );
+   if (FileDescriptor >= 0) ::close( FileDescriptor );
+   FileDescriptor = -1;
+#endif
+   Data = nullptr;
+   Size = 0;
+}
\ No newline at end of file
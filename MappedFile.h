@@ -0,0 +1,39 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "_Common.h"
+
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile(const MappedFile&&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&&) = delete;
+
+	bool open(const std::string& file_path);
+	void close();
+	const uint8_t* data() const { return Data; }
+	size_t size() const { return Size; }
+
+private:
+	const uint8_t* Data;
+	size_t Size;
+#ifdef _WIN32
+	void* FileHandle;
+	void* MappingHandle;
+#else
+	int FileDescriptor;
+#endif
+};
\ No newline at end of file
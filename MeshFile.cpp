@@ -0,0 +1,653 @@
+#include "MeshFile.h"
+#include "MappedFile.h"
+
+#include <atomic>
+
+namespace
+{
+   // negative OBJ indices count back from the last vertex read so far, so a chunk stores them relative to its own first
+   // vertex shifted by this bias, and they are resolved once the vertex offsets of all chunks are known
+   constexpr long long RelativeIndexBias = 1LL << 48;
+   constexpr size_t MinChunkBytes = 1 << 20;
+
+   struct MeshChunk
+   {
+      std::vector<glm::vec3> Vertices;
+      std::vector<long long> Indices;
+      bool Valid;
+
+      MeshChunk() : Valid( true ) {}
+   };
+
+   bool isSpace(char c)
+   {
+      return c == ' ' || c == '\t' || c == '\r';
+   }
+
+   const char* skipSpaces(const char* p, const char* end)
+   {
+      while (p < end && isSpace( *p )) ++p;
+      return p;
+   }
+
+   const char* skipToken(const char* p, const char* end)
+   {
+      p = skipSpaces( p, end );
+      while (p < end && !isSpace( *p ) && *p != '\n') ++p;
+      return p;
+   }
+
+   const char* getNextLine(const char* p, const char* end)
+   {
+      const void* newline = std::memchr( p, '\n', static_cast<size_t>(end - p) );
+      return newline == nullptr ? end : static_cast<const char*>(newline) + 1;
+   }
+
+   bool isDigit(char c)
+   {
+      return static_cast<uint>(c - '0') < 10u;
+   }
+
+   // decimal numbers with an optional fraction and exponent. the significand keeps 19 digits,
+   // which is far more than a float can hold, and the scaling is done in double precision.
+   bool parseFloat(float& value, const char*& p, const char* end)
+   {
+      static constexpr double powers_of_ten[] = {
+         1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+         1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+      };
+
+      const char* s = skipSpaces( p, end );
+      bool negative = false;
+      if (s < end && (*s == '-' || *s == '+')) {
+         negative = *s == '-';
+         ++s;
+      }
+
+      uint64_t significand = 0;
+      int exponent = 0, n_digits = 0;
+      bool has_digits = false;
+      for (; s < end && isDigit( *s ); ++s) {
+         has_digits = true;
+         if (n_digits < 19) {
+            significand = significand * 10 + static_cast<uint64_t>(*s - '0');
+            if (significand != 0) n_digits++;
+         }
+         else exponent++;
+      }
+      if (s < end && *s == '.') {
+         for (++s; s < end && isDigit( *s ); ++s) {
+            has_digits = true;
+            if (n_digits < 19) {
+               significand = significand * 10 + static_cast<uint64_t>(*s - '0');
+               if (significand != 0) n_digits++;
+               exponent--;
+            }
+         }
+      }
+      if (!has_digits) return false;
+
+      if (s < end && (*s == 'e' || *s == 'E')) {
+         const char* e = s + 1;
+         bool negative_exponent = false;
+         if (e < end && (*e == '-' || *e == '+')) {
+            negative_exponent = *e == '-';
+            ++e;
+         }
+         int exponent_value = 0;
+         bool has_exponent = false;
+         for (; e < end && isDigit( *e ); ++e) {
+            has_exponent = true;
+            if (exponent_value < 10000) exponent_value = exponent_value * 10 + (*e - '0');
+         }
+         if (has_exponent) {
+            exponent += negative_exponent ? -exponent_value : exponent_value;
+            s = e;
+         }
+      }
+
+      double result = static_cast<double>(significand);
+      if (significand != 0) {
+         for (; exponent > 22; exponent -= 22) result *= powers_of_ten[22];
+         for (; exponent < -22; exponent += 22) result /= powers_of_ten[22];
+         result = exponent < 0 ? result / powers_of_ten[-exponent] : result * powers_of_ten[exponent];
+      }
+      value = static_cast<float>(negative ? -result : result);
+      p = s;
+      return true;
+   }
+
+   bool parseInteger(long long& value, const char*& p, const char* end)
+   {
+      const char* s = skipSpaces( p, end );
+      bool negative = false;
+      if (s < end && (*s == '-' || *s == '+')) {
+         negative = *s == '-';
+         ++s;
+      }
+      if (s == end || !isDigit( *s )) return false;
+
+      long long result = 0;
+      for (; s < end && isDigit( *s ); ++s) {
+         if (result < RelativeIndexBias) result = result * 10 + (*s - '0');
+      }
+      value = negative ? -result : result;
+      p = s;
+      return true;
+   }
+
+   void addTriangleFan(std::vector<long long>& indices, const std::vector<long long>& polygon)
+   {
+      for (size_t i = 2; i < polygon.size(); ++i) {
+         indices.insert( indices.end(), { polygon[0], polygon[i - 1], polygon[i] } );
+      }
+   }
+
+   // splits [begin, end) into chunks at line breaks and parses them on all cores
+   template<typename Parser>
+   void parseLineChunks(std::vector<MeshChunk>& chunks, const char* begin, const char* end, Parser&& parse)
+   {
+      const auto size = static_cast<size_t>(end - begin);
+      const size_t max_chunks = 4 * static_cast<size_t>(std::max( 1, static_cast<int>(std::thread::hardware_concurrency()) ));
+      const size_t n_chunks = std::clamp( size / MinChunkBytes, static_cast<size_t>(1), max_chunks );
+
+      std::vector<const char*> boundaries(n_chunks + 1, end);
+      boundaries[0] = begin;
+      for (size_t i = 1; i < n_chunks; ++i) {
+         const char* boundary = std::max( begin + size * i / n_chunks, boundaries[i - 1] );
+         boundaries[i] = boundary < end ? getNextLine( boundary, end ) : end;
+      }
+
+      const size_t first = chunks.size();
+      chunks.resize( first + n_chunks );
+      parallelFor(
+         0, static_cast<int>(n_chunks),
+         [&](int from, int to)
+         {
+            for (int i = from; i < to; ++i) parse( chunks[first + i], boundaries[i], boundaries[i + 1] );
+         }
+      );
+   }
+
+   void parseObjChunk(MeshChunk& chunk, const char* begin, const char* end)
+   {
+      std::vector<long long> polygon;
+      for (const char* line = begin; line < end;) {
+         const char* line_end = getNextLine( line, end );
+         const char* p = skipSpaces( line, line_end );
+         if (p + 1 < line_end && p[0] == 'v' && isSpace( p[1] )) {
+            glm::vec3 vertex;
+            p += 2;
+            if (!parseFloat( vertex.x, p, line_end ) ||
+                !parseFloat( vertex.y, p, line_end ) ||
+                !parseFloat( vertex.z, p, line_end )) {
+               chunk.Valid = false;
+               return;
+            }
+            chunk.Vertices.emplace_back( vertex );
+         }
+         else if (p + 1 < line_end && p[0] == 'f' && isSpace( p[1] )) {
+            polygon.clear();
+            for (p = skipSpaces( p + 2, line_end ); p < line_end && *p != '\n' && *p != '#'; p = skipSpaces( p, line_end )) {
+               // only the position index is used from v, v/vt, v//vn and v/vt/vn
+               long long position;
+               if (!parseInteger( position, p, line_end ) || position == 0) {
+                  chunk.Valid = false;
+                  return;
+               }
+               if (position < 0) position += static_cast<long long>(chunk.Vertices.size()) - RelativeIndexBias;
+               else position -= 1;
+               polygon.emplace_back( position );
+               while (p < line_end && !isSpace( *p ) && *p != '\n') ++p;
+            }
+            addTriangleFan( chunk.Indices, polygon );
+         }
+         line = line_end;
+      }
+   }
+
+   // concatenates the chunks in order and resolves the OBJ relative indices against the chunk vertex offsets
+   bool mergeChunks(std::vector<glm::vec3>& vertices, std::vector<uint>& indices, const std::vector<MeshChunk>& chunks)
+   {
+      const auto n_chunks = static_cast<int>(chunks.size());
+      std::vector<size_t> vertex_offsets(n_chunks + 1, 0);
+      std::vector<size_t> index_offsets(n_chunks + 1, 0);
+      for (int i = 0; i < n_chunks; ++i) {
+         if (!chunks[i].Valid) return false;
+         vertex_offsets[i + 1] = vertex_offsets[i] + chunks[i].Vertices.size();
+         index_offsets[i + 1] = index_offsets[i] + chunks[i].Indices.size();
+      }
+
+      vertices.resize( vertex_offsets[n_chunks] );
+      indices.resize( index_offsets[n_chunks] );
+      const auto n_vertices = static_cast<long long>(vertices.size());
+      std::atomic<bool> valid(true);
+      parallelFor(
+         0, n_chunks,
+         [&](int begin, int end)
+         {
+            for (int i = begin; i < end; ++i) {
+               const MeshChunk& chunk = chunks[i];
+               std::copy( chunk.Vertices.begin(), chunk.Vertices.end(), vertices.begin() + vertex_offsets[i] );
+               uint* destination = indices.data() + index_offsets[i];
+               const auto chunk_offset = static_cast<long long>(vertex_offsets[i]);
+               for (size_t k = 0; k < chunk.Indices.size(); ++k) {
+                  long long index = chunk.Indices[k];
+                  if (index < 0) index += RelativeIndexBias + chunk_offset;
+                  if (index < 0 || index >= n_vertices) {
+                     valid = false;
+                     return;
+                  }
+                  destination[k] = static_cast<uint>(index);
+               }
+            }
+         }
+      );
+      return valid;
+   }
+
+   bool readObj(std::vector<glm::vec3>& vertices, std::vector<uint>& indices, const char* begin, const char* end)
+   {
+      std::vector<MeshChunk> chunks;
+      parseLineChunks( chunks, begin, end, parseObjChunk );
+      return mergeChunks( vertices, indices, chunks );
+   }
+
+   enum class PLY_TYPE { INVALID = 0, INT8, UINT8, INT16, UINT16, INT32, UINT32, FLOAT32, FLOAT64 };
+
+   struct PlyProperty
+   {
+      std::string Name;
+      PLY_TYPE Type;
+      PLY_TYPE CountType; // valid only for list properties
+      bool IsList;
+   };
+
+   struct PlyElement
+   {
+      std::string Name;
+      size_t Count;
+      std::vector<PlyProperty> Properties;
+
+      int findProperty(const std::string& name) const
+      {
+         for (size_t i = 0; i < Properties.size(); ++i) {
+            if (Properties[i].Name == name) return static_cast<int>(i);
+         }
+         return -1;
+      }
+      int findFaceIndexList() const
+      {
+         int index = findProperty( "vertex_indices" );
+         if (index < 0) index = findProperty( "vertex_index" );
+         return index >= 0 && Properties[index].IsList ? index : -1;
+      }
+   };
+
+   struct PlyHeader
+   {
+      bool IsBinary;
+      bool SwapBytes;
+      size_t DataOffset;
+      std::vector<PlyElement> Elements;
+   };
+
+   PLY_TYPE getPlyType(const std::string& name)
+   {
+      if (name == "char" || name == "int8") return PLY_TYPE::INT8;
+      if (name == "uchar" || name == "uint8") return PLY_TYPE::UINT8;
+      if (name == "short" || name == "int16") return PLY_TYPE::INT16;
+      if (name == "ushort" || name == "uint16") return PLY_TYPE::UINT16;
+      if (name == "int" || name == "int32") return PLY_TYPE::INT32;
+      if (name == "uint" || name == "uint32") return PLY_TYPE::UINT32;
+      if (name == "float" || name == "float32") return PLY_TYPE::FLOAT32;
+      if (name == "double" || name == "float64") return PLY_TYPE::FLOAT64;
+      return PLY_TYPE::INVALID;
+   }
+
+   size_t getPlyTypeSize(PLY_TYPE type)
+   {
+      switch (type) {
+         case PLY_TYPE::INT8: case PLY_TYPE::UINT8: return 1;
+         case PLY_TYPE::INT16: case PLY_TYPE::UINT16: return 2;
+         case PLY_TYPE::INT32: case PLY_TYPE::UINT32: case PLY_TYPE::FLOAT32: return 4;
+         case PLY_TYPE::FLOAT64: return 8;
+         default: return 0;
+      }
+   }
+
+   bool readPlyHeader(PlyHeader& header, const char* data, size_t size)
+   {
+      const char* end = data + size;
+      const char* line = data;
+      std::string keyword;
+      bool has_format = false;
+      header.Elements.clear();
+      for (int n_lines = 0; line < end; ++n_lines) {
+         const char* line_end = getNextLine( line, end );
+         std::istringstream stream(std::string(line, line_end));
+         line = line_end;
+         if (!(stream >> keyword)) continue;
+         if (n_lines == 0) {
+            if (keyword != "ply") return false;
+         }
+         else if (keyword == "format") {
+            std::string format;
+            stream >> format;
+            const uint16_t one = 1;
+            const bool little_endian_host = *reinterpret_cast<const uint8_t*>(&one) == 1;
+            header.IsBinary = format != "ascii";
+            if (format == "binary_little_endian") header.SwapBytes = !little_endian_host;
+            else if (format == "binary_big_endian") header.SwapBytes = little_endian_host;
+            else if (format == "ascii") header.SwapBytes = false;
+            else return false;
+            has_format = true;
+         }
+         else if (keyword == "element") {
+            PlyElement element;
+            if (!(stream >> element.Name >> element.Count)) return false;
+            header.Elements.emplace_back( element );
+         }
+         else if (keyword == "property") {
+            if (header.Elements.empty()) return false;
+            std::string type;
+            PlyProperty property{};
+            if (!(stream >> type)) return false;
+            if (type == "list") {
+               std::string count_type, item_type;
+               if (!(stream >> count_type >> item_type >> property.Name)) return false;
+               property.IsList = true;
+               property.CountType = getPlyType( count_type );
+               property.Type = getPlyType( item_type );
+               if (property.CountType == PLY_TYPE::INVALID) return false;
+            }
+            else if (!(stream >> property.Name)) return false;
+            else property.Type = getPlyType( type );
+            if (property.Type == PLY_TYPE::INVALID) return false;
+            header.Elements.back().Properties.emplace_back( property );
+         }
+         else if (keyword == "end_header") {
+            header.DataOffset = static_cast<size_t>(line - data);
+            return has_format;
+         }
+      }
+      return false;
+   }
+
+   double readPlyValue(const uint8_t* data, PLY_TYPE type, bool swap_bytes)
+   {
+      uint8_t bytes[8];
+      const size_t size = getPlyTypeSize( type );
+      if (swap_bytes) {
+         for (size_t i = 0; i < size; ++i) bytes[i] = data[size - 1 - i];
+      }
+      else std::memcpy( bytes, data, size );
+
+      switch (type) {
+         case PLY_TYPE::INT8: { int8_t v; std::memcpy( &v, bytes, 1 ); return v; }
+         case PLY_TYPE::UINT8: return bytes[0];
+         case PLY_TYPE::INT16: { int16_t v; std::memcpy( &v, bytes, 2 ); return v; }
+         case PLY_TYPE::UINT16: { uint16_t v; std::memcpy( &v, bytes, 2 ); return v; }
+         case PLY_TYPE::INT32: { int32_t v; std::memcpy( &v, bytes, 4 ); return v; }
+         case PLY_TYPE::UINT32: { uint32_t v; std::memcpy( &v, bytes, 4 ); return v; }
+         case PLY_TYPE::FLOAT32: { float v; std::memcpy( &v, bytes, 4 ); return v; }
+         case PLY_TYPE::FLOAT64: { double v; std::memcpy( &v, bytes, 8 ); return v; }
+         default: return 0.0;
+      }
+   }
+
+   // walks one row of an element with list properties, adding the faces of the index list if face_list is valid
+   bool readBinaryPlyRow(
+      const uint8_t*& p,
+      const uint8_t* end,
+      const PlyElement& element,
+      int face_list,
+      bool swap_bytes,
+      std::vector<long long>& polygon,
+      std::vector<long long>* indices
+   )
+   {
+      for (size_t i = 0; i < element.Properties.size(); ++i) {
+         const PlyProperty& property = element.Properties[i];
+         const size_t item_size = getPlyTypeSize( property.Type );
+         if (!property.IsList) {
+            if (static_cast<size_t>(end - p) < item_size) return false;
+            p += item_size;
+            continue;
+         }
+
+         const size_t count_size = getPlyTypeSize( property.CountType );
+         if (static_cast<size_t>(end - p) < count_size) return false;
+         const double count = readPlyValue( p, property.CountType, swap_bytes );
+         p += count_size;
+         if (count < 0.0 || count * static_cast<double>(item_size) > static_cast<double>(end - p)) return false;
+
+         const auto n_items = static_cast<size_t>(count);
+         if (static_cast<int>(i) == face_list && indices != nullptr) {
+            polygon.resize( n_items );
+            for (size_t k = 0; k < n_items; ++k) {
+               polygon[k] = static_cast<long long>(readPlyValue( p + k * item_size, property.Type, swap_bytes ));
+               if (polygon[k] < 0) return false;
+            }
+            addTriangleFan( *indices, polygon );
+         }
+         p += n_items * item_size;
+      }
+      return true;
+   }
+
+   bool readBinaryPly(std::vector<glm::vec3>& vertices, std::vector<long long>& indices, const PlyHeader& header, const uint8_t* data, const uint8_t* end)
+   {
+      const uint8_t* p = data;
+      std::vector<long long> polygon;
+      for (const auto& element : header.Elements) {
+         const bool has_list = std::any_of(
+            element.Properties.begin(), element.Properties.end(), [](const PlyProperty& property) { return property.IsList; }
+         );
+         const auto count = static_cast<int>(element.Count);
+         if (!has_list) {
+            std::vector<size_t> offsets;
+            size_t stride = 0;
+            for (const auto& property : element.Properties) {
+               offsets.emplace_back( stride );
+               stride += getPlyTypeSize( property.Type );
+            }
+            if (stride * element.Count > static_cast<size_t>(end - p)) return false;
+
+            if (element.Name == "vertex") {
+               const int x = element.findProperty( "x" ), y = element.findProperty( "y" ), z = element.findProperty( "z" );
+               if (x < 0 || y < 0 || z < 0) return false;
+               vertices.resize( element.Count );
+               parallelFor(
+                  0, count,
+                  [&](int begin, int last)
+                  {
+                     for (int i = begin; i < last; ++i) {
+                        const uint8_t* row = p + static_cast<size_t>(i) * stride;
+                        vertices[i] = glm::vec3(
+                           readPlyValue( row + offsets[x], element.Properties[x].Type, header.SwapBytes ),
+                           readPlyValue( row + offsets[y], element.Properties[y].Type, header.SwapBytes ),
+                           readPlyValue( row + offsets[z], element.Properties[z].Type, header.SwapBytes )
+                        );
+                     }
+                  }
+               );
+            }
+            p += stride * element.Count;
+            continue;
+         }
+
+         if (element.Name == "vertex") return false;
+
+         const int face_list = element.Name == "face" ? element.findFaceIndexList() : -1;
+         if (face_list >= 0 && element.Properties.size() == 1) {
+            // most files hold only triangles, so the rows are tried with a fixed stride in parallel first
+            const PlyProperty& property = element.Properties[0];
+            const size_t count_size = getPlyTypeSize( property.CountType );
+            const size_t item_size = getPlyTypeSize( property.Type );
+            const size_t stride = count_size + 3 * item_size;
+            if (stride * element.Count <= static_cast<size_t>(end - p)) {
+               const size_t first = indices.size();
+               indices.resize( first + 3 * element.Count );
+               std::atomic<bool> triangles_only(true);
+               parallelFor(
+                  0, count,
+                  [&](int begin, int last)
+                  {
+                     for (int i = begin; i < last && triangles_only; ++i) {
+                        const uint8_t* row = p + static_cast<size_t>(i) * stride;
+                        if (readPlyValue( row, property.CountType, header.SwapBytes ) != 3.0) {
+                           triangles_only = false;
+                           return;
+                        }
+                        for (size_t k = 0; k < 3; ++k) {
+                           indices[first + 3 * static_cast<size_t>(i) + k] = static_cast<long long>(
+                              readPlyValue( row + count_size + k * item_size, property.Type, header.SwapBytes )
+                           );
+                        }
+                     }
+                  }
+               );
+               if (triangles_only) {
+                  p += stride * element.Count;
+                  continue;
+               }
+               indices.resize( first );
+            }
+         }
+
+         for (size_t i = 0; i < element.Count; ++i) {
+            if (!readBinaryPlyRow( p, end, element, face_list, header.SwapBytes, polygon, face_list >= 0 ? &indices : nullptr )) {
+               return false;
+            }
+         }
+      }
+      return true;
+   }
+
+   void parseAsciiPlyVertices(MeshChunk& chunk, const char* begin, const char* end, const PlyElement& element)
+   {
+      const int x = element.findProperty( "x" ), y = element.findProperty( "y" ), z = element.findProperty( "z" );
+      for (const char* line = begin; line < end;) {
+         const char* line_end = getNextLine( line, end );
+         const char* p = line;
+         glm::vec3 vertex(0.0f);
+         for (size_t i = 0; i < element.Properties.size(); ++i) {
+            const auto index = static_cast<int>(i);
+            if (element.Properties[i].IsList) {
+               long long count;
+               if (!parseInteger( count, p, line_end ) || count < 0) {
+                  chunk.Valid = false;
+                  return;
+               }
+               for (long long k = 0; k < count; ++k) p = skipToken( p, line_end );
+            }
+            else if (index == x || index == y || index == z) {
+               if (!parseFloat( vertex[index == x ? 0 : index == y ? 1 : 2], p, line_end )) {
+                  chunk.Valid = false;
+                  return;
+               }
+            }
+            else p = skipToken( p, line_end );
+         }
+         chunk.Vertices.emplace_back( vertex );
+         line = line_end;
+      }
+   }
+
+   void parseAsciiPlyFaces(MeshChunk& chunk, const char* begin, const char* end, const PlyElement& element)
+   {
+      const int face_list = element.findFaceIndexList();
+      std::vector<long long> polygon;
+      for (const char* line = begin; line < end;) {
+         const char* line_end = getNextLine( line, end );
+         const char* p = line;
+         for (size_t i = 0; i < element.Properties.size(); ++i) {
+            if (!element.Properties[i].IsList) {
+               p = skipToken( p, line_end );
+               continue;
+            }
+
+            long long count;
+            if (!parseInteger( count, p, line_end ) || count < 0) {
+               chunk.Valid = false;
+               return;
+            }
+            if (static_cast<int>(i) != face_list) {
+               for (long long k = 0; k < count; ++k) p = skipToken( p, line_end );
+               continue;
+            }
+
+            polygon.resize( static_cast<size_t>(count) );
+            for (auto& index : polygon) {
+               if (!parseInteger( index, p, line_end ) || index < 0) {
+                  chunk.Valid = false;
+                  return;
+               }
+            }
+            addTriangleFan( chunk.Indices, polygon );
+         }
+         line = line_end;
+      }
+   }
+
+   bool readAsciiPly(std::vector<MeshChunk>& vertex_chunks, std::vector<MeshChunk>& face_chunks, const PlyHeader& header, const char* data, const char* end)
+   {
+      const char* p = data;
+      for (const auto& element : header.Elements) {
+         // the rows are lines, so only the line breaks are searched to find where the next element starts
+         const char* section = p;
+         for (size_t i = 0; i < element.Count; ++i) {
+            if (p == end) return false;
+            p = getNextLine( p, end );
+         }
+
+         if (element.Name == "vertex") {
+            if (element.findProperty( "x" ) < 0 || element.findProperty( "y" ) < 0 || element.findProperty( "z" ) < 0) return false;
+            parseLineChunks(
+               vertex_chunks, section, p,
+               [&element](MeshChunk& chunk, const char* begin, const char* last) { parseAsciiPlyVertices( chunk, begin, last, element ); }
+            );
+         }
+         else if (element.Name == "face" && element.findFaceIndexList() >= 0) {
+            parseLineChunks(
+               face_chunks, section, p,
+               [&element](MeshChunk& chunk, const char* begin, const char* last) { parseAsciiPlyFaces( chunk, begin, last, element ); }
+            );
+         }
+      }
+      return true;
+   }
+
+   bool readPly(std::vector<glm::vec3>& vertices, std::vector<uint>& indices, const char* begin, const char* end)
+   {
+      PlyHeader header{};
+      if (!readPlyHeader( header, begin, static_cast<size_t>(end - begin) )) return false;
+
+      std::vector<MeshChunk> chunks;
+      if (header.IsBinary) {
+         chunks.resize( 1 );
+         const auto* data = reinterpret_cast<const uint8_t*>(begin + header.DataOffset);
+         if (!readBinaryPly( chunks[0].Vertices, chunks[0].Indices, header, data, reinterpret_cast<const uint8_t*>(end) )) return false;
+      }
+      else {
+         std::vector<MeshChunk> face_chunks;
+         if (!readAsciiPly( chunks, face_chunks, header, begin + header.DataOffset, end )) return false;
+         chunks.insert( chunks.end(), std::make_move_iterator( face_chunks.begin() ), std::make_move_iterator( face_chunks.end() ) );
+      }
+      return mergeChunks( vertices, indices, chunks );
+   }
+}
+
+bool readMesh(std::vector<glm::vec3>& vertices, std::vector<uint>& indices, const std::string& file_path)
+{
+   MappedFile file;
+   if (!file.open( file_path )) return false;
+
+   vertices.clear();
+   indices.clear();
+   const auto* begin = reinterpret_cast<const char*>(file.data());
+   const char* end = begin + file.size();
+   if (file.size() >= 3 && std::memcmp( begin, "ply", 3 ) == 0) return readPly( vertices, indices, begin, end );
+   return readObj( vertices, indices, begin, end );
+}
\ No newline at end of file
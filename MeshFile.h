@@ -0,0 +1,17 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "_Common.h"
+
+// reads the vertex positions and faces of a Wavefront OBJ or a PLY (ascii or binary) file, where polygons are split
+// into triangle fans and indices holds three vertex indices per triangle.
+// the file is memory-mapped and parsed in line-aligned chunks on all cores, so large site models load at disk speed.
+bool readMesh(std::vector<glm::vec3>& vertices, std::vector<uint>& indices, const std::string& file_path);
\ No newline at end of file
@@ -0,0 +1,256 @@
+#include "MeshOptimizer.h"
+
+namespace
+{
+   constexpr int MaxCacheSize = 32;
+   constexpr int MaxValenceScore = 32;
+   constexpr int SimulatedCacheSize = 16;
+
+   struct ScoreTable
+   {
+      float Cache[MaxCacheSize];
+      float Valence[MaxValenceScore + 1];
+
+      ScoreTable() : Cache{}, Valence{}
+      {
+         // the last triangle gets a fixed score so that the next triangle is not biased towards one of its edges
+         const float cache_decay_power = 1.5f, last_triangle_score = 0.75f;
+         const float valence_boost_scale = 2.0f, valence_boost_power = 0.5f;
+         for (int i = 0; i < MaxCacheSize; ++i) {
+            Cache[i] = i < 3 ?
+               last_triangle_score :
+               std::pow( 1.0f - static_cast<float>(i - 3) / static_cast<float>(MaxCacheSize - 3), cache_decay_power );
+         }
+         for (int i = 1; i <= MaxValenceScore; ++i) {
+            Valence[i] = valence_boost_scale * std::pow( static_cast<float>(i), -valence_boost_power );
+         }
+      }
+
+      float getScore(int cache_position, uint remaining_valence) const
+      {
+         if (remaining_valence == 0) return -1.0f;
+
+         float score = cache_position >= 0 ? Cache[cache_position] : 0.0f;
+         score += remaining_valence <= static_cast<uint>(MaxValenceScore) ?
+            Valence[remaining_valence] : 2.0f / std::sqrt( static_cast<float>(remaining_valence) );
+         return score;
+      }
+   };
+
+   // the timestamps tell the position in a FIFO cache, and a reset only advances the clock
+   class CacheSimulator
+   {
+   public:
+      CacheSimulator(size_t vertex_count, int cache_size) :
+         Timestamps(vertex_count, 0), CacheSize( static_cast<uint>(cache_size) ), Time( CacheSize + 1 ) {}
+
+      void reset() { Time += CacheSize + 1; }
+      int getMisses(const uint* triangle)
+      {
+         int misses = 0;
+         for (int k = 0; k < 3; ++k) {
+            if (Time - Timestamps[triangle[k]] > CacheSize) {
+               Timestamps[triangle[k]] = Time++;
+               misses++;
+            }
+         }
+         return misses;
+      }
+
+   private:
+      std::vector<uint> Timestamps;
+      uint CacheSize;
+      uint Time;
+   };
+}
+
+void optimizeVertexCache(std::vector<uint>& indices, size_t vertex_count)
+{
+   const size_t triangle_count = indices.size() / 3;
+   if (triangle_count == 0) return;
+
+   static const ScoreTable scores;
+   std::vector<uint> valences(vertex_count, 0);
+   for (const auto& index : indices) valences[index]++;
+   std::vector<size_t> offsets(vertex_count + 1, 0);
+   for (size_t v = 0; v < vertex_count; ++v) offsets[v + 1] = offsets[v] + valences[v];
+   std::vector<uint> adjacent_triangles(indices.size());
+   {
+      std::vector<size_t> filled(offsets.begin(), offsets.end() - 1);
+      for (size_t i = 0; i < indices.size(); ++i) adjacent_triangles[filled[indices[i]]++] = static_cast<uint>(i / 3);
+   }
+
+   std::vector<float> vertex_scores(vertex_count);
+   for (size_t v = 0; v < vertex_count; ++v) vertex_scores[v] = scores.getScore( -1, valences[v] );
+   std::vector<float> triangle_scores(triangle_count);
+   std::vector<uint8_t> emitted(triangle_count, 0);
+   size_t best = 0;
+   for (size_t t = 0; t < triangle_count; ++t) {
+      const uint* triangle = &indices[t * 3];
+      triangle_scores[t] = vertex_scores[triangle[0]] + vertex_scores[triangle[1]] + vertex_scores[triangle[2]];
+      if (triangle_scores[t] > triangle_scores[best]) best = t;
+   }
+
+   std::vector<uint> ordered;
+   ordered.reserve( indices.size() );
+   uint cache[MaxCacheSize + 3];
+   int cache_size = 0;
+   size_t next_unemitted = 0;
+   while (best < triangle_count) {
+      const uint triangle[3] = { indices[best * 3], indices[best * 3 + 1], indices[best * 3 + 2] };
+      ordered.insert( ordered.end(), triangle, triangle + 3 );
+      emitted[best] = 1;
+      for (const auto& v : triangle) {
+         uint* begin = adjacent_triangles.data() + offsets[v];
+         uint* end = begin + valences[v];
+         uint* found = std::find( begin, end, static_cast<uint>(best) );
+         if (found != end) {
+            std::swap( *found, *(end - 1) );
+            valences[v]--;
+         }
+      }
+
+      // the vertices of the emitted triangle move to the front, and the ones pushed past the cache size fall out
+      uint next_cache[MaxCacheSize + 3];
+      int next_size = 0;
+      for (const auto& v : triangle) {
+         if (std::find( next_cache, next_cache + next_size, v ) == next_cache + next_size) next_cache[next_size++] = v;
+      }
+      for (int i = 0; i < cache_size; ++i) {
+         if (std::find( triangle, triangle + 3, cache[i] ) == triangle + 3) next_cache[next_size++] = cache[i];
+      }
+      for (int i = 0; i < next_size; ++i) {
+         const uint v = next_cache[i];
+         const float score = scores.getScore( i < MaxCacheSize ? i : -1, valences[v] );
+         const float delta = score - vertex_scores[v];
+         vertex_scores[v] = score;
+         for (size_t k = offsets[v]; k < offsets[v] + valences[v]; ++k) triangle_scores[adjacent_triangles[k]] += delta;
+      }
+      cache_size = std::min( next_size, MaxCacheSize );
+      for (int i = 0; i < cache_size; ++i) cache[i] = next_cache[i];
+
+      // only the triangles around the cached vertices changed their scores, so the next one is searched among them
+      best = triangle_count;
+      float best_score = -1.0f;
+      for (int i = 0; i < cache_size; ++i) {
+         const uint v = cache[i];
+         for (size_t k = offsets[v]; k < offsets[v] + valences[v]; ++k) {
+            const uint t = adjacent_triangles[k];
+            if (triangle_scores[t] > best_score) {
+               best_score = triangle_scores[t];
+               best = t;
+            }
+         }
+      }
+      if (best == triangle_count) {
+         while (next_unemitted < triangle_count && emitted[next_unemitted]) ++next_unemitted;
+         best = next_unemitted;
+      }
+   }
+   indices.swap( ordered );
+}
+
+void optimizeOverdraw(std::vector<uint>& indices, const std::vector<glm::vec3>& vertices, float threshold)
+{
+   const size_t triangle_count = indices.size() / 3;
+   if (triangle_count == 0) return;
+
+   // a triangle missing all its vertices starts a cluster, as the cache order already broke there
+   CacheSimulator cache(vertices.size(), SimulatedCacheSize);
+   std::vector<size_t> hard_boundaries;
+   for (size_t t = 0; t < triangle_count; ++t) {
+      if (cache.getMisses( &indices[t * 3] ) == 3 || t == 0) hard_boundaries.emplace_back( t );
+   }
+   hard_boundaries.emplace_back( triangle_count );
+
+   // the clusters are split further wherever the miss ratio from the cluster start stays close to the whole cluster
+   std::vector<size_t> boundaries;
+   for (size_t c = 0; c + 1 < hard_boundaries.size(); ++c) {
+      const size_t begin = hard_boundaries[c], end = hard_boundaries[c + 1];
+      cache.reset();
+      int cluster_misses = 0;
+      for (size_t t = begin; t < end; ++t) cluster_misses += cache.getMisses( &indices[t * 3] );
+      const float cluster_threshold = threshold * static_cast<float>(cluster_misses) / static_cast<float>(end - begin);
+
+      cache.reset();
+      size_t start = begin;
+      int misses = 0;
+      boundaries.emplace_back( begin );
+      for (size_t t = begin; t < end; ++t) {
+         misses += cache.getMisses( &indices[t * 3] );
+         if (t + 1 < end && static_cast<float>(misses) / static_cast<float>(t - start + 1) <= cluster_threshold) {
+            boundaries.emplace_back( t + 1 );
+            start = t + 1;
+            misses = 0;
+            cache.reset();
+         }
+      }
+   }
+   boundaries.emplace_back( triangle_count );
+
+   glm::vec3 mesh_center(0.0f);
+   for (const auto& vertex : vertices) mesh_center += vertex;
+   mesh_center /= static_cast<float>(std::max( vertices.size(), static_cast<size_t>(1) ));
+
+   const size_t cluster_count = boundaries.size() - 1;
+   std::vector<float> sort_keys(cluster_count);
+   for (size_t c = 0; c < cluster_count; ++c) {
+      glm::vec3 center(0.0f), normal(0.0f);
+      float area = 0.0f;
+      for (size_t t = boundaries[c]; t < boundaries[c + 1]; ++t) {
+         const glm::vec3& p0 = vertices[indices[t * 3]];
+         const glm::vec3& p1 = vertices[indices[t * 3 + 1]];
+         const glm::vec3& p2 = vertices[indices[t * 3 + 2]];
+         const glm::vec3 n = cross( p1 - p0, p2 - p0 );
+         const float triangle_area = length( n );
+         center += (p0 + p1 + p2) * (triangle_area / 3.0f);
+         normal += n;
+         area += triangle_area;
+      }
+      const float normal_length = length( normal );
+      sort_keys[c] = area > 0.0f && normal_length > 0.0f ?
+         dot( center / area - mesh_center, normal / normal_length ) : 0.0f;
+   }
+
+   std::vector<size_t> order(cluster_count);
+   for (size_t c = 0; c < cluster_count; ++c) order[c] = c;
+   std::stable_sort( order.begin(), order.end(), [&sort_keys](size_t a, size_t b) { return sort_keys[a] > sort_keys[b]; } );
+
+   std::vector<uint> sorted;
+   sorted.reserve( indices.size() );
+   for (const auto& c : order) {
+      sorted.insert( sorted.end(), indices.begin() + boundaries[c] * 3, indices.begin() + boundaries[c + 1] * 3 );
+   }
+   indices.swap( sorted );
+}
+
+void optimizeVertexFetch(std::vector<glm::vec3>& vertices, std::vector<glm::vec2>& textures, std::vector<uint>& indices)
+{
+   constexpr uint unused = std::numeric_limits<uint>::max();
+   std::vector<uint> remap(vertices.size(), unused);
+   std::vector<glm::vec3> ordered_vertices;
+   std::vector<glm::vec2> ordered_textures;
+   ordered_vertices.reserve( vertices.size() );
+   if (!textures.empty()) ordered_textures.reserve( textures.size() );
+   for (auto& index : indices) {
+      if (remap[index] == unused) {
+         remap[index] = static_cast<uint>(ordered_vertices.size());
+         ordered_vertices.emplace_back( vertices[index] );
+         if (!textures.empty()) ordered_textures.emplace_back( textures[index] );
+      }
+      index = remap[index];
+   }
+   vertices.swap( ordered_vertices );
+   if (!textures.empty()) textures.swap( ordered_textures );
+}
+
+float getAverageCacheMissRatio(const std::vector<uint>& indices, size_t vertex_count, int cache_size)
+{
+   const size_t triangle_count = indices.size() / 3;
+   if (triangle_count == 0) return 0.0f;
+
+   CacheSimulator cache(vertex_count, cache_size);
+   size_t misses = 0;
+   for (size_t t = 0; t < triangle_count; ++t) misses += cache.getMisses( &indices[t * 3] );
+   return static_cast<float>(misses) / static_cast<float>(triangle_count);
+}
\ No newline at end of file
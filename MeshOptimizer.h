@@ -0,0 +1,25 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "_Common.h"
+
+// reorders the triangles of an indexed triangle list so that consecutive triangles share the vertices in the
+// post-transform cache, with the scoring of Forsyth's linear-speed vertex cache optimization
+void optimizeVertexCache(std::vector<uint>& indices, size_t vertex_count);
+// groups the cache-ordered triangles into clusters and draws the clusters facing outwards first, so that the nearer
+// surfaces of a closed mesh fill the depth before the hidden ones. threshold bounds how much the average cache miss
+// ratio of a cluster may grow by the split, where 1.05 allows 5% more misses.
+void optimizeOverdraw(std::vector<uint>& indices, const std::vector<glm::vec3>& vertices, float threshold);
+// renumbers the vertices in the order the triangles first use them and drops the unused ones,
+// where the textures, if not empty, are reordered along with the vertices
+void optimizeVertexFetch(std::vector<glm::vec3>& vertices, std::vector<glm::vec2>& textures, std::vector<uint>& indices);
+// vertex shader invocations per triangle on a FIFO post-transform cache
+float getAverageCacheMissRatio(const std::vector<uint>& indices, size_t vertex_count, int cache_size);
\ No newline at end of file
@@ -0,0 +1,300 @@
+#include "ObstacleBVH.h"
+
+namespace
+{
+   float getHalfArea(const glm::vec3& min_point, const glm::vec3& max_point)
+   {
+      const glm::vec3 extent = max_point - min_point;
+      return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+   }
+}
+
+ObstacleBVH::ObstacleBVH() = default;
+
+void ObstacleBVH::build(const std::vector<glm::vec3>& vertices, const std::vector<uint>& indices)
+{
+   Nodes.clear();
+   Triangles.clear();
+   const auto n = static_cast<int>(indices.size() / 3);
+   if (n == 0) return;
+
+   BuildContext context;
+   context.BoundsMin.resize( n );
+   context.BoundsMax.resize( n );
+   context.Centroids.resize( n );
+   context.Order.resize( n );
+   parallelFor(
+      0, n,
+      [&](int begin, int end)
+      {
+         for (int i = begin; i < end; ++i) {
+            const glm::vec3& a = vertices[indices[3 * i]];
+            const glm::vec3& b = vertices[indices[3 * i + 1]];
+            const glm::vec3& c = vertices[indices[3 * i + 2]];
+            context.BoundsMin[i] = glm::min( glm::min( a, b ), c );
+            context.BoundsMax[i] = glm::max( glm::max( a, b ), c );
+            context.Centroids[i] = (context.BoundsMin[i] + context.BoundsMax[i]) * 0.5f;
+            context.Order[i] = i;
+         }
+      }
+   );
+
+   // a binary tree over n leaves has at most 2n - 1 nodes, so the nodes never move while subtrees are built in parallel
+   Nodes.resize( 2 * static_cast<size_t>(n) - 1 );
+   context.NodeCount = 1;
+   context.ParallelDepth = 0;
+   while ((1u << context.ParallelDepth) < std::thread::hardware_concurrency()) context.ParallelDepth++;
+   buildNode( context, 0, 0, n, 0 );
+   Nodes.resize( context.NodeCount );
+
+   Triangles.resize( n );
+   parallelFor(
+      0, n,
+      [&](int begin, int end)
+      {
+         for (int i = begin; i < end; ++i) {
+            const int triangle = context.Order[i];
+            const glm::vec3& a = vertices[indices[3 * triangle]];
+            Triangles[i].Vertex0 = a;
+            Triangles[i].Edge1 = vertices[indices[3 * triangle + 1]] - a;
+            Triangles[i].Edge2 = vertices[indices[3 * triangle + 2]] - a;
+         }
+      }
+   );
+}
+
+void ObstacleBVH::buildNode(BuildContext& context, int node_index, int begin, int end, int depth)
+{
+   constexpr float infinity = std::numeric_limits<float>::infinity();
+   Node& node = Nodes[node_index];
+   node.Min = glm::vec3(infinity);
+   node.Max = glm::vec3(-infinity);
+   glm::vec3 centroid_min(infinity), centroid_max(-infinity);
+   for (int i = begin; i < end; ++i) {
+      const int triangle = context.Order[i];
+      node.Min = glm::min( node.Min, context.BoundsMin[triangle] );
+      node.Max = glm::max( node.Max, context.BoundsMax[triangle] );
+      centroid_min = glm::min( centroid_min, context.Centroids[triangle] );
+      centroid_max = glm::max( centroid_max, context.Centroids[triangle] );
+   }
+   node.Start = begin;
+   node.Count = end - begin;
+   if (node.Count <= MaxLeafSize || depth >= MaxDepth) return;
+
+   // the centroids are binned along their longest axis, and the bin boundary of the least surface area cost splits the node
+   const glm::vec3 centroid_extent = centroid_max - centroid_min;
+   const int axis = centroid_extent.x >= centroid_extent.y ?
+      (centroid_extent.x >= centroid_extent.z ? 0 : 2) : (centroid_extent.y >= centroid_extent.z ? 1 : 2);
+   if (centroid_extent[axis] <= 0.0f) return;
+
+   const float scale = static_cast<float>(BinCount) / centroid_extent[axis];
+   int counts[BinCount] = { 0, };
+   glm::vec3 bin_min[BinCount], bin_max[BinCount];
+   std::fill( bin_min, bin_min + BinCount, glm::vec3(infinity) );
+   std::fill( bin_max, bin_max + BinCount, glm::vec3(-infinity) );
+   for (int i = begin; i < end; ++i) {
+      const int triangle = context.Order[i];
+      const int bin = std::min( static_cast<int>((context.Centroids[triangle][axis] - centroid_min[axis]) * scale), BinCount - 1 );
+      counts[bin]++;
+      bin_min[bin] = glm::min( bin_min[bin], context.BoundsMin[triangle] );
+      bin_max[bin] = glm::max( bin_max[bin], context.BoundsMax[triangle] );
+   }
+
+   int right_counts[BinCount];
+   float right_areas[BinCount];
+   glm::vec3 right_min(infinity), right_max(-infinity);
+   int right_count = 0;
+   for (int b = BinCount - 1; b > 0; --b) {
+      right_min = glm::min( right_min, bin_min[b] );
+      right_max = glm::max( right_max, bin_max[b] );
+      right_count += counts[b];
+      right_counts[b] = right_count;
+      right_areas[b] = right_count > 0 ? getHalfArea( right_min, right_max ) : 0.0f;
+   }
+   glm::vec3 left_min(infinity), left_max(-infinity);
+   int left_count = 0, best_split = 0;
+   float best_cost = infinity;
+   for (int b = 0; b < BinCount - 1; ++b) {
+      left_min = glm::min( left_min, bin_min[b] );
+      left_max = glm::max( left_max, bin_max[b] );
+      left_count += counts[b];
+      if (left_count == 0 || right_counts[b + 1] == 0) continue;
+
+      const float cost = static_cast<float>(left_count) * getHalfArea( left_min, left_max ) +
+         static_cast<float>(right_counts[b + 1]) * right_areas[b + 1];
+      if (cost < best_cost) {
+         best_cost = cost;
+         best_split = b + 1;
+      }
+   }
+   // splitting costs a box test per child on top of the triangle tests, so small nodes stay leaves if it does not pay
+   if (best_split == 0) return;
+   if (best_cost >= getHalfArea( node.Min, node.Max ) * static_cast<float>(node.Count - 1) && node.Count <= 8 * MaxLeafSize) return;
+
+   const auto middle = static_cast<int>(std::distance(
+      context.Order.begin(),
+      std::partition(
+         context.Order.begin() + begin, context.Order.begin() + end,
+         [&](int triangle)
+         {
+            const int bin = std::min(
+               static_cast<int>((context.Centroids[triangle][axis] - centroid_min[axis]) * scale), BinCount - 1
+            );
+            return bin < best_split;
+         }
+      )
+   ));
+
+   const int left = context.NodeCount.fetch_add( 2 );
+   node.Start = left;
+   node.Count = 0;
+   if (depth < context.ParallelDepth && end - begin >= ParallelBuildSize) {
+      std::thread worker( &ObstacleBVH::buildNode, this, std::ref( context ), left, begin, middle, depth + 1 );
+      buildNode( context, left + 1, middle, end, depth + 1 );
+      worker.join();
+   }
+   else {
+      buildNode( context, left, begin, middle, depth + 1 );
+      buildNode( context, left + 1, middle, end, depth + 1 );
+   }
+}
+
+float ObstacleBVH::getBoxDistance(const Node& node, const glm::vec3& origin, const glm::vec3& inverse_direction, float t_max)
+{
+   const glm::vec3 t0 = (node.Min - origin) * inverse_direction;
+   const glm::vec3 t1 = (node.Max - origin) * inverse_direction;
+   const glm::vec3 t_near = glm::min( t0, t1 );
+   const glm::vec3 t_far = glm::max( t0, t1 );
+   const float enter = std::max( std::max( t_near.x, t_near.y ), std::max( t_near.z, 0.0f ) );
+   const float leave = std::min( std::min( t_far.x, t_far.y ), std::min( t_far.z, t_max ) );
+   return enter <= leave ? enter : std::numeric_limits<float>::infinity();
+}
+
+float ObstacleBVH::getTriangleDistance(const Triangle& triangle, const glm::vec3& origin, const glm::vec3& direction)
+{
+   constexpr float infinity = std::numeric_limits<float>::infinity();
+   const glm::vec3 p = cross( direction, triangle.Edge2 );
+   const float determinant = dot( triangle.Edge1, p );
+   if (determinant == 0.0f) return infinity;
+
+   const float inverse_determinant = 1.0f / determinant;
+   const glm::vec3 s = origin - triangle.Vertex0;
+   const float u = dot( s, p ) * inverse_determinant;
+   if (u < 0.0f || u > 1.0f) return infinity;
+
+   const glm::vec3 q = cross( s, triangle.Edge1 );
+   const float v = dot( direction, q ) * inverse_determinant;
+   if (v < 0.0f || u + v > 1.0f) return infinity;
+
+   const float t = dot( triangle.Edge2, q ) * inverse_determinant;
+   return t > 0.0f ? t : infinity;
+}
+
+template<bool any_hit>
+float ObstacleBVH::traverse(const glm::vec3& origin, const glm::vec3& direction, float t_max) const
+{
+   constexpr float infinity = std::numeric_limits<float>::infinity();
+   if (Nodes.empty()) return infinity;
+
+   struct Entry
+   {
+      int Index;
+      float Distance;
+   };
+   Entry stack[MaxDepth + 2];
+   int top = 0;
+   const glm::vec3 inverse_direction = 1.0f / direction;
+   float closest = t_max;
+   const float root_distance = getBoxDistance( Nodes[0], origin, inverse_direction, closest );
+   if (root_distance < infinity) stack[top++] = { 0, root_distance };
+   while (top > 0) {
+      const Entry entry = stack[--top];
+      if (entry.Distance >= closest) continue;
+
+      const Node& node = Nodes[entry.Index];
+      if (node.Count > 0) {
+         for (int i = node.Start; i < node.Start + node.Count; ++i) {
+            const float t = getTriangleDistance( Triangles[i], origin, direction );
+            if (t < closest) {
+               closest = t;
+               if (any_hit) return closest;
+            }
+         }
+         continue;
+      }
+
+      // the nearer child goes on top of the stack, so it is visited first
+      const float left = getBoxDistance( Nodes[node.Start], origin, inverse_direction, closest );
+      const float right = getBoxDistance( Nodes[node.Start + 1], origin, inverse_direction, closest );
+      const Entry near_child = left <= right ? Entry{ node.Start, left } : Entry{ node.Start + 1, right };
+      const Entry far_child = left <= right ? Entry{ node.Start + 1, right } : Entry{ node.Start, left };
+      if (far_child.Distance < infinity) stack[top++] = far_child;
+      if (near_child.Distance < infinity) stack[top++] = near_child;
+   }
+   return closest < t_max ? closest : infinity;
+}
+
+float ObstacleBVH::castRay(const glm::vec3& origin, const glm::vec3& direction, float t_max) const
+{
+   return traverse<false>( origin, direction, t_max );
+}
+
+bool ObstacleBVH::isOccluded(const glm::vec3& origin, const glm::vec3& direction, float t_max) const
+{
+   return traverse<true>( origin, direction, t_max ) < t_max;
+}
+
+void ObstacleBVH::removeOccludedPixels(uint8_t* mask, const PinholeCamera& camera, const TerrainHeightMap& terrain) const
+{
+   if (empty()) return;
+
+   const glm::mat3 rotation(camera.ToWorldCoordinate);
+   const glm::vec3 origin(camera.ToWorldCoordinate[3]);
+   const float half_width = static_cast<float>(camera.Width) * 0.5f;
+   const float half_height = static_cast<float>(camera.Height) * 0.5f;
+   parallelFor(
+      0, camera.Height,
+      [&](int begin, int end)
+      {
+         for (int y = begin; y < end; ++y) {
+            uint8_t* row = mask + static_cast<size_t>(y) * camera.Width;
+            const float v = static_cast<float>(y) + 0.5f - half_height;
+            for (int x = 0; x < camera.Width; ++x) {
+               if (row[x] == 0) continue;
+
+               const glm::vec3 direction = rotation * glm::vec3(static_cast<float>(x) + 0.5f - half_width, v, camera.FocalLength);
+               const float ground_distance = terrain.castRay( origin, direction );
+               // the ground point itself must not count as an obstacle lying on the ground
+               if (std::isfinite( ground_distance ) && isOccluded( origin, direction, ground_distance * (1.0f - 1e-5f) )) row[x] = 0;
+            }
+         }
+      }
+   );
+}
+
+void ObstacleBVH::getObstacleDistances(std::vector<float>& distances, const uint8_t* mask, const PinholeCamera& camera) const
+{
+   distances.assign( static_cast<size_t>(camera.Width) * camera.Height, std::numeric_limits<float>::infinity() );
+   if (empty()) return;
+
+   const glm::mat3 rotation(camera.ToWorldCoordinate);
+   const glm::vec3 origin(camera.ToWorldCoordinate[3]);
+   const float half_width = static_cast<float>(camera.Width) * 0.5f;
+   const float half_height = static_cast<float>(camera.Height) * 0.5f;
+   parallelFor(
+      0, camera.Height,
+      [&](int begin, int end)
+      {
+         for (int y = begin; y < end; ++y) {
+            const size_t offset = static_cast<size_t>(y) * camera.Width;
+            const float v = static_cast<float>(y) + 0.5f - half_height;
+            for (int x = 0; x < camera.Width; ++x) {
+               if (mask[offset + x] == 0) continue;
+
+               const glm::vec3 direction = rotation * glm::vec3(static_cast<float>(x) + 0.5f - half_width, v, camera.FocalLength);
+               distances[offset + x] = castRay( origin, direction );
+            }
+         }
+      }
+   );
+}
\ No newline at end of file
@@ -0,0 +1,81 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "TerrainHeightMap.h"
+
+#include <atomic>
+
+// a bounding volume hierarchy over static obstacle triangles in world coordinates.
+// it is built with binned SAH, and large subtrees are built on their own threads, so rebuilding on scene changes is cheap.
+class ObstacleBVH
+{
+public:
+	ObstacleBVH();
+
+	bool empty() const { return Triangles.empty(); }
+	// indices holds three vertex indices per triangle
+	void build(const std::vector<glm::vec3>& vertices, const std::vector<uint>& indices);
+	int getTriangleCount() const { return static_cast<int>(Triangles.size()); }
+	int getNodeCount() const { return static_cast<int>(Nodes.size()); }
+	// the ray parameter of the closest hit in units of the direction, or infinity if nothing is hit before t_max
+	float castRay(
+		const glm::vec3& origin,
+		const glm::vec3& direction,
+		float t_max = std::numeric_limits<float>::infinity()
+	) const;
+	// stops at the first hit before t_max, which is all an occlusion test needs
+	bool isOccluded(const glm::vec3& origin, const glm::vec3& direction, float t_max) const;
+	// clears the pixels of the top-down mask whose ground point, on the terrain or the flat ground, hides behind an obstacle
+	void removeOccludedPixels(uint8_t* mask, const PinholeCamera& camera, const TerrainHeightMap& terrain) const;
+	// the top-down ray parameter of the first obstacle of each pixel where the mask is not 0, in units of the pixel ray
+	// turned to the world, and infinity elsewhere or where nothing is hit
+	void getObstacleDistances(std::vector<float>& distances, const uint8_t* mask, const PinholeCamera& camera) const;
+
+private:
+	static constexpr int BinCount = 16;
+	static constexpr int MaxLeafSize = 4;
+	static constexpr int MaxDepth = 64;
+	static constexpr int ParallelBuildSize = 1 << 16;
+
+	struct Node
+	{
+		glm::vec3 Min;
+		int Start; // the first triangle of a leaf, or the left child of an inner node whose right child follows it
+		glm::vec3 Max;
+		int Count; // 0 for inner nodes
+	};
+
+	struct Triangle
+	{
+		glm::vec3 Vertex0;
+		glm::vec3 Edge1;
+		glm::vec3 Edge2;
+	};
+
+	struct BuildContext
+	{
+		std::vector<glm::vec3> BoundsMin;
+		std::vector<glm::vec3> BoundsMax;
+		std::vector<glm::vec3> Centroids;
+		std::vector<int> Order;
+		std::atomic<int> NodeCount;
+		int ParallelDepth; // subtrees get threads of their own only above this depth, so there are about as many as cores
+	};
+
+	std::vector<Node> Nodes;
+	std::vector<Triangle> Triangles;
+
+	void buildNode(BuildContext& context, int node_index, int begin, int end, int depth);
+	static float getBoxDistance(const Node& node, const glm::vec3& origin, const glm::vec3& inverse_direction, float t_max);
+	static float getTriangleDistance(const Triangle& triangle, const glm::vec3& origin, const glm::vec3& direction);
+	template<bool any_hit>
+	float traverse(const glm::vec3& origin, const glm::vec3& direction, float t_max) const;
+};
\ No newline at end of file
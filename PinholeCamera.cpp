@@ -0,0 +1,68 @@
+#include "PinholeCamera.h"
+
+PinholeCamera::PinholeCamera(
+   int width,
+   int height,
+   float focal_length,
+   float pan_angle_in_degree,
+   float tilt_angle_in_degree,
+   float camera_height_in_meter
+) :
+   Width( width ), Height( height ), FocalLength( focal_length ), TiltAngle( glm::radians( tilt_angle_in_degree ) ),
+   CameraHeight( camera_height_in_meter )
+{
+   const glm::mat4 panning_to_camera = glm::rotate( glm::mat4(1.0f), glm::radians( pan_angle_in_degree ), glm::vec3(0.0f, -1.0f, 0.0f) );
+   const glm::mat4 tilting_to_camera = glm::rotate( glm::mat4(1.0f), TiltAngle, glm::vec3(1.0f, 0.0f, 0.0f) );
+   ToWorldCoordinate = inverse( panning_to_camera ) * inverse( tilting_to_camera );
+}
+
+bool PinholeCamera::getWorldPoint(glm::vec3& world_point, const glm::vec2& image_point, float height_from_ground) const
+{
+   const auto half_width = static_cast<float>(Width) * 0.5f;
+   const auto half_height = static_cast<float>(Height) * 0.5f;
+   const float sin_tilt = sinf( TiltAngle );
+   const float cos_tilt = cosf( TiltAngle );
+   const float f_mul_sin_tilt = FocalLength * sin_tilt;
+
+   glm::vec3 ground_point;
+   ground_point.z = f_mul_sin_tilt + (image_point.y - half_height) * cos_tilt;
+
+   if (ground_point.z <= 0.0 || CameraHeight < height_from_ground) return false;
+
+   ground_point.z = (CameraHeight - height_from_ground) / ground_point.z;
+   ground_point.x = (image_point.x - half_width) * ground_point.z;
+   ground_point.y = (image_point.y - half_height) * ground_point.z;
+   ground_point.z = FocalLength * ground_point.z;
+
+   world_point = glm::vec3(ToWorldCoordinate * glm::vec4(ground_point, 1.0f));
+   return true;
+}
+
+bool PinholeCamera::getImagePoint(glm::vec2& image_point, const glm::vec3& world_point) const
+{
+   const glm::vec3 camera_point = glm::vec3(inverse( ToWorldCoordinate ) * glm::vec4(world_point, 1.0f));
+   if (camera_point.z <= 0.0f) return false;
+
+   image_point.x = FocalLength * camera_point.x / camera_point.z + static_cast<float>(Width) * 0.5f;
+   image_point.y = FocalLength * camera_point.y / camera_point.z + static_cast<float>(Height) * 0.5f;
+   return true;
+}
+
+float PinholeCamera::getHorizonRow() const
+{
+   return static_cast<float>(Height) * 0.5f - FocalLength * tanf( TiltAngle );
+}
+
+glm::dmat3 PinholeCamera::getImageToGroundHomography() const
+{
+   // (u, v, 1) -> camera ray (u - cx, v - cy, f) -> world ray r, which meets the ground at r * CameraHeight / r.y
+   glm::dmat3 to_ray(1.0);
+   to_ray[2] = glm::dvec3(-0.5 * Width, -0.5 * Height, static_cast<double>(FocalLength));
+
+   const glm::dmat3 rotation = glm::dmat3(glm::mat3(ToWorldCoordinate));
+   glm::dmat3 to_ground(0.0);
+   to_ground[0][0] = CameraHeight; // x
+   to_ground[2][1] = CameraHeight; // z
+   to_ground[1][2] = 1.0; // w from y
+   return to_ground * rotation * to_ray;
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "_Common.h"
+
+// the camera model of VirtualFenceMakerGL without any GL state, where the camera sits at the world origin,
+// the world y axis points down and the ground is the plane y = CameraHeight
+struct PinholeCamera
+{
+	int Width;
+	int Height;
+	float FocalLength;
+	float TiltAngle;
+	float CameraHeight;
+	glm::mat4 ToWorldCoordinate;
+
+	PinholeCamera() : Width( 0 ), Height( 0 ), FocalLength( 0.0f ), TiltAngle( 0.0f ), CameraHeight( 0.0f ), ToWorldCoordinate{} {}
+	PinholeCamera(
+		int width,
+		int height,
+		float focal_length,
+		float pan_angle_in_degree,
+		float tilt_angle_in_degree,
+		float camera_height_in_meter
+	);
+
+	// image_point is in window coordinates, which is top-down with pixel centers at half-integers
+	bool getWorldPoint(glm::vec3& world_point, const glm::vec2& image_point, float height_from_ground) const;
+	bool getImagePoint(glm::vec2& image_point, const glm::vec3& world_point) const;
+	// rows below the horizon see the ground
+	float getHorizonRow() const;
+	// maps (u, v, 1) to the homogeneous ground point (x, z, w), where w > 0 only below the horizon
+	glm::dmat3 getImageToGroundHomography() const;
+};
\ No newline at end of file
@@ -0,0 +1,27 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "_Common.h"
+
+// planar frames start with the full resolution luma plane followed by 2x2 subsampled chroma
+enum class RawVideoFormat { GREY, I420, NV12 };
+
+inline size_t getRawFrameSize(int width, int height, RawVideoFormat format)
+{
+   const size_t luma_size = static_cast<size_t>(width) * height;
+   switch (format) {
+      case RawVideoFormat::I420:
+      case RawVideoFormat::NV12:
+         return luma_size + 2 * (static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2));
+      default:
+         return luma_size;
+   }
+}
\ No newline at end of file
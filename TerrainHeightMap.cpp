@@ -0,0 +1,544 @@
+#include "TerrainHeightMap.h"
+#include "FenceMaskFile.h"
+
+TerrainHeightMap::TerrainHeightMap() :
+   Columns( 0 ), Rows( 0 ), CellsX( 0 ), CellsZ( 0 ), TopLevel( 0 ), GroundLevel( 0.0f ), MinElevation( 0.0f ),
+   MaxElevation( 0.0f ), Extent( 0.0f ), CellSize( 0.0f )
+{
+}
+
+void TerrainHeightMap::setElevations(const float* elevations, int columns, int rows, const glm::vec2& extent_in_meter)
+{
+   Elevations.clear();
+   if (columns < 2 || rows < 2 || extent_in_meter.x <= 0.0f || extent_in_meter.y <= 0.0f) return;
+
+   Columns = columns;
+   Rows = rows;
+   CellsX = columns - 1;
+   CellsZ = rows - 1;
+   Extent = extent_in_meter;
+   CellSize = glm::vec2(Extent.x / static_cast<float>(CellsX), Extent.y / static_cast<float>(CellsZ));
+   Elevations.assign( elevations, elevations + static_cast<size_t>(columns) * rows );
+   buildMinMaxLevels();
+}
+
+bool TerrainHeightMap::load(const std::string& file_path, const glm::vec2& extent_in_meter)
+{
+   int columns, rows;
+   std::vector<float> elevations;
+   if (!readFloatMap( elevations, columns, rows, file_path )) return false;
+
+   setElevations( elevations.data(), columns, rows, extent_in_meter );
+   return !empty();
+}
+
+void TerrainHeightMap::buildMinMaxLevels()
+{
+   std::vector<int> level_heights;
+   LevelOffsets.assign( 1, 0 );
+   LevelWidths.assign( 1, CellsX );
+   level_heights.emplace_back( CellsZ );
+   int size = CellsX * CellsZ;
+   while (LevelWidths.back() > 1 || level_heights.back() > 1) {
+      LevelOffsets.emplace_back( size );
+      LevelWidths.emplace_back( (LevelWidths.back() + 1) / 2 );
+      level_heights.emplace_back( (level_heights.back() + 1) / 2 );
+      size += LevelWidths.back() * level_heights.back();
+   }
+   TopLevel = static_cast<int>(LevelOffsets.size()) - 1;
+   MinLevels.resize( size );
+   MaxLevels.resize( size );
+
+   parallelFor(
+      0, CellsZ,
+      [this](int begin, int end)
+      {
+         for (int z = begin; z < end; ++z) {
+            const float* upper = Elevations.data() + static_cast<size_t>(z) * Columns;
+            const float* lower = upper + Columns;
+            float* min_row = MinLevels.data() + static_cast<size_t>(z) * CellsX;
+            float* max_row = MaxLevels.data() + static_cast<size_t>(z) * CellsX;
+            for (int x = 0; x < CellsX; ++x) {
+               min_row[x] = std::min( std::min( upper[x], upper[x + 1] ), std::min( lower[x], lower[x + 1] ) );
+               max_row[x] = std::max( std::max( upper[x], upper[x + 1] ), std::max( lower[x], lower[x + 1] ) );
+            }
+         }
+      }
+   );
+
+   for (int level = 1; level <= TopLevel; ++level) {
+      const int child_width = LevelWidths[level - 1];
+      const int child_height = level_heights[level - 1];
+      const float* child_min = MinLevels.data() + LevelOffsets[level - 1];
+      const float* child_max = MaxLevels.data() + LevelOffsets[level - 1];
+      float* node_min = MinLevels.data() + LevelOffsets[level];
+      float* node_max = MaxLevels.data() + LevelOffsets[level];
+      for (int z = 0; z < level_heights[level]; ++z) {
+         const int z0 = 2 * z * child_width;
+         const int z1 = std::min( 2 * z + 1, child_height - 1 ) * child_width;
+         for (int x = 0; x < LevelWidths[level]; ++x) {
+            const int x0 = 2 * x;
+            const int x1 = std::min( 2 * x + 1, child_width - 1 );
+            const int node = z * LevelWidths[level] + x;
+            node_min[node] = std::min(
+               std::min( child_min[z0 + x0], child_min[z0 + x1] ),
+               std::min( child_min[z1 + x0], child_min[z1 + x1] )
+            );
+            node_max[node] = std::max(
+               std::max( child_max[z0 + x0], child_max[z0 + x1] ),
+               std::max( child_max[z1 + x0], child_max[z1 + x1] )
+            );
+         }
+      }
+   }
+   MinElevation = MinLevels.back();
+   MaxElevation = MaxLevels.back();
+}
+
+float TerrainHeightMap::getSurfaceY(float x, float z) const
+{
+   if (empty() || x < 0.0f || z < 0.0f || x > Extent.x || z > Extent.y) return GroundLevel;
+
+   const int ix = std::min( static_cast<int>(x / CellSize.x), CellsX - 1 );
+   const int iz = std::min( static_cast<int>(z / CellSize.y), CellsZ - 1 );
+   const float u = x / CellSize.x - static_cast<float>(ix);
+   const float v = z / CellSize.y - static_cast<float>(iz);
+   const float* e = Elevations.data() + static_cast<size_t>(iz) * Columns + ix;
+   const float elevation = u + v < 1.0f ?
+      e[0] + u * (e[1] - e[0]) + v * (e[Columns] - e[0]) :
+      e[Columns + 1] + (1.0f - u) * (e[Columns] - e[Columns + 1]) + (1.0f - v) * (e[1] - e[Columns + 1]);
+   return GroundLevel - elevation;
+}
+
+TerrainHeightMap::RaySpan TerrainHeightMap::getRaySpan(const glm::vec3& origin, const glm::vec3& direction) const
+{
+   constexpr float infinity = std::numeric_limits<float>::infinity();
+   RaySpan span{ 0.0f, infinity, infinity, infinity };
+   if (direction.y > 0.0f && origin.y <= GroundLevel) span.Plane = (GroundLevel - origin.y) / direction.y;
+   if (empty()) {
+      span.Leave = span.Limit = -infinity;
+      return span;
+   }
+
+   const float origins[2] = { origin.x, origin.z };
+   const float directions[2] = { direction.x, direction.z };
+   const float extents[2] = { Extent.x, Extent.y };
+   for (int a = 0; a < 2; ++a) {
+      if (directions[a] != 0.0f) {
+         const float t0 = -origins[a] / directions[a];
+         const float t1 = (extents[a] - origins[a]) / directions[a];
+         span.Enter = std::max( span.Enter, std::min( t0, t1 ) );
+         span.Leave = std::min( span.Leave, std::max( t0, t1 ) );
+      }
+      else if (origins[a] < 0.0f || origins[a] > extents[a]) span.Leave = -infinity;
+   }
+
+   // below the lowest elevation the ray is under the terrain wherever it is
+   span.Limit = direction.y > 0.0f ?
+      std::min( span.Leave, (GroundLevel - MinElevation - origin.y) / direction.y ) : span.Leave;
+   return span;
+}
+
+float TerrainHeightMap::finishRay(const RaySpan& span, float grid_hit, const glm::vec3& origin, const glm::vec3& direction) const
+{
+   // the flat ground outside the grid comes first, or the ray never crosses the grid
+   if (!(span.Enter < span.Leave) || span.Plane < span.Enter) return span.Plane;
+   if (grid_hit < std::numeric_limits<float>::infinity()) return grid_hit;
+   if (span.Limit < span.Leave) return std::max( span.Limit, span.Enter );
+   // leaving the grid below the flat ground means hitting the side of the grid
+   if (std::isfinite( span.Leave ) && origin.y + span.Leave * direction.y >= GroundLevel) return span.Leave;
+   return span.Plane;
+}
+
+bool TerrainHeightMap::hitCell(
+   float& t_hit,
+   const glm::vec3& origin,
+   const glm::vec3& direction,
+   int ix,
+   int iz,
+   float t_in,
+   float t_out
+) const
+{
+   const float* e = Elevations.data() + static_cast<size_t>(iz) * Columns + ix;
+   const float e00 = e[0], e10 = e[1], e01 = e[Columns], e11 = e[Columns + 1];
+   const float e0 = GroundLevel - origin.y;
+   const auto fx = static_cast<float>(ix);
+   const auto fz = static_cast<float>(iz);
+   const auto getLocalU = [&](float t) { return (origin.x + t * direction.x) / CellSize.x - fx; };
+   const auto getLocalV = [&](float t) { return (origin.z + t * direction.z) / CellSize.y - fz; };
+   // the signed height of the ray over the lower triangle (u + v < 1) or the upper one
+   const auto getClearance = [&](float t, bool lower_triangle)
+   {
+      const float u = getLocalU( t );
+      const float v = getLocalV( t );
+      const float elevation = lower_triangle ?
+         e00 + u * (e10 - e00) + v * (e01 - e00) :
+         e11 + (1.0f - u) * (e01 - e11) + (1.0f - v) * (e10 - e11);
+      return e0 - t * direction.y - elevation;
+   };
+
+   // the ray crosses the diagonal at most once, which splits its segment into two planar pieces
+   const float s_in = getLocalU( t_in ) + getLocalV( t_in );
+   const float s_out = getLocalU( t_out ) + getLocalV( t_out );
+   const bool crosses = (s_in - 1.0f) * (s_out - 1.0f) < 0.0f;
+   const float t_diagonal = crosses ? t_in + (1.0f - s_in) / (s_out - s_in) * (t_out - t_in) : t_out;
+   const bool first_lower = crosses ? s_in < 1.0f : s_in + s_out < 2.0f;
+
+   const float first_in = getClearance( t_in, first_lower );
+   const float first_out = getClearance( t_diagonal, first_lower );
+   if (first_in <= 0.0f) {
+      t_hit = t_in;
+      return true;
+   }
+   if (first_out <= 0.0f) {
+      t_hit = t_in + first_in / (first_in - first_out) * (t_diagonal - t_in);
+      return true;
+   }
+   if (!crosses) return false;
+
+   const float second_in = getClearance( t_diagonal, !first_lower );
+   const float second_out = getClearance( t_out, !first_lower );
+   if (second_out > 0.0f) return false;
+   t_hit = t_diagonal + second_in / (second_in - second_out) * (t_out - t_diagonal);
+   return true;
+}
+
+float TerrainHeightMap::traverse(const glm::vec3& origin, const glm::vec3& direction, float t, float t_limit) const
+{
+   constexpr float infinity = std::numeric_limits<float>::infinity();
+   const float e0 = GroundLevel - origin.y;
+   int ix = std::clamp( static_cast<int>(std::floor( (origin.x + t * direction.x) / CellSize.x )), 0, CellsX - 1 );
+   int iz = std::clamp( static_cast<int>(std::floor( (origin.z + t * direction.z) / CellSize.y )), 0, CellsZ - 1 );
+   int level = TopLevel;
+   while (true) {
+      const int nx = ix >> level;
+      const int nz = iz >> level;
+      const auto node_scale = static_cast<float>(1 << level);
+      const float node_size_x = CellSize.x * node_scale;
+      const float node_size_z = CellSize.y * node_scale;
+      const float tx = direction.x > 0.0f ? (static_cast<float>(nx + 1) * node_size_x - origin.x) / direction.x :
+         direction.x < 0.0f ? (static_cast<float>(nx) * node_size_x - origin.x) / direction.x : infinity;
+      const float tz = direction.z > 0.0f ? (static_cast<float>(nz + 1) * node_size_z - origin.z) / direction.z :
+         direction.z < 0.0f ? (static_cast<float>(nz) * node_size_z - origin.z) / direction.z : infinity;
+      const float t_exit = std::min( std::min( tx, tz ), t_limit );
+      const float e_in = e0 - t * direction.y;
+      const float e_out = e0 - t_exit * direction.y;
+
+      const int node = LevelOffsets[level] + nz * LevelWidths[level] + nx;
+      if (std::max( e_in, e_out ) < MinLevels[node]) return t;
+      if (std::min( e_in, e_out ) <= MaxLevels[node]) {
+         if (level > 0) {
+            level--;
+            continue;
+         }
+         float t_hit;
+         if (hitCell( t_hit, origin, direction, ix, iz, t, t_exit )) return t_hit;
+      }
+
+      // the ray passes over the node, so it moves on to the neighbor and tries a coarser level there
+      if (t_exit >= t_limit) return infinity;
+      if (tx <= tz) {
+         ix = direction.x > 0.0f ? (nx + 1) << level : (nx << level) - 1;
+         iz = std::clamp(
+            static_cast<int>(std::floor( (origin.z + t_exit * direction.z) / CellSize.y )),
+            nz << level, std::min( ((nz + 1) << level) - 1, CellsZ - 1 )
+         );
+      }
+      else {
+         ix = std::clamp(
+            static_cast<int>(std::floor( (origin.x + t_exit * direction.x) / CellSize.x )),
+            nx << level, std::min( ((nx + 1) << level) - 1, CellsX - 1 )
+         );
+         iz = direction.z > 0.0f ? (nz + 1) << level : (nz << level) - 1;
+      }
+      if (ix < 0 || ix >= CellsX || iz < 0 || iz >= CellsZ) return infinity;
+      t = t_exit;
+      level = std::min( level + 1, TopLevel );
+   }
+}
+
+#ifdef USE_AVX2
+void TerrainHeightMap::traverse8(
+   float* grid_hits,
+   const glm::vec3& origin,
+   const glm::vec3* directions,
+   const float* enters,
+   const float* limits
+) const
+{
+   // the same traversal as traverse() for eight rays at once, where every lane keeps its own node and level
+   const __m256i vector_stride = _mm256_setr_epi32( 0, 3, 6, 9, 12, 15, 18, 21 );
+   const float* base = &directions[0].x;
+   const __m256 dx = _mm256_i32gather_ps( base, vector_stride, 4 );
+   const __m256 dy = _mm256_i32gather_ps( base + 1, vector_stride, 4 );
+   const __m256 dz = _mm256_i32gather_ps( base + 2, vector_stride, 4 );
+   const __m256 ox = _mm256_set1_ps( origin.x );
+   const __m256 oz = _mm256_set1_ps( origin.z );
+   const __m256 e0 = _mm256_set1_ps( GroundLevel - origin.y );
+   const __m256 cell_x = _mm256_set1_ps( CellSize.x );
+   const __m256 cell_z = _mm256_set1_ps( CellSize.y );
+   const __m256 zero = _mm256_setzero_ps();
+   const __m256 one = _mm256_set1_ps( 1.0f );
+   const __m256 two = _mm256_set1_ps( 2.0f );
+   const __m256 infinity = _mm256_set1_ps( std::numeric_limits<float>::infinity() );
+   const __m256i zero_i = _mm256_setzero_si256();
+   const __m256i one_i = _mm256_set1_epi32( 1 );
+   const __m256i max_ix = _mm256_set1_epi32( CellsX - 1 );
+   const __m256i max_iz = _mm256_set1_epi32( CellsZ - 1 );
+   const __m256i top_level = _mm256_set1_epi32( TopLevel );
+   const __m256i columns = _mm256_set1_epi32( Columns );
+   const __m256 positive_x = _mm256_cmp_ps( dx, zero, _CMP_GT_OQ );
+   const __m256 positive_z = _mm256_cmp_ps( dz, zero, _CMP_GT_OQ );
+   const __m256 flat_x = _mm256_cmp_ps( dx, zero, _CMP_EQ_OQ );
+   const __m256 flat_z = _mm256_cmp_ps( dz, zero, _CMP_EQ_OQ );
+   const __m256 t_limit = _mm256_loadu_ps( limits );
+   const auto clampIndex = [](__m256i index, __m256i low, __m256i high)
+   {
+      return _mm256_min_epi32( _mm256_max_epi32( index, low ), high );
+   };
+   const auto getCellIndex = [](__m256 o, __m256 t, __m256 d, __m256 cell)
+   {
+      return _mm256_cvttps_epi32( _mm256_floor_ps( _mm256_div_ps( _mm256_add_ps( o, _mm256_mul_ps( t, d ) ), cell ) ) );
+   };
+
+   __m256 t = _mm256_loadu_ps( enters );
+   __m256 hits = infinity;
+   __m256 active = _mm256_cmp_ps( t, t_limit, _CMP_LT_OQ );
+   __m256i ix = clampIndex( getCellIndex( ox, t, dx, cell_x ), zero_i, max_ix );
+   __m256i iz = clampIndex( getCellIndex( oz, t, dz, cell_z ), zero_i, max_iz );
+   __m256i level = top_level;
+   while (_mm256_movemask_ps( active ) != 0) {
+      const __m256i nx = _mm256_srav_epi32( ix, level );
+      const __m256i nz = _mm256_srav_epi32( iz, level );
+      const __m256 node_scale = _mm256_cvtepi32_ps( _mm256_sllv_epi32( one_i, level ) );
+      const __m256 node_size_x = _mm256_mul_ps( cell_x, node_scale );
+      const __m256 node_size_z = _mm256_mul_ps( cell_z, node_scale );
+      // the mask is -1 for positive directions, so subtracting it selects the far side of the node
+      const __m256 bound_x = _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_sub_epi32( nx, _mm256_castps_si256( positive_x ) ) ), node_size_x );
+      const __m256 bound_z = _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_sub_epi32( nz, _mm256_castps_si256( positive_z ) ) ), node_size_z );
+      const __m256 tx = _mm256_blendv_ps( _mm256_div_ps( _mm256_sub_ps( bound_x, ox ), dx ), infinity, flat_x );
+      const __m256 tz = _mm256_blendv_ps( _mm256_div_ps( _mm256_sub_ps( bound_z, oz ), dz ), infinity, flat_z );
+      const __m256 t_exit = _mm256_min_ps( _mm256_min_ps( tx, tz ), t_limit );
+      const __m256 e_in = _mm256_sub_ps( e0, _mm256_mul_ps( t, dy ) );
+      const __m256 e_out = _mm256_sub_ps( e0, _mm256_mul_ps( t_exit, dy ) );
+
+      const __m256i node = _mm256_add_epi32(
+         _mm256_add_epi32(
+            _mm256_i32gather_epi32( LevelOffsets.data(), level, 4 ),
+            _mm256_mullo_epi32( nz, _mm256_i32gather_epi32( LevelWidths.data(), level, 4 ) )
+         ),
+         nx
+      );
+      const __m256 min_elevation = _mm256_mask_i32gather_ps( zero, MinLevels.data(), node, active, 4 );
+      const __m256 max_elevation = _mm256_mask_i32gather_ps( zero, MaxLevels.data(), node, active, 4 );
+      const __m256 below = _mm256_and_ps( active, _mm256_cmp_ps( _mm256_max_ps( e_in, e_out ), min_elevation, _CMP_LT_OQ ) );
+      const __m256 not_below = _mm256_andnot_ps( below, active );
+      const __m256 open = _mm256_and_ps( not_below, _mm256_cmp_ps( _mm256_min_ps( e_in, e_out ), max_elevation, _CMP_LE_OQ ) );
+      const __m256 at_leaf = _mm256_castsi256_ps( _mm256_cmpeq_epi32( level, zero_i ) );
+      const __m256 leaf = _mm256_and_ps( open, at_leaf );
+      const __m256 descend = _mm256_andnot_ps( at_leaf, open );
+      hits = _mm256_blendv_ps( hits, t, below );
+
+      __m256 leaf_hit = zero;
+      if (_mm256_movemask_ps( leaf ) != 0) {
+         const __m256i cell = _mm256_add_epi32( _mm256_mullo_epi32( iz, columns ), ix );
+         const __m256i next_row = _mm256_add_epi32( cell, columns );
+         const __m256 e00 = _mm256_mask_i32gather_ps( zero, Elevations.data(), cell, leaf, 4 );
+         const __m256 e10 = _mm256_mask_i32gather_ps( zero, Elevations.data(), _mm256_add_epi32( cell, one_i ), leaf, 4 );
+         const __m256 e01 = _mm256_mask_i32gather_ps( zero, Elevations.data(), next_row, leaf, 4 );
+         const __m256 e11 = _mm256_mask_i32gather_ps( zero, Elevations.data(), _mm256_add_epi32( next_row, one_i ), leaf, 4 );
+         const __m256 fx = _mm256_cvtepi32_ps( ix );
+         const __m256 fz = _mm256_cvtepi32_ps( iz );
+         const auto getLocalU = [&](__m256 at) { return _mm256_sub_ps( _mm256_div_ps( _mm256_add_ps( ox, _mm256_mul_ps( at, dx ) ), cell_x ), fx ); };
+         const auto getLocalV = [&](__m256 at) { return _mm256_sub_ps( _mm256_div_ps( _mm256_add_ps( oz, _mm256_mul_ps( at, dz ) ), cell_z ), fz ); };
+         const auto getClearance = [&](__m256 at, __m256 lower_triangle)
+         {
+            const __m256 u = getLocalU( at );
+            const __m256 v = getLocalV( at );
+            const __m256 lower = _mm256_add_ps(
+               _mm256_add_ps( e00, _mm256_mul_ps( u, _mm256_sub_ps( e10, e00 ) ) ),
+               _mm256_mul_ps( v, _mm256_sub_ps( e01, e00 ) )
+            );
+            const __m256 upper = _mm256_add_ps(
+               _mm256_add_ps( e11, _mm256_mul_ps( _mm256_sub_ps( one, u ), _mm256_sub_ps( e01, e11 ) ) ),
+               _mm256_mul_ps( _mm256_sub_ps( one, v ), _mm256_sub_ps( e10, e11 ) )
+            );
+            return _mm256_sub_ps( _mm256_sub_ps( e0, _mm256_mul_ps( at, dy ) ), _mm256_blendv_ps( upper, lower, lower_triangle ) );
+         };
+
+         const __m256 s_in = _mm256_add_ps( getLocalU( t ), getLocalV( t ) );
+         const __m256 s_out = _mm256_add_ps( getLocalU( t_exit ), getLocalV( t_exit ) );
+         const __m256 crosses = _mm256_cmp_ps( _mm256_mul_ps( _mm256_sub_ps( s_in, one ), _mm256_sub_ps( s_out, one ) ), zero, _CMP_LT_OQ );
+         const __m256 t_diagonal = _mm256_blendv_ps(
+            t_exit,
+            _mm256_add_ps( t, _mm256_mul_ps( _mm256_div_ps( _mm256_sub_ps( one, s_in ), _mm256_sub_ps( s_out, s_in ) ), _mm256_sub_ps( t_exit, t ) ) ),
+            crosses
+         );
+         const __m256 first_lower = _mm256_blendv_ps(
+            _mm256_cmp_ps( _mm256_add_ps( s_in, s_out ), two, _CMP_LT_OQ ),
+            _mm256_cmp_ps( s_in, one, _CMP_LT_OQ ),
+            crosses
+         );
+         const __m256 second_lower = _mm256_xor_ps( first_lower, _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) ) );
+         const __m256 first_in = getClearance( t, first_lower );
+         const __m256 first_out = getClearance( t_diagonal, first_lower );
+         const __m256 second_in = getClearance( t_diagonal, second_lower );
+         const __m256 second_out = getClearance( t_exit, second_lower );
+
+         const __m256 hit_in = _mm256_cmp_ps( first_in, zero, _CMP_LE_OQ );
+         const __m256 hit_first = _mm256_cmp_ps( first_out, zero, _CMP_LE_OQ );
+         const __m256 hit_second = _mm256_and_ps( crosses, _mm256_cmp_ps( second_out, zero, _CMP_LE_OQ ) );
+         const __m256 t_first = _mm256_add_ps(
+            t, _mm256_mul_ps( _mm256_div_ps( first_in, _mm256_sub_ps( first_in, first_out ) ), _mm256_sub_ps( t_diagonal, t ) )
+         );
+         const __m256 t_second = _mm256_add_ps(
+            t_diagonal,
+            _mm256_mul_ps( _mm256_div_ps( second_in, _mm256_sub_ps( second_in, second_out ) ), _mm256_sub_ps( t_exit, t_diagonal ) )
+         );
+         const __m256 leaf_t = _mm256_blendv_ps( _mm256_blendv_ps( t_second, t_first, hit_first ), t, hit_in );
+         leaf_hit = _mm256_and_ps( leaf, _mm256_or_ps( _mm256_or_ps( hit_in, hit_first ), hit_second ) );
+         hits = _mm256_blendv_ps( hits, leaf_t, leaf_hit );
+      }
+
+      // lanes passing over their nodes move on to the neighbors and try coarser levels there
+      const __m256 advance = _mm256_or_ps( _mm256_andnot_ps( open, not_below ), _mm256_andnot_ps( leaf_hit, leaf ) );
+      const __m256 step_x = _mm256_cmp_ps( tx, tz, _CMP_LE_OQ );
+      const __m256i node_x0 = _mm256_sllv_epi32( nx, level );
+      const __m256i node_z0 = _mm256_sllv_epi32( nz, level );
+      const __m256i next_x0 = _mm256_sllv_epi32( _mm256_add_epi32( nx, one_i ), level );
+      const __m256i next_z0 = _mm256_sllv_epi32( _mm256_add_epi32( nz, one_i ), level );
+      const __m256i step_ix = _mm256_castps_si256( _mm256_blendv_ps(
+         _mm256_castsi256_ps( _mm256_sub_epi32( node_x0, one_i ) ), _mm256_castsi256_ps( next_x0 ), positive_x
+      ) );
+      const __m256i step_iz = _mm256_castps_si256( _mm256_blendv_ps(
+         _mm256_castsi256_ps( _mm256_sub_epi32( node_z0, one_i ) ), _mm256_castsi256_ps( next_z0 ), positive_z
+      ) );
+      const __m256i slide_ix = clampIndex(
+         getCellIndex( ox, t_exit, dx, cell_x ), node_x0, _mm256_min_epi32( _mm256_sub_epi32( next_x0, one_i ), max_ix )
+      );
+      const __m256i slide_iz = clampIndex(
+         getCellIndex( oz, t_exit, dz, cell_z ), node_z0, _mm256_min_epi32( _mm256_sub_epi32( next_z0, one_i ), max_iz )
+      );
+      const __m256i next_ix = _mm256_castps_si256( _mm256_blendv_ps( _mm256_castsi256_ps( slide_ix ), _mm256_castsi256_ps( step_ix ), step_x ) );
+      const __m256i next_iz = _mm256_castps_si256( _mm256_blendv_ps( _mm256_castsi256_ps( step_iz ), _mm256_castsi256_ps( slide_iz ), step_x ) );
+      const __m256i outside = _mm256_or_si256(
+         _mm256_or_si256( _mm256_cmpgt_epi32( zero_i, next_ix ), _mm256_cmpgt_epi32( next_ix, max_ix ) ),
+         _mm256_or_si256( _mm256_cmpgt_epi32( zero_i, next_iz ), _mm256_cmpgt_epi32( next_iz, max_iz ) )
+      );
+      const __m256 leaves = _mm256_and_ps(
+         advance, _mm256_or_ps( _mm256_cmp_ps( t_exit, t_limit, _CMP_GE_OQ ), _mm256_castsi256_ps( outside ) )
+      );
+
+      const __m256i advance_i = _mm256_castps_si256( advance );
+      ix = _mm256_blendv_epi8( ix, next_ix, advance_i );
+      iz = _mm256_blendv_epi8( iz, next_iz, advance_i );
+      t = _mm256_blendv_ps( t, t_exit, advance );
+      level = _mm256_blendv_epi8( level, _mm256_sub_epi32( level, one_i ), _mm256_castps_si256( descend ) );
+      level = _mm256_blendv_epi8( level, _mm256_min_epi32( _mm256_add_epi32( level, one_i ), top_level ), advance_i );
+      active = _mm256_andnot_ps( _mm256_or_ps( _mm256_or_ps( below, leaf_hit ), leaves ), active );
+   }
+   _mm256_storeu_ps( grid_hits, hits );
+}
+#endif
+
+float TerrainHeightMap::castRay(const glm::vec3& origin, const glm::vec3& direction) const
+{
+   const RaySpan span = getRaySpan( origin, direction );
+   float grid_hit = std::numeric_limits<float>::infinity();
+   if (span.Enter < span.Limit && std::isfinite( span.Limit ) && span.Plane >= span.Enter) {
+      grid_hit = traverse( origin, direction, span.Enter, span.Limit );
+   }
+   return finishRay( span, grid_hit, origin, direction );
+}
+
+void TerrainHeightMap::castRays(float* distances, const glm::vec3& origin, const glm::vec3* directions, int n) const
+{
+   int i = 0;
+#ifdef USE_AVX2
+   RaySpan spans[8];
+   float enters[8], limits[8], grid_hits[8];
+   for (; i + 8 <= n; i += 8) {
+      bool any_traversal = false;
+      for (int k = 0; k < 8; ++k) {
+         spans[k] = getRaySpan( origin, directions[i + k] );
+         const bool traversal = spans[k].Enter < spans[k].Limit && std::isfinite( spans[k].Limit ) && spans[k].Plane >= spans[k].Enter;
+         enters[k] = traversal ? spans[k].Enter : 0.0f;
+         limits[k] = traversal ? spans[k].Limit : 0.0f;
+         any_traversal |= traversal;
+      }
+      if (any_traversal) traverse8( grid_hits, origin, directions + i, enters, limits );
+      else std::fill( grid_hits, grid_hits + 8, std::numeric_limits<float>::infinity() );
+      for (int k = 0; k < 8; ++k) distances[i + k] = finishRay( spans[k], grid_hits[k], origin, directions[i + k] );
+   }
+#endif
+   for (; i < n; ++i) distances[i] = castRay( origin, directions[i] );
+}
+
+void TerrainHeightMap::getGroundPoints(std::vector<glm::vec3>& ground_points, const PinholeCamera& camera) const
+{
+   ground_points.resize( static_cast<size_t>(camera.Width) * camera.Height );
+   const glm::mat3 rotation(camera.ToWorldCoordinate);
+   const glm::vec3 origin(camera.ToWorldCoordinate[3]);
+   const float half_width = static_cast<float>(camera.Width) * 0.5f;
+   const float half_height = static_cast<float>(camera.Height) * 0.5f;
+   parallelFor(
+      0, camera.Height,
+      [&](int begin, int end)
+      {
+         std::vector<glm::vec3> directions(camera.Width);
+         std::vector<float> distances(camera.Width);
+         for (int y = begin; y < end; ++y) {
+            const float v = static_cast<float>(y) + 0.5f - half_height;
+            for (int x = 0; x < camera.Width; ++x) {
+               directions[x] = rotation * glm::vec3(static_cast<float>(x) + 0.5f - half_width, v, camera.FocalLength);
+            }
+            castRays( distances.data(), origin, directions.data(), camera.Width );
+
+            glm::vec3* row = ground_points.data() + static_cast<size_t>(y) * camera.Width;
+            for (int x = 0; x < camera.Width; ++x) {
+               row[x] = std::isfinite( distances[x] ) ?
+                  origin + distances[x] * directions[x] : glm::vec3(std::numeric_limits<float>::infinity());
+            }
+         }
+      }
+   );
+}
+
+void TerrainHeightMap::getTriangles(std::vector<glm::vec3>& vertices, std::vector<glm::vec2>& textures, std::vector<uint>& indices) const
+{
+   vertices.clear();
+   textures.clear();
+   indices.clear();
+   if (empty()) return;
+
+   vertices.reserve( static_cast<size_t>(Columns) * Rows );
+   textures.reserve( static_cast<size_t>(Columns) * Rows );
+   for (int z = 0; z < Rows; ++z) {
+      for (int x = 0; x < Columns; ++x) {
+         const glm::vec3 vertex(
+            static_cast<float>(x) * CellSize.x,
+            GroundLevel - Elevations[static_cast<size_t>(z) * Columns + x],
+            static_cast<float>(z) * CellSize.y
+         );
+         vertices.emplace_back( vertex );
+         textures.emplace_back( vertex.z / Extent.y, 1.0f - vertex.x / Extent.x );
+      }
+   }
+   // the cells go row by row in narrow bands of columns, so a row of vertices stays in a 16-entry post-transform cache
+   // until the next row reuses it, which nearly halves the vertex shader invocations of a plain row-major order
+   constexpr int band_width = 7;
+   indices.reserve( static_cast<size_t>(CellsX) * CellsZ * 6 );
+   for (int band = 0; band < CellsX; band += band_width) {
+      const int band_end = std::min( band + band_width, CellsX );
+      for (int z = 0; z < CellsZ; ++z) {
+         for (int x = band; x < band_end; ++x) {
+            const auto v00 = static_cast<uint>(z * Columns + x);
+            const uint v10 = v00 + 1;
+            const auto v01 = static_cast<uint>(v00 + Columns);
+            const uint v11 = v01 + 1;
+            indices.insert( indices.end(), { v00, v10, v01, v10, v11, v01 } );
+         }
+      }
+   }
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+/*
+ * Author: Emoy Kim
+ * E-mail: emoy.kim_AT_gmail.com
+ *
+ * This code is a free software; it can be freely used, changed and redistributed.
+ * If you use any version of the code, please reference the code.
+ *
+ */
+
+#pragma once
+
+#include "PinholeCamera.h"
+
+// a heightmap terrain over the ground rectangle [0, extent.x] x [0, extent.y] of the world xz plane.
+// elevations are in meters above the flat ground y = GroundLevel, so the surface is y = GroundLevel - elevation,
+// every grid cell is split into two triangles along its diagonal from (x1, z0) to (x0, z1),
+// and outside the grid the ground stays flat.
+class TerrainHeightMap
+{
+public:
+	TerrainHeightMap();
+
+	bool empty() const { return Elevations.empty(); }
+	// grid rows run along z and columns along x, and the outermost samples lie on the border of the extent
+	void setElevations(const float* elevations, int columns, int rows, const glm::vec2& extent_in_meter);
+	// the grid file is a float map of elevations in meters (see readFloatMap)
+	bool load(const std::string& file_path, const glm::vec2& extent_in_meter);
+	void setGroundLevel(float ground_level) { GroundLevel = ground_level; }
+	float getGroundLevel() const { return GroundLevel; }
+	int getColumns() const { return Columns; }
+	int getRows() const { return Rows; }
+	float getSurfaceY(float x, float z) const;
+	// ray parameters of the first ground hits in units of the directions, and infinity where the ray never meets the ground
+	float castRay(const glm::vec3& origin, const glm::vec3& direction) const;
+	void castRays(float* distances, const glm::vec3& origin, const glm::vec3* directions, int n) const;
+	// top-down ground points seen at the pixel centers, where pixels not seeing the ground get infinity
+	void getGroundPoints(std::vector<glm::vec3>& ground_points, const PinholeCamera& camera) const;
+	// indexed triangles of the surface with a vertex per grid sample and the texture coordinates of the flat ground quad
+	void getTriangles(std::vector<glm::vec3>& vertices, std::vector<glm::vec2>& textures, std::vector<uint>& indices) const;
+
+private:
+	struct RaySpan
+	{
+		float Enter; // where the ray enters the grid
+		float Leave; // where the ray leaves the grid
+		float Limit; // where the ray leaves the grid or goes below the lowest elevation
+		float Plane; // where the ray meets the flat ground
+	};
+
+	int Columns;
+	int Rows;
+	int CellsX;
+	int CellsZ;
+	int TopLevel;
+	float GroundLevel;
+	float MinElevation;
+	float MaxElevation;
+	glm::vec2 Extent;
+	glm::vec2 CellSize;
+	std::vector<float> Elevations;
+	// per-node elevation bounds of all levels, where level 0 has a node per cell and level l + 1 merges 2x2 nodes of level l
+	std::vector<float> MinLevels;
+	std::vector<float> MaxLevels;
+	std::vector<int> LevelOffsets;
+	std::vector<int> LevelWidths;
+
+	void buildMinMaxLevels();
+	RaySpan getRaySpan(const glm::vec3& origin, const glm::vec3& direction) const;
+	float finishRay(const RaySpan& span, float grid_hit, const glm::vec3& origin, const glm::vec3& direction) const;
+	bool hitCell(float& t_hit, const glm::vec3& origin, const glm::vec3& direction, int ix, int iz, float t_in, float t_out) const;
+	float traverse(const glm::vec3& origin, const glm::vec3& direction, float t, float t_limit) const;
+#ifdef USE_AVX2
+	void traverse8(float* grid_hits, const glm::vec3& origin, const glm::vec3* directions, const float* enters, const float* limits) const;
+#endif
+};
\ No newline at end of file
@@ -1,36 +1,192 @@
 #include "VirtualFenceMakerGL.h"
 
+#include <filesystem>
+#include <random>
+
 //------------------------------------------------------------------
 //
 // Shader Class
 //
 //------------------------------------------------------------------
 
-ShaderGL::ShaderGL() : ShaderProgram( 0 ), MVPLocation( 0 ), ColorLocation( 0 ), TextureLocation( 0 )
+namespace
+{
+   // the extension shares this value with GL_ARB_parallel_shader_compile, and it leaves the count to the driver
+   constexpr GLuint AnyShaderCompilerThreads = 0xFFFFFFFF;
+
+   uint64_t hashString(uint64_t hash, const char* text)
+   {
+      // FNV-1a, where the terminating zero also goes in so that the strings cannot shift into each other
+      do {
+         hash ^= static_cast<uint8_t>(*text);
+         hash *= 0x100000001B3ull;
+      } while (*text++ != '\0');
+      return hash;
+   }
+}
+
+ShaderGL::ShaderGL() :
+   ShaderProgram( 0 ), MVPLocation( 0 ), ColorLocation( 0 ), TextureLocation( 0 ), VertexShader( 0 ), FragmentShader( 0 ),
+   GeometryShader( 0 ), LoadedFromCache( false )
+{
+}
+
+bool ShaderGL::enableParallelCompile()
+{
+   using MaxShaderCompilerThreads = void (APIENTRYP)(GLuint count);
+   const char* const extensions[2][2] = {
+      { "GL_KHR_parallel_shader_compile", "glMaxShaderCompilerThreadsKHR" },
+      { "GL_ARB_parallel_shader_compile", "glMaxShaderCompilerThreadsARB" }
+   };
+   for (const auto& extension : extensions) {
+      if (glfwExtensionSupported( extension[0] ) != GLFW_TRUE) continue;
+
+      const auto set_threads = reinterpret_cast<MaxShaderCompilerThreads>(glfwGetProcAddress( extension[1] ));
+      if (set_threads != nullptr) {
+         set_threads( AnyShaderCompilerThreads );
+         return true;
+      }
+   }
+   return false;
+}
+
+bool ShaderGL::loadProgramBinary()
 {
+   std::ifstream file(CacheFilePath, std::ios::binary);
+   if (!file.is_open()) return false;
+
+   GLenum format = 0;
+   file.read( reinterpret_cast<char*>(&format), sizeof(format) );
+   const std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+   if (!file.eof() || binary.empty()) return false;
+
+   // a binary that the driver no longer accepts leaves the program unlinked, and then it is compiled again
+   glProgramBinary( ShaderProgram, format, binary.data(), static_cast<GLsizei>(binary.size()) );
+   GLint linked = GL_FALSE;
+   glGetProgramiv( ShaderProgram, GL_LINK_STATUS, &linked );
+   return linked == GL_TRUE;
 }
 
-void ShaderGL::setShader(const GLchar* const vertex_source, const GLchar* const fragment_source)
+void ShaderGL::saveProgramBinary() const
 {
-   const GLuint vertex_shader = glCreateShader( GL_VERTEX_SHADER );
-   const GLuint fragment_shader = glCreateShader( GL_FRAGMENT_SHADER );
+   GLint length = 0;
+   glGetProgramiv( ShaderProgram, GL_PROGRAM_BINARY_LENGTH, &length );
+   if (length <= 0) return;
+
+   GLenum format = 0;
+   std::vector<char> binary(length);
+   glGetProgramBinary( ShaderProgram, length, &length, &format, binary.data() );
+
+   // the binary goes to a file of its own first and is renamed over the cache file only when complete,
+   // so a worker or another run loading the same shader never reads it half written
+   std::error_code error;
+   std::filesystem::create_directories( CacheDirectory, error );
+   std::ostringstream temporary_path;
+   temporary_path << CacheFilePath << "." << std::random_device{}() << "."
+      << std::hash<std::thread::id>{}( std::this_thread::get_id() ) << ".tmp";
+   std::ofstream file(temporary_path.str(), std::ios::binary);
+   if (!file.is_open()) return;
+   file.write( reinterpret_cast<const char*>(&format), sizeof(format) );
+   file.write( binary.data(), length );
+   file.close();
+   if (!file) {
+      std::filesystem::remove( temporary_path.str(), error );
+      return;
+   }
+   std::filesystem::rename( temporary_path.str(), CacheFilePath, error );
+   if (error) std::filesystem::remove( temporary_path.str(), error );
+}
 
-   glShaderSource( vertex_shader, 1, &vertex_source, nullptr );
-   glShaderSource( fragment_shader, 1, &fragment_source, nullptr );
-   glCompileShader( vertex_shader );
-   glCompileShader( fragment_shader );
+bool ShaderGL::isCompiled(GLuint shader, const char* stage)
+{
+   GLint compiled = GL_FALSE;
+   glGetShaderiv( shader, GL_COMPILE_STATUS, &compiled );
+   if (compiled == GL_TRUE) return true;
+
+   GLint length = 0;
+   glGetShaderiv( shader, GL_INFO_LOG_LENGTH, &length );
+   std::string log(std::max( length, 1 ), '\0');
+   glGetShaderInfoLog( shader, length, nullptr, log.data() );
+   std::cout << "Failed to compile the " << stage << " shader:\n" << log.c_str() << "\n";
+   return false;
+}
+
+void ShaderGL::setShader(
+   const GLchar* const vertex_source,
+   const GLchar* const fragment_source,
+   const GLchar* const geometry_source
+)
+{
+   // a driver update changes one of its strings, which makes every cached binary miss
+   uint64_t key = 0xCBF29CE484222325ull;
+   const GLenum driver_strings[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+   for (const auto& name : driver_strings) key = hashString( key, reinterpret_cast<const char*>(glGetString( name )) );
+   key = hashString( key, vertex_source );
+   key = hashString( key, fragment_source );
+   key = hashString( key, geometry_source != nullptr ? geometry_source : "" );
+   std::ostringstream file_name;
+   file_name << std::hex << std::setw( 16 ) << std::setfill( '0' ) << key << ".bin";
+   CacheFilePath = CacheDirectory + "/" + file_name.str();
 
    ShaderProgram = glCreateProgram();
-   glAttachShader( ShaderProgram, vertex_shader );
-   glAttachShader( ShaderProgram, fragment_shader );
+   LoadedFromCache = loadProgramBinary();
+   if (LoadedFromCache) return;
+
+   // nothing is queried here, so the driver may keep compiling while the other programs are set
+   VertexShader = glCreateShader( GL_VERTEX_SHADER );
+   FragmentShader = glCreateShader( GL_FRAGMENT_SHADER );
+   GeometryShader = geometry_source != nullptr ? glCreateShader( GL_GEOMETRY_SHADER ) : 0;
+
+   glShaderSource( VertexShader, 1, &vertex_source, nullptr );
+   glShaderSource( FragmentShader, 1, &fragment_source, nullptr );
+   glCompileShader( VertexShader );
+   glCompileShader( FragmentShader );
+   if (GeometryShader != 0) {
+      glShaderSource( GeometryShader, 1, &geometry_source, nullptr );
+      glCompileShader( GeometryShader );
+   }
+
+   glAttachShader( ShaderProgram, VertexShader );
+   glAttachShader( ShaderProgram, FragmentShader );
+   if (GeometryShader != 0) glAttachShader( ShaderProgram, GeometryShader );
+   glProgramParameteri( ShaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
    glLinkProgram( ShaderProgram );
+}
+
+bool ShaderGL::finishShader()
+{
+   bool linked = true;
+   if (VertexShader != 0) {
+      GLint status = GL_FALSE;
+      glGetProgramiv( ShaderProgram, GL_LINK_STATUS, &status );
+      linked = status == GL_TRUE;
+      if (!linked) {
+         // the compile logs usually tell more than the link log, which only follows them
+         isCompiled( VertexShader, "vertex" );
+         isCompiled( FragmentShader, "fragment" );
+         if (GeometryShader != 0) isCompiled( GeometryShader, "geometry" );
+
+         GLint length = 0;
+         glGetProgramiv( ShaderProgram, GL_INFO_LOG_LENGTH, &length );
+         std::string log(std::max( length, 1 ), '\0');
+         glGetProgramInfoLog( ShaderProgram, length, nullptr, log.data() );
+         std::cout << "Failed to link the shader program:\n" << log.c_str() << "\n";
+      }
+      else saveProgramBinary();
+
+      const GLuint shaders[3] = { VertexShader, FragmentShader, GeometryShader };
+      for (const auto& shader : shaders) {
+         if (shader == 0) continue;
+         glDetachShader( ShaderProgram, shader );
+         glDeleteShader( shader );
+      }
+      VertexShader = FragmentShader = GeometryShader = 0;
+   }
 
    MVPLocation = glGetUniformLocation( ShaderProgram, "ModelViewProjectionMatrix" );
    ColorLocation = glGetUniformLocation( ShaderProgram, "PrimitiveColor" );
    TextureLocation = glGetUniformLocation( ShaderProgram, "BaseTexture" );
-
-   glDeleteShader( vertex_shader );
-   glDeleteShader( fragment_shader );
+   return linked;
 }
 
 
@@ -40,7 +196,9 @@ void ShaderGL::setShader(const GLchar* const vertex_source, const GLchar* const
 //
 //------------------------------------------------------------------
 
-ObjectGL::ObjectGL() : ObjVAO( 0 ), ObjVBO( 0 ), DrawMode( 0 ), TextureID( 0 ), VerticesCount( 0 ), Colors{}
+ObjectGL::ObjectGL() :
+   ObjVAO( 0 ), ObjVBO( 0 ), ObjEBO( 0 ), DrawMode( 0 ), IndexType( GL_UNSIGNED_INT ), TextureID( 0 ), VerticesCount( 0 ),
+   IndicesCount( 0 ), Colors{}, DequantizationMatrix( 1.0f )
 {
 }
 
@@ -50,6 +208,7 @@ void ObjectGL::prepareVertexBuffer(int n_bytes_per_vertex)
    glBindBuffer( GL_ARRAY_BUFFER, ObjVBO );
    glBufferData( GL_ARRAY_BUFFER, sizeof(GLfloat) * DataBuffer.size(), DataBuffer.data(), GL_STATIC_DRAW );
    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+   std::vector<GLfloat>().swap( DataBuffer );
 
    glGenVertexArrays( 1, &ObjVAO );
    glBindVertexArray( ObjVAO );
@@ -58,6 +217,68 @@ void ObjectGL::prepareVertexBuffer(int n_bytes_per_vertex)
    glEnableVertexAttribArray( 0 );
 }
 
+void ObjectGL::prepareQuantizedBuffers(
+   const std::vector<glm::vec3>& vertices,
+   const std::vector<glm::vec2>& textures,
+   const std::vector<uint>& indices
+)
+{
+   glm::vec3 min_point(std::numeric_limits<float>::max()), max_point(std::numeric_limits<float>::lowest());
+   for (const auto& vertex : vertices) {
+      min_point = min( min_point, vertex );
+      max_point = max( max_point, vertex );
+   }
+   glm::vec3 extent = max_point - min_point;
+   for (int i = 0; i < 3; ++i) {
+      if (extent[i] <= 0.0f) extent[i] = 1.0f;
+   }
+   DequantizationMatrix = scale( translate( glm::mat4(1.0f), min_point ), extent );
+
+   // 4 shorts for a position padded to 8 bytes, and 2 more for the texture coordinates if any
+   const int n_shorts_per_vertex = textures.empty() ? 4 : 6;
+   const auto quantize = [](float value) { return static_cast<uint16_t>(std::lrint( std::clamp( value, 0.0f, 1.0f ) * 65535.0f )); };
+   std::vector<uint16_t> data(vertices.size() * n_shorts_per_vertex, 0);
+   for (size_t i = 0; i < vertices.size(); ++i) {
+      uint16_t* vertex = data.data() + i * n_shorts_per_vertex;
+      const glm::vec3 normalized = (vertices[i] - min_point) / extent;
+      vertex[0] = quantize( normalized.x );
+      vertex[1] = quantize( normalized.y );
+      vertex[2] = quantize( normalized.z );
+      if (!textures.empty()) {
+         vertex[4] = quantize( textures[i].x );
+         vertex[5] = quantize( textures[i].y );
+      }
+   }
+   const int n_bytes_per_vertex = n_shorts_per_vertex * static_cast<int>(sizeof(uint16_t));
+   VerticesCount = static_cast<GLsizei>(vertices.size());
+   IndicesCount = static_cast<GLsizei>(indices.size());
+
+   glGenVertexArrays( 1, &ObjVAO );
+   glBindVertexArray( ObjVAO );
+   glGenBuffers( 1, &ObjVBO );
+   glBindBuffer( GL_ARRAY_BUFFER, ObjVBO );
+   glBufferData( GL_ARRAY_BUFFER, sizeof(uint16_t) * data.size(), data.data(), GL_STATIC_DRAW );
+   glVertexAttribPointer( 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, n_bytes_per_vertex, bufferOffset( 0 ) );
+   glEnableVertexAttribArray( 0 );
+   if (!textures.empty()) {
+      glVertexAttribPointer( 2, 2, GL_UNSIGNED_SHORT, GL_TRUE, n_bytes_per_vertex, bufferOffset( 4 * sizeof(uint16_t) ) );
+      glEnableVertexAttribArray( 2 );
+   }
+
+   // 16-bit indices halve the index buffer whenever the vertices allow it
+   glGenBuffers( 1, &ObjEBO );
+   glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ObjEBO );
+   if (vertices.size() <= 65536) {
+      IndexType = GL_UNSIGNED_SHORT;
+      const std::vector<uint16_t> short_indices(indices.begin(), indices.end());
+      glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * short_indices.size(), short_indices.data(), GL_STATIC_DRAW );
+   }
+   else {
+      IndexType = GL_UNSIGNED_INT;
+      glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof(uint) * indices.size(), indices.data(), GL_STATIC_DRAW );
+   }
+}
+
 void ObjectGL::prepareTexture2DFromFile(const std::string& file_name) const
 {
    const FREE_IMAGE_FORMAT format = FreeImage_GetFileType( file_name.c_str(), 0 );
@@ -83,7 +304,7 @@ void ObjectGL::prepareTexture2DFromFile(const std::string& file_name) const
    }
 }
 
-void ObjectGL::prepareTexture(int n_bytes_per_vertex, const std::string& texture_file_name)
+void ObjectGL::prepareTexture(const std::string& texture_file_name)
 {
    glGenTextures( 1, &TextureID );
    glActiveTexture( GL_TEXTURE0 + TextureID );
@@ -95,9 +316,6 @@ void ObjectGL::prepareTexture(int n_bytes_per_vertex, const std::string& texture
    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
-
-   glVertexAttribPointer( 2, 2, GL_FLOAT, GL_FALSE, n_bytes_per_vertex, bufferOffset( 3 * sizeof(GLfloat) ) );
-   glEnableVertexAttribArray( 2 );
 }
 
 void ObjectGL::setObject(GLenum draw_mode, const glm::vec3& color, const std::vector<glm::vec3>& vertices)
@@ -134,7 +352,170 @@ void ObjectGL::setObject(
    }
    const int n_bytes_per_vertex = 5 * sizeof(GLfloat);
    prepareVertexBuffer( n_bytes_per_vertex );
-   prepareTexture( n_bytes_per_vertex, texture_file_name );
+   glVertexAttribPointer( 2, 2, GL_FLOAT, GL_FALSE, n_bytes_per_vertex, bufferOffset( 3 * sizeof(GLfloat) ) );
+   glEnableVertexAttribArray( 2 );
+   prepareTexture( texture_file_name );
+}
+
+void ObjectGL::setIndexedObject(
+   const glm::vec3& color,
+   const std::vector<glm::vec3>& vertices,
+   const std::vector<uint>& indices
+)
+{
+   DrawMode = GL_TRIANGLES;
+   Colors = { color.r, color.g, color.b };
+   prepareQuantizedBuffers( vertices, {}, indices );
+}
+
+void ObjectGL::setIndexedObject(
+   const glm::vec3& color,
+   const std::vector<glm::vec3>& vertices,
+   const std::vector<glm::vec2>& textures,
+   const std::vector<uint>& indices,
+   const std::string& texture_file_name
+)
+{
+   DrawMode = GL_TRIANGLES;
+   Colors = { color.r, color.g, color.b };
+   prepareQuantizedBuffers( vertices, textures, indices );
+   prepareTexture( texture_file_name );
+}
+
+
+//------------------------------------------------------------------
+//
+// Geometry Arena Class
+//
+//------------------------------------------------------------------
+
+GeometryArenaGL::GeometryArenaGL() :
+   ArenaVAO( 0 ), VertexBuffer( 0 ), IndexBuffer( 0 ), CommandBuffer( 0 ), DrawDataBuffer( 0 ), MappedVertices( nullptr ),
+   MappedIndices( nullptr ), MappedCommands( nullptr ), MappedDrawData( nullptr ), MaxVertices( 0 ), MaxIndices( 0 ),
+   MaxDraws( 0 ), UsedVertices( 0 ), UsedIndices( 0 ), Slot( 0 ), DrawCount( 0 ), SlotFences{}
+{
+}
+
+void GeometryArenaGL::create(GLsizei max_vertices, GLsizei max_indices, GLsizei max_draws_per_batch)
+{
+   MaxVertices = max_vertices;
+   MaxIndices = max_indices;
+   MaxDraws = max_draws_per_batch;
+   UsedVertices = UsedIndices = 0;
+   Slot = 0;
+   DrawCount = 0;
+
+   // coherent mappings make every write visible to the commands issued after it, so nothing is ever flushed
+   const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+   const auto map = [flags](GLuint& buffer, GLenum target, GLsizeiptr size)
+   {
+      glGenBuffers( 1, &buffer );
+      glBindBuffer( target, buffer );
+      glBufferStorage( target, size, nullptr, flags );
+      return glMapBufferRange( target, 0, size, flags );
+   };
+
+   glGenVertexArrays( 1, &ArenaVAO );
+   glBindVertexArray( ArenaVAO );
+   MappedVertices = static_cast<glm::vec3*>(map( VertexBuffer, GL_ARRAY_BUFFER, sizeof(glm::vec3) * max_vertices ));
+   glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), nullptr );
+   glEnableVertexAttribArray( 0 );
+   MappedIndices = static_cast<uint*>(map( IndexBuffer, GL_ELEMENT_ARRAY_BUFFER, sizeof(uint) * max_indices ));
+   glBindVertexArray( 0 );
+
+   MappedCommands = static_cast<DrawCommand*>(
+      map( CommandBuffer, GL_DRAW_INDIRECT_BUFFER, sizeof(DrawCommand) * BatchSlots * max_draws_per_batch )
+   );
+   MappedDrawData = static_cast<DrawData*>(
+      map( DrawDataBuffer, GL_SHADER_STORAGE_BUFFER, sizeof(DrawData) * BatchSlots * max_draws_per_batch )
+   );
+   glBindBuffer( GL_ARRAY_BUFFER, 0 );
+   glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+   glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+}
+
+void GeometryArenaGL::destroy()
+{
+   for (auto& fence : SlotFences) {
+      if (fence != nullptr) glDeleteSync( fence );
+      fence = nullptr;
+   }
+   const GLuint buffers[4] = { VertexBuffer, IndexBuffer, CommandBuffer, DrawDataBuffer };
+   for (const auto& buffer : buffers) {
+      if (buffer != 0) glUnmapNamedBuffer( buffer );
+   }
+   glDeleteBuffers( 4, buffers );
+   glDeleteVertexArrays( 1, &ArenaVAO );
+   ArenaVAO = VertexBuffer = IndexBuffer = CommandBuffer = DrawDataBuffer = 0;
+   MappedVertices = nullptr;
+   MappedIndices = nullptr;
+   MappedCommands = nullptr;
+   MappedDrawData = nullptr;
+}
+
+bool GeometryArenaGL::allocate(Range& range, const std::vector<glm::vec3>& vertices, const std::vector<uint>& indices)
+{
+   const auto n_vertices = static_cast<GLsizei>(vertices.size());
+   const auto n_indices = static_cast<GLsizei>(indices.size());
+   if (n_vertices > MaxVertices - UsedVertices || n_indices > MaxIndices - UsedIndices) return false;
+
+   // the indices are stored after the vertices of the earlier meshes, so every draw has a zero base vertex
+   std::copy( vertices.begin(), vertices.end(), MappedVertices + UsedVertices );
+   for (GLsizei i = 0; i < n_indices; ++i) MappedIndices[UsedIndices + i] = indices[i] + static_cast<uint>(UsedVertices);
+   range.FirstIndex = static_cast<GLuint>(UsedIndices);
+   range.IndexCount = n_indices;
+   UsedVertices += n_vertices;
+   UsedIndices += n_indices;
+   return true;
+}
+
+void GeometryArenaGL::waitForSlot()
+{
+   GLsync& fence = SlotFences[Slot];
+   if (fence == nullptr) return;
+
+   while (glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000 ) == GL_TIMEOUT_EXPIRED) {}
+   glDeleteSync( fence );
+   fence = nullptr;
+}
+
+void GeometryArenaGL::beginDraws()
+{
+   DrawCount = 0;
+   waitForSlot();
+}
+
+void GeometryArenaGL::addDraw(const Range& range, const DrawData& data)
+{
+   if (DrawCount == MaxDraws) {
+      submitDraws();
+      waitForSlot();
+   }
+
+   const GLsizei draw = Slot * MaxDraws + DrawCount;
+   MappedCommands[draw] = { static_cast<GLuint>(range.IndexCount), 1, range.FirstIndex, 0, static_cast<GLuint>(draw) };
+   MappedDrawData[draw] = data;
+   DrawCount++;
+}
+
+void GeometryArenaGL::endDraws()
+{
+   if (DrawCount > 0) submitDraws();
+}
+
+void GeometryArenaGL::submitDraws()
+{
+   glBindVertexArray( ArenaVAO );
+   glBindBuffer( GL_DRAW_INDIRECT_BUFFER, CommandBuffer );
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, DrawDataBuffer );
+   const auto offset = static_cast<size_t>(Slot) * MaxDraws * sizeof(DrawCommand);
+   glMultiDrawElementsIndirect( GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const GLvoid*>(offset), DrawCount, 0 );
+   glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+   glBindVertexArray( 0 );
+
+   SlotFences[Slot] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+   Slot = (Slot + 1) % BatchSlots;
+   DrawCount = 0;
 }
 
 
@@ -145,8 +526,12 @@ void ObjectGL::setObject(
 //------------------------------------------------------------------
 
 VirtualFenceMakerGL::VirtualFenceMakerGL(float actual_width, float actual_height) :
-   RenderWindow( nullptr ), ClickedPoint( -1, -1 ), DrawFenceOnGroundOnly( false ), FenceMask( nullptr ),
-   ActualGroundWidth( actual_width ), ActualGroundHeight( actual_height ), FenceHeight( 20.0f ), FenceRadius( 20.0f )
+   RenderWindow( nullptr ), ClickedPoint( -1, -1 ), DrawFenceOnGroundOnly( false ), DrawFenceVolume( false ),
+   DrawFenceAnalytically( false ), FullDamage( true ), DamageRect( 0 ), SceneFramebuffer( 0 ), SceneRenderbuffers{ 0, 0 },
+   RenderThreadRunning( false ),
+   FenceMask( nullptr ), ActualGroundWidth( actual_width ), ActualGroundHeight( actual_height ), FenceHeight( 20.0f ),
+   FenceRadius( 20.0f ), MaxFencePixelError( 0.25f ), VolumeHeights{ 2.0f, 5.0f, 10.0f, 20.0f }, FenceLevels{},
+   FenceVolumeLevels{}, AnalyticFenceLocations{}
 {
    Renderer = this;
 
@@ -215,6 +600,7 @@ void VirtualFenceMakerGL::setCamera(
 
    MainCamera.CameraHeight = camera_height_in_meter;
    MainCamera.CameraPosition = glm::vec3(0.0f);
+   Terrain.setGroundLevel( camera_height_in_meter );
 
    MainCamera.PanningToCamera = glm::rotate( glm::mat4(1.0f), MainCamera.PanAngle, glm::vec3(0.0f, -1.0f, 0.0f) );
    MainCamera.TiltingToCamera = glm::rotate( glm::mat4(1.0f), MainCamera.TiltAngle, glm::vec3(1.0f, 0.0f, 0.0f) );
@@ -239,49 +625,289 @@ void VirtualFenceMakerGL::cleanup(GLFWwindow* window)
 {
    glDeleteProgram( GroundShader.ShaderProgram );
    glDeleteProgram( FenceShader.ShaderProgram );
+   glDeleteProgram( FenceVolumeShader.ShaderProgram );
+   glDeleteProgram( AnalyticFenceShader.ShaderProgram );
+   glDeleteProgram( FenceBatchShader.ShaderProgram );
 
    glDeleteVertexArrays( 1, &Ground.ObjVAO );
-   glDeleteVertexArrays( 1, &Fence.ObjVAO );
+   glDeleteVertexArrays( 1, &FenceQuad.ObjVAO );
+   glDeleteVertexArrays( 1, &Obstacle.ObjVAO );
    
    glDeleteBuffers( 1, &Ground.ObjVBO );
-   glDeleteBuffers( 1, &Fence.ObjVBO );
+   glDeleteBuffers( 1, &FenceQuad.ObjVBO );
+   glDeleteBuffers( 1, &Obstacle.ObjVBO );
+   glDeleteBuffers( 1, &Ground.ObjEBO );
+   glDeleteBuffers( 1, &Obstacle.ObjEBO );
+   FenceArena.destroy();
+   glDeleteFramebuffers( 1, &SceneFramebuffer );
+   glDeleteRenderbuffers( 2, SceneRenderbuffers );
+   SceneFramebuffer = 0;
 
    glfwSetWindowShouldClose( window, GLFW_TRUE );
+   RenderThreadRunning = false;
 }
 
 void VirtualFenceMakerGL::cleanupWrapper(GLFWwindow* window)
 {
-   Renderer->cleanup( window );
+   Renderer->postInputEvent( { InputEvent::Type::CLOSE, 0, 0, 0, 0.0, 0.0 } );
 }
 
-void VirtualFenceMakerGL::captureFenceMask() const
+void VirtualFenceMakerGL::captureFenceMask()
 {
    glPixelStorei( GL_PACK_ALIGNMENT, 1 );
    glReadBuffer( GL_BACK );
    glReadPixels( 0, 0, MainCamera.Width, MainCamera.Height, GL_RED, GL_UNSIGNED_BYTE, FenceMask );
 
-   const int size = MainCamera.Width * MainCamera.Height;
-   for (int i = 0; i < size; ++i) {
-      if (FenceMask[i] == 255) FenceMask[i] = 0;
-      else if (FenceMask[i] != 0) FenceMask[i] = 255;
-   }
-
-   FIBITMAP* fence_image = FreeImage_ConvertFromRawBits(
-      FenceMask,
-      MainCamera.Width,
-      MainCamera.Height,
-      MainCamera.Width,
-      8,
-      0, 
-      0, 
-      0,
-      false
+   const auto binarize = [](uint8_t& value)
+   {
+      if (value == 255) value = 0;
+      else if (value != 0) value = 255;
+   };
+   // flip rows from bottom-up to top-down so that the mask shares the image coordinates of the detections
+   for (int y = 0; y < (MainCamera.Height + 1) / 2; ++y) {
+      uint8_t* top_row = FenceMask + y * MainCamera.Width;
+      uint8_t* bottom_row = FenceMask + (MainCamera.Height - 1 - y) * MainCamera.Width;
+      for (int x = 0; x < MainCamera.Width; ++x) {
+         binarize( top_row[x] );
+         if (top_row != bottom_row) {
+            binarize( bottom_row[x] );
+            std::swap( top_row[x], bottom_row[x] );
+         }
+      }
+   }
+   FenceMaskIntegral.build( FenceMask, MainCamera.Width, MainCamera.Height );
+   BlobLabeler.setFenceMask( FenceMask, MainCamera.Width, MainCamera.Height );
+   MaskPyramid.build( FenceMask, MainCamera.Width, MainCamera.Height, 5, 32, FenceMaskPyramid::Reduction::ANY );
+
+   writeFenceMask( FenceMask, MainCamera.Width, MainCamera.Height, std::string(CMAKE_SOURCE_DIR) + "/fence_mask.png" );
+
+   std::vector<FencePolygon> fence_contours;
+   extractFenceContours( fence_contours, FenceMask, MainCamera.Width, MainCamera.Height );
+   simplifyFenceContours( fence_contours, 1.0f );
+   writeFenceContours( fence_contours, MainCamera.Width, MainCamera.Height, std::string(CMAKE_SOURCE_DIR) + "/fence_mask.vfc" );
+
+   GroundScale.build( getPinholeCamera() );
+   writeFloatMap(
+      GroundScale.getGroundSamplingDistances().data(), GroundScale.getWidth(), GroundScale.getHeight(),
+      std::string(CMAKE_SOURCE_DIR) + "/ground_sampling_distance.tif"
+   );
+   writeFloatMap(
+      GroundScale.getObjectHeights().data(), GroundScale.getWidth(), GroundScale.getHeight(),
+      std::string(CMAKE_SOURCE_DIR) + "/object_height.tif"
    );
-   FreeImage_Save( FIF_PNG, fence_image, std::string(std::string(CMAKE_SOURCE_DIR) + "/fence_mask.png").c_str() );
-   FreeImage_Unload( fence_image );
    std::cout << "Fence Mask Saved!\n";
 }
 
+void VirtualFenceMakerGL::captureFenceCoverage(int samples)
+{
+   GLint max_samples = 1;
+   glGetIntegerv( GL_MAX_SAMPLES, &max_samples );
+   samples = std::clamp( samples, 1, std::max( max_samples, 1 ) );
+
+   // the fence is drawn into a multisample buffer, and resolving it averages the samples into the coverage
+   GLuint renderbuffers[3];
+   GLuint framebuffers[2];
+   glGenRenderbuffers( 3, renderbuffers );
+   glGenFramebuffers( 2, framebuffers );
+   glBindRenderbuffer( GL_RENDERBUFFER, renderbuffers[0] );
+   glRenderbufferStorageMultisample( GL_RENDERBUFFER, samples, GL_R8, MainCamera.Width, MainCamera.Height );
+   glBindRenderbuffer( GL_RENDERBUFFER, renderbuffers[1] );
+   glRenderbufferStorage( GL_RENDERBUFFER, GL_R8, MainCamera.Width, MainCamera.Height );
+   glBindRenderbuffer( GL_RENDERBUFFER, renderbuffers[2] );
+   glRenderbufferStorageMultisample( GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, MainCamera.Width, MainCamera.Height );
+   glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+   glBindFramebuffer( GL_FRAMEBUFFER, framebuffers[1] );
+   glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[1] );
+   glBindFramebuffer( GL_FRAMEBUFFER, framebuffers[0] );
+   glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0] );
+   glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[2] );
+
+   glClearColor( 0.0f, 0.0f, 0.0f, 1.0f );
+   glClear( OPENGL_COLOR_BUFFER_BIT );
+   std::vector<GroundFence> fences;
+   getVisibleFences( fences, ViewFrustum(MainCamera.ProjectionMatrix * MainCamera.ViewMatrix), 0.0f );
+   if (!fences.empty()) {
+      prepareObstacleOcclusion();
+      if (DrawFenceAnalytically) {
+         // overlapping fences keep the larger coverage, as their union is at least as large as either of them
+         glEnable( GL_BLEND );
+         glBlendEquation( GL_MAX );
+         for (const auto& fence : fences) drawAnalyticFenceAtCenter( fence.Center, fence.Radius, glm::vec3(1.0f), true );
+         glBlendEquation( GL_FUNC_ADD );
+         glDisable( GL_BLEND );
+      }
+      else drawFences( fences, glm::vec3(1.0f), false, false );
+      glDisable( GL_DEPTH_TEST );
+      glUseProgram( 0 );
+   }
+
+   glBindFramebuffer( GL_READ_FRAMEBUFFER, framebuffers[0] );
+   glBindFramebuffer( GL_DRAW_FRAMEBUFFER, framebuffers[1] );
+   glBlitFramebuffer(
+      0, 0, MainCamera.Width, MainCamera.Height,
+      0, 0, MainCamera.Width, MainCamera.Height,
+      OPENGL_COLOR_BUFFER_BIT, GL_NEAREST
+   );
+
+   std::vector<uint8_t> coverage(static_cast<size_t>(MainCamera.Width) * MainCamera.Height);
+   glBindFramebuffer( GL_READ_FRAMEBUFFER, framebuffers[1] );
+   glReadBuffer( GL_COLOR_ATTACHMENT0 );
+   glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+   glReadPixels( 0, 0, MainCamera.Width, MainCamera.Height, GL_RED, GL_UNSIGNED_BYTE, coverage.data() );
+
+   glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+   glDeleteFramebuffers( 2, framebuffers );
+   glDeleteRenderbuffers( 3, renderbuffers );
+   glClearColor( 1.0f, 1.0f, 1.0f, 1.0f );
+
+   for (int y = 0; y < MainCamera.Height / 2; ++y) {
+      uint8_t* top_row = coverage.data() + static_cast<size_t>(y) * MainCamera.Width;
+      uint8_t* bottom_row = coverage.data() + static_cast<size_t>(MainCamera.Height - 1 - y) * MainCamera.Width;
+      std::swap_ranges( top_row, top_row + MainCamera.Width, bottom_row );
+   }
+   writeFenceMask( coverage.data(), MainCamera.Width, MainCamera.Height, std::string(CMAKE_SOURCE_DIR) + "/fence_coverage.png" );
+   std::cout << "Fence Coverage Saved! (" << samples << " samples per pixel)\n";
+}
+
+void VirtualFenceMakerGL::computeFenceCoverage(int samples_per_axis) const
+{
+   std::vector<GroundFence> fences;
+   getVisibleFences( fences, ViewFrustum(getPinholeCamera()), 0.0f );
+
+   FenceRasterizer rasterizer;
+   rasterizer.setCamera( getPinholeCamera() );
+   std::vector<uint8_t> coverage;
+   rasterizer.getCoverage( coverage, fences, samples_per_axis );
+   ObstacleHierarchy.removeOccludedPixels( coverage.data(), getPinholeCamera(), Terrain );
+   writeFenceMask( coverage.data(), MainCamera.Width, MainCamera.Height, std::string(CMAKE_SOURCE_DIR) + "/fence_coverage.png" );
+   std::cout << "Fence Coverage Saved! (" << samples_per_axis * samples_per_axis << " samples per pixel)\n";
+}
+
+void VirtualFenceMakerGL::setVolumeHeights(const std::vector<float>& heights)
+{
+   VolumeHeights.assign( heights.begin(), heights.begin() + std::min( static_cast<int>(heights.size()), MaxVolumeLayers ) );
+}
+
+float VirtualFenceMakerGL::getMaxVolumeHeight() const
+{
+   return VolumeHeights.empty() ? 0.0f : *std::max_element( VolumeHeights.begin(), VolumeHeights.end() );
+}
+
+void VirtualFenceMakerGL::writeFenceVolumeMasks(const std::vector<std::vector<uint8_t>>& masks) const
+{
+   for (size_t k = 0; k < masks.size(); ++k) {
+      const std::string file_name = "fence_volume_" + std::to_string( k ) + ".png";
+      writeFenceMask( masks[k].data(), MainCamera.Width, MainCamera.Height, std::string(CMAKE_SOURCE_DIR) + "/" + file_name );
+      std::cout << file_name << ": objects up to " << VolumeHeights[k] << " tall\n";
+   }
+}
+
+void VirtualFenceMakerGL::captureFenceVolumeMasks()
+{
+   const auto n_layers = static_cast<GLsizei>(VolumeHeights.size());
+   if (n_layers == 0) return;
+
+   // every instance draws the volume for one height into its own layer of the texture array
+   GLuint texture, framebuffer;
+   glGenTextures( 1, &texture );
+   glBindTexture( GL_TEXTURE_2D_ARRAY, texture );
+   glTexStorage3D( GL_TEXTURE_2D_ARRAY, 1, GL_R8, MainCamera.Width, MainCamera.Height, n_layers );
+   GLuint depth_texture;
+   glGenTextures( 1, &depth_texture );
+   glBindTexture( GL_TEXTURE_2D_ARRAY, depth_texture );
+   glTexStorage3D( GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT24, MainCamera.Width, MainCamera.Height, n_layers );
+   glGenFramebuffers( 1, &framebuffer );
+   glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+   glFramebufferTexture( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0 );
+   glFramebufferTexture( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth_texture, 0 );
+
+   glClearColor( 0.0f, 0.0f, 0.0f, 1.0f );
+   glClear( OPENGL_COLOR_BUFFER_BIT | OPENGL_DEPTH_BUFFER_BIT );
+   std::vector<GroundFence> fences;
+   getVisibleFences(
+      fences, ViewFrustum(MainCamera.ProjectionMatrix * MainCamera.ViewMatrix),
+      getMaxVolumeHeight()
+   );
+   if (!fences.empty()) {
+      const GLint object_heights_location = glGetUniformLocation( FenceVolumeShader.ShaderProgram, "ObjectHeights" );
+      glUseProgram( FenceVolumeShader.ShaderProgram );
+      glEnable( GL_DEPTH_TEST );
+      if (Obstacle.VerticesCount > 0) {
+         // the obstacles go into the depth of every layer, where a unit height keeps them as they are
+         const glm::mat4 obstacle_view_projection =
+            MainCamera.ProjectionMatrix * MainCamera.ViewMatrix * Obstacle.DequantizationMatrix;
+         const std::vector<float> unit_heights(n_layers, 1.0f);
+         glUniformMatrix4fv( FenceVolumeShader.MVPLocation, 1, GL_FALSE, &obstacle_view_projection[0][0] );
+         glUniform1fv( object_heights_location, n_layers, unit_heights.data() );
+         glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+         glBindVertexArray( Obstacle.ObjVAO );
+         glDrawElementsInstanced( Obstacle.DrawMode, Obstacle.IndicesCount, Obstacle.IndexType, nullptr, n_layers );
+         glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+      }
+
+      glUniform1fv( object_heights_location, n_layers, VolumeHeights.data() );
+      glBindVertexArray( FenceArena.ArenaVAO );
+      const float max_height = getMaxVolumeHeight();
+      for (const auto& fence : fences) {
+         const int level = getFenceSegmentLevel( fence.Center, fence.Radius, max_height );
+         const glm::mat4 model_view_projection = MainCamera.ProjectionMatrix * MainCamera.ViewMatrix *
+            scale( translate( glm::mat4(1.0f), fence.Center ), glm::vec3(fence.Radius, 1.0f, fence.Radius) );
+         glUniformMatrix4fv( FenceVolumeShader.MVPLocation, 1, GL_FALSE, &model_view_projection[0][0] );
+         const GeometryArenaGL::Range& range = FenceVolumeLevels[level];
+         glDrawElementsInstanced(
+            GL_TRIANGLES, range.IndexCount, GL_UNSIGNED_INT,
+            reinterpret_cast<const GLvoid*>(range.FirstIndex * sizeof(uint)), n_layers
+         );
+      }
+      glBindVertexArray( 0 );
+      glDisable( GL_DEPTH_TEST );
+      glUseProgram( 0 );
+   }
+   glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+   glClearColor( 1.0f, 1.0f, 1.0f, 1.0f );
+
+   const size_t size = static_cast<size_t>(MainCamera.Width) * MainCamera.Height;
+   std::vector<uint8_t> layers(size * n_layers);
+   glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+   glGetTextureImage( texture, 0, GL_RED, GL_UNSIGNED_BYTE, static_cast<GLsizei>(layers.size()), layers.data() );
+   glDeleteFramebuffers( 1, &framebuffer );
+   glDeleteTextures( 1, &texture );
+   glDeleteTextures( 1, &depth_texture );
+
+   std::vector<std::vector<uint8_t>> masks(n_layers);
+   for (GLsizei k = 0; k < n_layers; ++k) {
+      masks[k].resize( size );
+      for (int y = 0; y < MainCamera.Height; ++y) {
+         std::memcpy(
+            masks[k].data() + static_cast<size_t>(y) * MainCamera.Width,
+            layers.data() + k * size + static_cast<size_t>(MainCamera.Height - 1 - y) * MainCamera.Width,
+            MainCamera.Width
+         );
+      }
+   }
+   writeFenceVolumeMasks( masks );
+}
+
+void VirtualFenceMakerGL::computeFenceVolumeMasks() const
+{
+   std::vector<GroundFence> fences;
+   getVisibleFences( fences, ViewFrustum(getPinholeCamera()), getMaxVolumeHeight() );
+
+   FenceRasterizer rasterizer;
+   rasterizer.setCamera( getPinholeCamera() );
+   std::vector<std::vector<uint8_t>> masks;
+   rasterizer.getVolumeMasks( masks, fences, VolumeHeights );
+   if (!ObstacleHierarchy.empty() && !masks.empty()) {
+      // the mask of the tallest objects holds every pixel that sees a volume at all, so only its rays are cast,
+      // and the masks are swept again with each volume ending at the first obstacle in front of it
+      const auto tallest = std::max_element( VolumeHeights.begin(), VolumeHeights.end() ) - VolumeHeights.begin();
+      std::vector<float> obstacle_distances;
+      ObstacleHierarchy.getObstacleDistances( obstacle_distances, masks[tallest].data(), getPinholeCamera() );
+      rasterizer.getVolumeMasks( masks, fences, VolumeHeights, obstacle_distances.data() );
+   }
+   writeFenceVolumeMasks( masks );
+}
+
 void VirtualFenceMakerGL::keyboard(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
    if (action != GLFW_PRESS) return;
@@ -293,36 +919,106 @@ void VirtualFenceMakerGL::keyboard(GLFWwindow* window, int key, int scancode, in
          captureFenceMask();
          DrawFenceOnGroundOnly = false;
          break;
+      case GLFW_KEY_A:
+         captureFenceCoverage( 16 );
+         break;
+      case GLFW_KEY_S:
+         computeFenceCoverage( 4 );
+         break;
+      case GLFW_KEY_V:
+         DrawFenceVolume = !DrawFenceVolume;
+         break;
+      case GLFW_KEY_H:
+         captureFenceVolumeMasks();
+         break;
+      case GLFW_KEY_J:
+         computeFenceVolumeMasks();
+         break;
       case GLFW_KEY_R:
          DrawFenceOnGroundOnly = !DrawFenceOnGroundOnly;
          break;
+      case GLFW_KEY_E:
+         DrawFenceAnalytically = !DrawFenceAnalytically;
+         break;
+      case GLFW_KEY_P:
+         pinFence();
+         break;
+      case GLFW_KEY_X:
+         setPinnedFences( {} );
+         break;
       case GLFW_KEY_Q:
       case GLFW_KEY_ESCAPE:
-         cleanupWrapper( RenderWindow );
+         cleanup( RenderWindow );
          break;
       default:
          return;
    }
+   // the keys toggle how everything is drawn, or draw into the window for a capture
+   damageAll();
 }
 
 void VirtualFenceMakerGL::keyboardWrapper(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-   Renderer->keyboard( window, key, scancode, action, mods );
+   Renderer->postInputEvent( { InputEvent::Type::KEY, key, action, mods, 0.0, 0.0 } );
 }
 
-void VirtualFenceMakerGL::mouse(GLFWwindow* window, int button, int action, int mods)
+void VirtualFenceMakerGL::mouse(GLFWwindow* window, int button, int action, int mods, double x, double y)
 {
    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
-      double x, y;
-      glfwGetCursorPos( RenderWindow, &x, &y );
+      GroundFence fence;
+      if (getClickedFence( fence )) damageFence( fence );
+
       ClickedPoint.x = static_cast<int>(round( x ));
       ClickedPoint.y = static_cast<int>(round( y ));
+      if (getClickedFence( fence )) damageFence( fence );
    }
 }
 
 void VirtualFenceMakerGL::mouseWrapper(GLFWwindow* window, int button, int action, int mods)
 {
-   Renderer->mouse( window, button, action, mods );
+   // the cursor can be read only on the main thread, so the event carries where it was at the click
+   double x, y;
+   glfwGetCursorPos( window, &x, &y );
+   Renderer->postInputEvent( { InputEvent::Type::MOUSE_BUTTON, button, action, mods, x, y } );
+}
+
+void VirtualFenceMakerGL::getVisibleFences(std::vector<GroundFence>& fences, const ViewFrustum& frustum, float height) const
+{
+   std::vector<int> visible;
+   PinnedFenceIndex.getVisibleFences( visible, frustum, height );
+   fences.clear();
+   for (const auto& index : visible) fences.emplace_back( PinnedFences[index] );
+
+   GroundFence clicked_fence;
+   if (getClickedFence( clicked_fence )) fences.emplace_back( clicked_fence );
+}
+
+bool VirtualFenceMakerGL::getClickedFence(GroundFence& fence) const
+{
+   // the clicked point is on the top of the fence, whose center then goes down to the ground surface
+   glm::vec3 fence_center;
+   if (ClickedPoint.x < 0 || !getWorldPoint( fence_center, FenceHeight )) return false;
+
+   fence_center.y = Terrain.getSurfaceY( fence_center.x, fence_center.z );
+   fence = GroundFence(fence_center, FenceRadius, 255);
+   return true;
+}
+
+void VirtualFenceMakerGL::pinFence()
+{
+   GroundFence fence;
+   if (!getClickedFence( fence )) return;
+
+   PinnedFences.emplace_back( fence );
+   PinnedFenceIndex.build( PinnedFences );
+   ClickedPoint = glm::ivec2(-1, -1);
+}
+
+void VirtualFenceMakerGL::setPinnedFences(const std::vector<GroundFence>& fences)
+{
+   PinnedFences = fences;
+   PinnedFenceIndex.build( PinnedFences );
+   damageAll();
 }
 
 void VirtualFenceMakerGL::updateFenceHeight(double mouse_wheel_y_offset)
@@ -349,18 +1045,23 @@ void VirtualFenceMakerGL::updateFenceRadius(double mouse_wheel_y_offset)
    }
 }
 
-void VirtualFenceMakerGL::mousewheel(GLFWwindow* window, double xoffset, double yoffset)
+void VirtualFenceMakerGL::mousewheel(GLFWwindow* window, double xoffset, double yoffset, int mods)
 {
+   // the damage of the clicked fence is left to processInputEvents, which takes a whole burst of wheel steps at once,
+   // but the pinned fences are drawn up to the fence height as well, so a height change damages all of them
    if (ClickedPoint.x >= 0) {
-      const int state = glfwGetKey( RenderWindow, GLFW_KEY_LEFT_CONTROL );
-      if (state == GLFW_PRESS) updateFenceHeight( yoffset );
+      if ((mods & GLFW_MOD_CONTROL) != 0) {
+         updateFenceHeight( yoffset );
+         if (!PinnedFences.empty()) damageAll();
+      }
       else updateFenceRadius( yoffset );
    }
 }
 
 void VirtualFenceMakerGL::mousewheelWrapper(GLFWwindow* window, double xoffset, double yoffset)
 {
-   Renderer->mousewheel( window, xoffset, yoffset );
+   const int mods = glfwGetKey( window, GLFW_KEY_LEFT_CONTROL ) == GLFW_PRESS ? GLFW_MOD_CONTROL : 0;
+   Renderer->postInputEvent( { InputEvent::Type::MOUSE_WHEEL, 0, 0, mods, xoffset, yoffset } );
 }
 
 void VirtualFenceMakerGL::reshape(GLFWwindow* window, int width, int height)
@@ -368,11 +1069,23 @@ void VirtualFenceMakerGL::reshape(GLFWwindow* window, int width, int height)
    MainCamera.Width = width;
    MainCamera.Height = height;
    glViewport( 0, 0, width, height );
+   prepareSceneFramebuffer();
+   damageAll();
 }
 
 void VirtualFenceMakerGL::reshapeWrapper(GLFWwindow* window, int width, int height)
 {
-   Renderer->reshape( window, width, height );
+   Renderer->postInputEvent( { InputEvent::Type::RESIZE, 0, 0, 0, static_cast<double>(width), static_cast<double>(height) } );
+}
+
+void VirtualFenceMakerGL::refresh(GLFWwindow* window)
+{
+   damageAll();
+}
+
+void VirtualFenceMakerGL::refreshWrapper(GLFWwindow* window)
+{
+   Renderer->postInputEvent( { InputEvent::Type::REFRESH, 0, 0, 0, 0.0, 0.0 } );
 }
 
 void VirtualFenceMakerGL::error(int error, const char* description) const
@@ -393,6 +1106,7 @@ void VirtualFenceMakerGL::registerCallbacks() const
    glfwSetMouseButtonCallback( RenderWindow, mouseWrapper );
    glfwSetScrollCallback( RenderWindow, mousewheelWrapper );
    glfwSetFramebufferSizeCallback( RenderWindow, reshapeWrapper );
+   glfwSetWindowRefreshCallback( RenderWindow, refreshWrapper );
 }
 
 void VirtualFenceMakerGL::setGroundShader()
@@ -450,85 +1164,334 @@ void VirtualFenceMakerGL::setFenceShader()
    FenceShader.setShader( vertex_source, fragment_source );
 }
 
+void VirtualFenceMakerGL::setAnalyticFenceShader()
+{
+   // the quad spans ScreenRect, and its depth comes from the ground point of every pixel instead
+   const GLchar* const vertex_source = {
+      "#version 460                                                                  \n"
+      "uniform vec4 ScreenRect;                                                      \n"
+      "layout (location = 0) in vec4 v_position;                                     \n"
+      "void main(void) {                                                             \n"
+      "	gl_Position = vec4( mix( ScreenRect.xy, ScreenRect.zw, v_position.xy ), 0.0f, 1.0f ); \n"
+      "}                                                                             \n"
+   };
+   const GLchar* const fragment_source = {
+      "#version 460                                                                \n"
+      "uniform mat4 ViewProjectionMatrix;                                          \n"
+      "uniform mat4 InverseViewProjectionMatrix;                                   \n"
+      "uniform vec3 CameraPosition;                                                \n"
+      "uniform vec2 ViewportSize;                                                  \n"
+      "uniform vec3 FenceCenter;                                                   \n"
+      "uniform float FenceRadius;                                                  \n"
+      "uniform vec3 PrimitiveColor;                                                \n"
+      "uniform bool WriteCoverage;                                                 \n"
+      "layout (location = 0) out vec4 final_color;                                 \n"
+      "float getSignedDistance(vec2 point) {                                       \n"
+      "	return length( point - FenceCenter.xz ) - FenceRadius;                    \n"
+      "}                                                                           \n"
+      "void main(void) {                                                           \n"
+      "	vec2 ndc = gl_FragCoord.xy / ViewportSize * 2.0f - 1.0f;                  \n"
+      "	vec4 near_point = InverseViewProjectionMatrix * vec4( ndc, -1.0f, 1.0f ); \n"
+      "	vec3 direction = near_point.xyz / near_point.w - CameraPosition;          \n"
+      "	float t = (FenceCenter.y - CameraPosition.y) / direction.y;               \n"
+      "	vec3 ground_point = CameraPosition + t * direction;                       \n"
+      "	float signed_distance = getSignedDistance( ground_point.xz );             \n"
+      "	float pixel_size = length( vec2(dFdx( signed_distance ), dFdy( signed_distance )) ); \n"
+      "	vec4 clip_point = ViewProjectionMatrix * vec4( ground_point, 1.0f );      \n"
+      "	if (!(t > 0.0f) || clip_point.z > clip_point.w) discard;                  \n"
+      "	float coverage = clamp( 0.5f - signed_distance / max( pixel_size, 1e-6f ), 0.0f, 1.0f ); \n"
+      "	if (WriteCoverage) {                                                      \n"
+      "		if (coverage <= 0.0f) discard;                                         \n"
+      "		final_color = vec4( PrimitiveColor * coverage, 1.0f );                 \n"
+      "	}                                                                         \n"
+      "	else {                                                                    \n"
+      "		if (signed_distance > 0.0f) discard;                                   \n"
+      "		final_color = vec4( PrimitiveColor, 1.0f );                            \n"
+      "	}                                                                         \n"
+      "	gl_FragDepth = clip_point.z / clip_point.w * 0.5f + 0.5f;                 \n"
+      "}                                                                           \n"
+   };
+
+   AnalyticFenceShader.setShader( vertex_source, fragment_source );
+}
+
+void VirtualFenceMakerGL::setFenceBatchShader()
+{
+   const GLchar* const vertex_source = {
+      "#version 460                                                                  \n"
+      "struct FenceDraw {                                                            \n"
+      "	mat4 ModelViewProjectionMatrix;                                             \n"
+      "	vec4 Color;                                                                 \n"
+      "};                                                                            \n"
+      "layout (std430, binding = 0) readonly buffer FenceDraws { FenceDraw Draws[]; }; \n"
+      "layout (location = 0) in vec4 v_position;                                     \n"
+      "out vec4 color;                                                               \n"
+      "void main(void) {                                                             \n"
+      "	color = Draws[gl_BaseInstance].Color;                                       \n"
+      "	gl_Position = Draws[gl_BaseInstance].ModelViewProjectionMatrix * v_position; \n"
+      "}                                                                             \n"
+   };
+   const GLchar* const fragment_source = {
+      "#version 460                                \n"
+      "in vec4 color;                              \n"
+      "layout (location = 0) out vec4 final_color; \n"
+      "void main(void) {                           \n"
+      "	final_color = color;                      \n"
+      "}                                           \n"
+   };
+
+   FenceBatchShader.setShader( vertex_source, fragment_source );
+}
+
+void VirtualFenceMakerGL::setFenceVolumeShader()
+{
+   const GLchar* const vertex_source = {
+      "#version 460                                                       \n"
+      "uniform mat4 ModelViewProjectionMatrix;                            \n"
+      "uniform float ObjectHeights[16];                                   \n"
+      "layout (location = 0) in vec4 v_position;                          \n"
+      "out int layer;                                                     \n"
+      "void main(void) {                                                  \n"
+      "	const float height = ObjectHeights[gl_InstanceID];               \n"
+      "	layer = gl_InstanceID;                                           \n"
+      "	gl_Position = ModelViewProjectionMatrix *                        \n"
+      "		vec4( v_position.x, v_position.y * height, v_position.z, 1.0f ); \n"
+      "}                                                                  \n"
+   };
+   const GLchar* const geometry_source = {
+      "#version 460                                          \n"
+      "layout (triangles) in;                                \n"
+      "layout (triangle_strip, max_vertices = 3) out;        \n"
+      "in int layer[];                                       \n"
+      "void main(void) {                                     \n"
+      "	for (int i = 0; i < 3; ++i) {                       \n"
+      "		gl_Layer = layer[i];                             \n"
+      "		gl_Position = gl_in[i].gl_Position;              \n"
+      "		EmitVertex();                                    \n"
+      "	}                                                   \n"
+      "	EndPrimitive();                                     \n"
+      "}                                                     \n"
+   };
+   const GLchar* const fragment_source = {
+      "#version 460                                \n"
+      "layout (location = 0) out vec4 final_color; \n"
+      "void main(void) {                           \n"
+      "	final_color = vec4( 1.0f );               \n"
+      "}                                           \n"
+   };
+
+   FenceVolumeShader.setShader( vertex_source, fragment_source, geometry_source );
+}
+
 void VirtualFenceMakerGL::setFenceObject()
 {
-   const glm::vec3 fence_color = { 0.5f, 0.125f, 0.9f };
-   std::vector<glm::vec3> fence_vertices;
-   fence_vertices.emplace_back( 0.0f, 0.0f, 0.0f );
-   for (int theta = 0; theta <= 360; theta += 5) {
-      const auto rad = glm::radians( static_cast<float>(theta) );
-      fence_vertices.emplace_back( cosf( rad ), 0.0f, sinf( rad ) );
+   // every level is a disc of its own in the arena, and a draw picks one by its index range
+   for (int level = 0; level < FenceSegmentLevels; ++level) {
+      const int segments = MinFenceSegments << level;
+      std::vector<glm::vec3> fence_vertices;
+      std::vector<uint> fence_indices;
+      fence_vertices.emplace_back( 0.0f, 0.0f, 0.0f );
+      for (int i = 0; i < segments; ++i) {
+         const float rad = glm::two_pi<float>() * static_cast<float>(i) / static_cast<float>(segments);
+         fence_vertices.emplace_back( cosf( rad ), 0.0f, sinf( rad ) );
+         fence_indices.insert( fence_indices.end(), { 0, static_cast<uint>(i + 1), static_cast<uint>((i + 1) % segments + 1) } );
+      }
+      FenceArena.allocate( FenceLevels[level], fence_vertices, fence_indices );
+   }
+}
+
+void VirtualFenceMakerGL::setFenceVolumeObject()
+{
+   // unit cylinders standing on y = 0 and reaching y = -1, which is up in the world coordinates
+   for (int level = 0; level < FenceSegmentLevels; ++level) {
+      const int segments = MinFenceSegments << level;
+      std::vector<glm::vec3> volume_vertices;
+      std::vector<uint> volume_indices;
+      const auto bottom_center = static_cast<uint>(2 * segments);
+      const uint top_center = bottom_center + 1;
+      for (int i = 0; i < segments; ++i) {
+         const float rad = glm::two_pi<float>() * static_cast<float>(i) / static_cast<float>(segments);
+         volume_vertices.emplace_back( cosf( rad ), 0.0f, sinf( rad ) );
+         volume_vertices.emplace_back( cosf( rad ), -1.0f, sinf( rad ) );
+      }
+      volume_vertices.emplace_back( 0.0f, 0.0f, 0.0f );
+      volume_vertices.emplace_back( 0.0f, -1.0f, 0.0f );
+      for (int i = 0; i < segments; ++i) {
+         const auto bottom0 = static_cast<uint>(2 * i);
+         const auto bottom1 = static_cast<uint>(2 * ((i + 1) % segments));
+         const uint top0 = bottom0 + 1, top1 = bottom1 + 1;
+         volume_indices.insert( volume_indices.end(), { bottom0, bottom1, top0, top0, bottom1, top1 } );
+         volume_indices.insert( volume_indices.end(), { bottom_center, bottom0, bottom1 } );
+         volume_indices.insert( volume_indices.end(), { top_center, top0, top1 } );
+      }
+      FenceArena.allocate( FenceVolumeLevels[level], volume_vertices, volume_indices );
    }
-   Fence.setObject( GL_TRIANGLE_FAN, fence_color, fence_vertices );
+}
+
+void VirtualFenceMakerGL::setFenceQuadObject()
+{
+   const std::vector<glm::vec3> quad_vertices = {
+      { 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 1.0f, 1.0f, 0.0f }
+   };
+   FenceQuad.setObject( GL_TRIANGLE_STRIP, DefaultFenceColor, quad_vertices );
 }
 
 void VirtualFenceMakerGL::setGroundObject()
 {
    const glm::vec3 ground_color = { 0.0f, 1.0f, 0.0f };
+   if (!Terrain.empty()) {
+      std::vector<glm::vec3> terrain_vertices;
+      std::vector<glm::vec2> terrain_textures;
+      std::vector<uint> terrain_indices;
+      Terrain.getTriangles( terrain_vertices, terrain_textures, terrain_indices );
+      optimizeVertexFetch( terrain_vertices, terrain_textures, terrain_indices );
+      Ground.setIndexedObject(
+         ground_color,
+         terrain_vertices,
+         terrain_textures,
+         terrain_indices,
+         std::string(CMAKE_SOURCE_DIR) + "/ground.jpg"
+      );
+      return;
+   }
+
    const std::vector<glm::vec3> ground_vertices = {
       glm::vec3(0.0f, MainCamera.CameraHeight, 0.0f),
       glm::vec3(0.0f, MainCamera.CameraHeight, ActualGroundWidth),
       glm::vec3(ActualGroundHeight, MainCamera.CameraHeight, 0.0f),
-      glm::vec3(ActualGroundHeight, MainCamera.CameraHeight, 0.0f),
-      glm::vec3(0.0f, MainCamera.CameraHeight, ActualGroundWidth),
       glm::vec3(ActualGroundHeight, MainCamera.CameraHeight, ActualGroundWidth)
    };
    const std::vector<glm::vec2> ground_textures = {
       glm::vec2(0.0f, 1.0f),
       glm::vec2(1.0f, 1.0f),
       glm::vec2(0.0f, 0.0f),
-      glm::vec2(0.0f, 0.0f),
-      glm::vec2(1.0f, 1.0f),
       glm::vec2(1.0f, 0.0f)
    };
-   Ground.setObject( 
-      GL_TRIANGLES, 
+   const std::vector<uint> ground_indices = { 0, 1, 2, 2, 1, 3 };
+   Ground.setIndexedObject( 
       ground_color, 
       ground_vertices, 
       ground_textures, 
+      ground_indices,
       std::string(CMAKE_SOURCE_DIR) + "/ground.jpg" 
    );
 }
 
+bool VirtualFenceMakerGL::loadTerrain(const std::string& file_path)
+{
+   if (!Terrain.load( file_path, glm::vec2(ActualGroundHeight, ActualGroundWidth) )) return false;
+
+   glDeleteVertexArrays( 1, &Ground.ObjVAO );
+   glDeleteBuffers( 1, &Ground.ObjVBO );
+   glDeleteBuffers( 1, &Ground.ObjEBO );
+   glDeleteTextures( 1, &Ground.TextureID );
+   Ground = ObjectGL();
+   setGroundObject();
+   return true;
+}
+
+bool VirtualFenceMakerGL::loadObstacles(const std::string& file_path)
+{
+   std::vector<glm::vec3> vertices;
+   std::vector<uint> indices;
+   if (!readMesh( vertices, indices, file_path )) return false;
+
+   for (auto& vertex : vertices) vertex.y = MainCamera.CameraHeight - vertex.y;
+   ObstacleHierarchy.build( vertices, indices );
+
+   // the obstacles are drawn into the depth before every fence, so they get the cheapest vertex and pixel work
+   std::vector<glm::vec2> no_textures;
+   optimizeVertexCache( indices, vertices.size() );
+   optimizeOverdraw( indices, vertices, 1.05f );
+   optimizeVertexFetch( vertices, no_textures, indices );
+   glDeleteVertexArrays( 1, &Obstacle.ObjVAO );
+   glDeleteBuffers( 1, &Obstacle.ObjVBO );
+   glDeleteBuffers( 1, &Obstacle.ObjEBO );
+   Obstacle = ObjectGL();
+   Obstacle.setIndexedObject( glm::vec3(0.5f), vertices, indices );
+   return true;
+}
+
+void VirtualFenceMakerGL::setShaders()
+{
+   const auto start = std::chrono::steady_clock::now();
+   const bool parallel = ShaderGL::enableParallelCompile();
+   setGroundShader();
+   setFenceShader();
+   setFenceVolumeShader();
+   setAnalyticFenceShader();
+   setFenceBatchShader();
+
+   // every program is waited for only after all of them started, so they compile at the same time
+   ShaderGL* const shaders[] = { &GroundShader, &FenceShader, &FenceVolumeShader, &AnalyticFenceShader, &FenceBatchShader };
+   int cached = 0;
+   for (const auto& shader : shaders) {
+      shader->finishShader();
+      if (shader->isLoadedFromCache()) cached++;
+   }
+   const GLuint analytic_program = AnalyticFenceShader.ShaderProgram;
+   AnalyticFenceLocations.ScreenRect = glGetUniformLocation( analytic_program, "ScreenRect" );
+   AnalyticFenceLocations.ViewProjectionMatrix = glGetUniformLocation( analytic_program, "ViewProjectionMatrix" );
+   AnalyticFenceLocations.InverseViewProjectionMatrix =
+      glGetUniformLocation( analytic_program, "InverseViewProjectionMatrix" );
+   AnalyticFenceLocations.CameraPosition = glGetUniformLocation( analytic_program, "CameraPosition" );
+   AnalyticFenceLocations.ViewportSize = glGetUniformLocation( analytic_program, "ViewportSize" );
+   AnalyticFenceLocations.FenceCenter = glGetUniformLocation( analytic_program, "FenceCenter" );
+   AnalyticFenceLocations.FenceRadius = glGetUniformLocation( analytic_program, "FenceRadius" );
+   AnalyticFenceLocations.WriteCoverage = glGetUniformLocation( analytic_program, "WriteCoverage" );
+   const auto end = std::chrono::steady_clock::now();
+   std::cout << "Shaders ready in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms ("
+      << cached << " of " << std::size( shaders ) << " from the cache" << (parallel ? ", compiled in parallel" : "") << ")\n";
+}
+
 void VirtualFenceMakerGL::initialize()
 {
    initializeOpenGL();
    registerCallbacks();
 
-   setGroundShader();
-   setFenceShader();
+   setShaders();
    setGroundObject();
+   FenceArena.create( 1 << 16, 1 << 18, 4096 );
    setFenceObject();
+   setFenceVolumeObject();
+   setFenceQuadObject();
+   prepareSceneFramebuffer();
 }
 
-bool VirtualFenceMakerGL::getWorldPoint(glm::vec3& fence_center, float height_from_ground) const
+PinholeCamera VirtualFenceMakerGL::getPinholeCamera() const
 {
-   const auto x = static_cast<float>(ClickedPoint.x);
-   const auto y = static_cast<float>(ClickedPoint.y);
-   const auto half_width = static_cast<float>(MainCamera.Width) * 0.5f;
-   const auto half_height = static_cast<float>(MainCamera.Height) * 0.5f;
-   const float sin_tilt = sinf( MainCamera.TiltAngle );
-   const float cos_tilt = cosf( MainCamera.TiltAngle );
-   const float f_mul_sin_tilt = MainCamera.FocalLength * sin_tilt;
-
-   glm::vec3 ground_point;
-   ground_point.z = f_mul_sin_tilt + (y - half_height) * cos_tilt;
-
-   if (ground_point.z <= 0.0 || MainCamera.CameraHeight < height_from_ground) return false;
+   PinholeCamera camera;
+   camera.Width = MainCamera.Width;
+   camera.Height = MainCamera.Height;
+   camera.FocalLength = MainCamera.FocalLength;
+   camera.TiltAngle = MainCamera.TiltAngle;
+   camera.CameraHeight = MainCamera.CameraHeight;
+   camera.ToWorldCoordinate = MainCamera.ToWorldCoordinate;
+   return camera;
+}
 
-   ground_point.z = (MainCamera.CameraHeight - height_from_ground) / ground_point.z;
-   ground_point.x = (x - half_width) * ground_point.z;
-   ground_point.y = (y - half_height) * ground_point.z;
-   ground_point.z = MainCamera.FocalLength * ground_point.z;
+bool VirtualFenceMakerGL::getWorldPoint(glm::vec3& fence_center, float height_from_ground) const
+{
+   const glm::vec2 clicked_point(static_cast<float>(ClickedPoint.x), static_cast<float>(ClickedPoint.y));
+   if (Terrain.empty()) return getPinholeCamera().getWorldPoint( fence_center, clicked_point, height_from_ground );
+
+   const glm::vec3 origin(MainCamera.ToWorldCoordinate[3]);
+   const glm::vec3 direction = glm::mat3(MainCamera.ToWorldCoordinate) * glm::vec3(
+      clicked_point.x - static_cast<float>(MainCamera.Width) * 0.5f,
+      clicked_point.y - static_cast<float>(MainCamera.Height) * 0.5f,
+      MainCamera.FocalLength
+   );
+   const float distance = Terrain.castRay( origin, direction );
+   if (!std::isfinite( distance )) return false;
 
-   const glm::vec4 world_point = MainCamera.ToWorldCoordinate * glm::vec4(ground_point, 1.0f);
-   fence_center = glm::vec3(world_point);
+   fence_center = origin + distance * direction;
+   fence_center.y -= height_from_ground;
    return true;
 }
 
 void VirtualFenceMakerGL::drawGround()
 {
-   const glm::mat4 model_view_projection = MainCamera.ProjectionMatrix * MainCamera.ViewMatrix;
+   const glm::mat4 model_view_projection = MainCamera.ProjectionMatrix * MainCamera.ViewMatrix * Ground.DequantizationMatrix;
 
    glUseProgram( GroundShader.ShaderProgram );
    glUniformMatrix4fv( GroundShader.MVPLocation, 1, GL_FALSE, &model_view_projection[0][0] );
@@ -536,52 +1499,359 @@ void VirtualFenceMakerGL::drawGround()
 
    glBindVertexArray( Ground.ObjVAO );
    glUniform3fv( GroundShader.ColorLocation, 1, value_ptr( Ground.Colors ) );
-   glDrawArrays( Ground.DrawMode, 0, Ground.VerticesCount );
+   // the terrain can hide parts of itself, unlike the flat ground
+   if (!Terrain.empty()) glEnable( GL_DEPTH_TEST );
+   glDrawElements( Ground.DrawMode, Ground.IndicesCount, Ground.IndexType, nullptr );
+   glDisable( GL_DEPTH_TEST );
    glBindVertexArray( 0 );
 }
 
-void VirtualFenceMakerGL::drawFenceAtCenter(const glm::vec3& center)
+void VirtualFenceMakerGL::drawObstacles(bool depth_only)
 {
-   glm::mat4 model_view_projection = MainCamera.ProjectionMatrix * MainCamera.ViewMatrix;
+   if (Obstacle.VerticesCount == 0) return;
 
+   const glm::mat4 model_view_projection = MainCamera.ProjectionMatrix * MainCamera.ViewMatrix * Obstacle.DequantizationMatrix;
    glUseProgram( FenceShader.ShaderProgram );
-   const glm::mat4 to_center = scale( translate( glm::mat4(1.0f), center ), glm::vec3(FenceRadius) );
-   model_view_projection = model_view_projection * to_center;
    glUniformMatrix4fv( FenceShader.MVPLocation, 1, GL_FALSE, &model_view_projection[0][0] );
-   glUniform1i( FenceShader.TextureLocation, Ground.TextureID );
+   glUniform3fv( FenceShader.ColorLocation, 1, value_ptr( Obstacle.Colors ) );
 
-   glBindVertexArray( Fence.ObjVAO );
-   glUniform3fv( FenceShader.ColorLocation, 1, value_ptr( Fence.Colors ) );
-   glDrawArrays( Fence.DrawMode, 0, Fence.VerticesCount );
+   glEnable( GL_DEPTH_TEST );
+   if (depth_only) glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+   glBindVertexArray( Obstacle.ObjVAO );
+   glDrawElements( Obstacle.DrawMode, Obstacle.IndicesCount, Obstacle.IndexType, nullptr );
    glBindVertexArray( 0 );
+   if (depth_only) glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+   glDisable( GL_DEPTH_TEST );
+}
+
+void VirtualFenceMakerGL::prepareObstacleOcclusion()
+{
+   // the depth holds only the obstacles, so fences lying on the ground never fight with the ground itself
+   if (Obstacle.VerticesCount == 0) return;
+
+   glClear( OPENGL_DEPTH_BUFFER_BIT );
+   drawObstacles( true );
+   glEnable( GL_DEPTH_TEST );
+}
+
+int VirtualFenceMakerGL::getFenceSegmentLevel(const glm::vec3& center, float radius, float height) const
+{
+   // the depth of the nearest point in the bounding box of the fence bounds the pixels per meter on its plane by
+   // f / depth times the longest ray through the image, as the image gets stretched toward its corners
+   const glm::vec3 forward(MainCamera.ToWorldCoordinate * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f));
+   const glm::vec3 half_size(radius, height * 0.5f, radius);
+   const glm::vec3 box_center = center - glm::vec3(0.0f, height * 0.5f, 0.0f);
+   const float nearest_depth = dot( box_center - MainCamera.CameraPosition, forward ) - dot( half_size, abs( forward ) );
+   const float near_plane = 1.0f;
+   if (nearest_depth <= near_plane) return FenceSegmentLevels - 1;
+
+   const float half_width = static_cast<float>(MainCamera.Width) * 0.5f;
+   const float half_height = static_cast<float>(MainCamera.Height) * 0.5f;
+   const float corner_stretch =
+      std::sqrt( half_width * half_width + half_height * half_height + MainCamera.FocalLength * MainCamera.FocalLength ) /
+      MainCamera.FocalLength;
+   const float projected_radius = radius * MainCamera.FocalLength * corner_stretch / nearest_depth;
+
+   // a polygon of n segments inscribed in a circle of radius r falls inside it by at most r * (1 - cos(pi / n))
+   if (projected_radius <= MaxFencePixelError) return 0;
+   const float required_segments = glm::pi<float>() / std::acos( 1.0f - MaxFencePixelError / projected_radius );
+   int level = 0;
+   while (level < FenceSegmentLevels - 1 && static_cast<float>(MinFenceSegments << level) < required_segments) level++;
+   return level;
+}
+
+bool VirtualFenceMakerGL::getFenceScreenRect(glm::vec4& rect, const glm::vec3& center, float radius, float height) const
+{
+   const float near_plane = 1.0f;
+   const glm::mat4 view_projection = MainCamera.ProjectionMatrix * MainCamera.ViewMatrix;
+   glm::vec2 min_point(std::numeric_limits<float>::max()), max_point(std::numeric_limits<float>::lowest());
+   for (int i = 0; i < 8; ++i) {
+      const glm::vec4 corner = view_projection * glm::vec4(
+         center.x + ((i & 1) != 0 ? radius : -radius),
+         center.y - ((i & 4) != 0 ? height : 0.0f),
+         center.z + ((i & 2) != 0 ? radius : -radius),
+         1.0f
+      );
+      // a corner behind the near plane projects nowhere useful, so the quad covers the whole screen
+      if (corner.w < near_plane) {
+         rect = glm::vec4(-1.0f, -1.0f, 1.0f, 1.0f);
+         return true;
+      }
+      const glm::vec2 ndc = glm::vec2(corner) / corner.w;
+      min_point = min( min_point, ndc );
+      max_point = max( max_point, ndc );
+   }
+
+   // a pixel more on every side keeps the anti-aliased rim inside the quad
+   const glm::vec2 pixel(2.0f / static_cast<float>(MainCamera.Width), 2.0f / static_cast<float>(MainCamera.Height));
+   min_point = max( min_point - pixel, glm::vec2(-1.0f) );
+   max_point = min( max_point + pixel, glm::vec2(1.0f) );
+   if (min_point.x >= max_point.x || min_point.y >= max_point.y) return false;
+   rect = glm::vec4(min_point, max_point);
+   return true;
+}
+
+void VirtualFenceMakerGL::drawAnalyticFenceAtCenter(
+   const glm::vec3& center,
+   float radius,
+   const glm::vec3& color,
+   bool write_coverage
+)
+{
+   glm::vec4 screen_rect;
+   if (!getFenceScreenRect( screen_rect, center, radius, 0.0f )) return;
+
+   const glm::mat4 view_projection = MainCamera.ProjectionMatrix * MainCamera.ViewMatrix;
+   const glm::mat4 inverse_view_projection = inverse( view_projection );
+   const glm::vec2 viewport_size(static_cast<float>(MainCamera.Width), static_cast<float>(MainCamera.Height));
+   glUseProgram( AnalyticFenceShader.ShaderProgram );
+   glUniform4fv( AnalyticFenceLocations.ScreenRect, 1, value_ptr( screen_rect ) );
+   glUniformMatrix4fv( AnalyticFenceLocations.ViewProjectionMatrix, 1, GL_FALSE, value_ptr( view_projection ) );
+   glUniformMatrix4fv(
+      AnalyticFenceLocations.InverseViewProjectionMatrix, 1, GL_FALSE, value_ptr( inverse_view_projection )
+   );
+   glUniform3fv( AnalyticFenceLocations.CameraPosition, 1, value_ptr( MainCamera.CameraPosition ) );
+   glUniform2fv( AnalyticFenceLocations.ViewportSize, 1, value_ptr( viewport_size ) );
+   glUniform3fv( AnalyticFenceLocations.FenceCenter, 1, value_ptr( center ) );
+   glUniform1f( AnalyticFenceLocations.FenceRadius, radius );
+   glUniform1i( AnalyticFenceLocations.WriteCoverage, write_coverage ? 1 : 0 );
+   glUniform3fv( AnalyticFenceShader.ColorLocation, 1, value_ptr( color ) );
+
+   glBindVertexArray( FenceQuad.ObjVAO );
+   glDrawArrays( FenceQuad.DrawMode, 0, FenceQuad.VerticesCount );
+   glBindVertexArray( 0 );
+}
+
+void VirtualFenceMakerGL::drawFences(
+   const std::vector<GroundFence>& fences,
+   const glm::vec3& color,
+   bool with_tops,
+   bool as_volumes
+)
+{
+   if (DrawFenceAnalytically && !as_volumes) {
+      for (const auto& fence : fences) {
+         if (with_tops) {
+            drawAnalyticFenceAtCenter( fence.Center - glm::vec3(0.0f, FenceHeight, 0.0f), fence.Radius, color, false );
+         }
+         drawAnalyticFenceAtCenter( fence.Center, fence.Radius, color, false );
+      }
+      return;
+   }
+
+   // every fence is a draw or two recorded into the arena, and the GPU takes them all in a few multi-draws
+   const glm::mat4 view_projection = MainCamera.ProjectionMatrix * MainCamera.ViewMatrix;
+   const glm::vec4 draw_color(color, 1.0f);
+   const auto addDisc = [&](const glm::vec3& center, float radius)
+   {
+      const int level = getFenceSegmentLevel( center, radius, 0.0f );
+      const glm::mat4 to_center = scale( translate( glm::mat4(1.0f), center ), glm::vec3(radius) );
+      FenceArena.addDraw( FenceLevels[level], { view_projection * to_center, draw_color } );
+   };
+
+   glUseProgram( FenceBatchShader.ShaderProgram );
+   FenceArena.beginDraws();
+   for (const auto& fence : fences) {
+      if (as_volumes) {
+         const int level = getFenceSegmentLevel( fence.Center, fence.Radius, FenceHeight );
+         const glm::mat4 to_center =
+            scale( translate( glm::mat4(1.0f), fence.Center ), glm::vec3(fence.Radius, FenceHeight, fence.Radius) );
+         FenceArena.addDraw( FenceVolumeLevels[level], { view_projection * to_center, draw_color } );
+         continue;
+      }
+      if (with_tops) addDisc( fence.Center - glm::vec3(0.0f, FenceHeight, 0.0f), fence.Radius );
+      addDisc( fence.Center, fence.Radius );
+   }
+   FenceArena.endDraws();
 }
 
 void VirtualFenceMakerGL::render()
 {
-   glClear( OPENGL_COLOR_BUFFER_BIT );
+   glClear( OPENGL_COLOR_BUFFER_BIT | OPENGL_DEPTH_BUFFER_BIT );
 
-   if (!DrawFenceOnGroundOnly) drawGround();
+   if (!DrawFenceOnGroundOnly) {
+      drawGround();
+      drawObstacles( false );
+   }
 
-   glm::vec3 fence_center;
-   if (ClickedPoint.x >= 0 && getWorldPoint( fence_center, FenceHeight )) {
-      if (!DrawFenceOnGroundOnly) drawFenceAtCenter( fence_center );
-      
-      fence_center.y = MainCamera.CameraHeight;
-      drawFenceAtCenter( fence_center );
+   // only the fences in the view frustum cost a draw, however many are pinned
+   std::vector<GroundFence> fences;
+   getVisibleFences( fences, ViewFrustum(MainCamera.ProjectionMatrix * MainCamera.ViewMatrix), FenceHeight );
+   if (!fences.empty()) {
+      prepareObstacleOcclusion();
+      drawFences( fences, DefaultFenceColor, !DrawFenceOnGroundOnly, !DrawFenceOnGroundOnly && DrawFenceVolume );
+      glDisable( GL_DEPTH_TEST );
    }
 
    glUseProgram( 0 );
 }
 
+void VirtualFenceMakerGL::damageAll()
+{
+   FullDamage = true;
+}
+
+void VirtualFenceMakerGL::damageFence(const GroundFence& fence)
+{
+   glm::vec4 ndc_rect;
+   if (!getFenceScreenRect( ndc_rect, fence.Center, fence.Radius, FenceHeight )) return;
+
+   const glm::vec2 size(static_cast<float>(MainCamera.Width), static_cast<float>(MainCamera.Height));
+   const glm::vec2 min_point = (glm::vec2(ndc_rect.x, ndc_rect.y) * 0.5f + 0.5f) * size;
+   const glm::vec2 max_point = (glm::vec2(ndc_rect.z, ndc_rect.w) * 0.5f + 0.5f) * size;
+   const glm::ivec4 rect(
+      static_cast<int>(std::floor( min_point.x )), static_cast<int>(std::floor( min_point.y )),
+      static_cast<int>(std::ceil( max_point.x )), static_cast<int>(std::ceil( max_point.y ))
+   );
+   if (DamageRect.x >= DamageRect.z || DamageRect.y >= DamageRect.w) DamageRect = rect;
+   else {
+      DamageRect = glm::ivec4(
+         std::min( DamageRect.x, rect.x ), std::min( DamageRect.y, rect.y ),
+         std::max( DamageRect.z, rect.z ), std::max( DamageRect.w, rect.w )
+      );
+   }
+}
+
+void VirtualFenceMakerGL::prepareSceneFramebuffer()
+{
+   if (SceneFramebuffer == 0) {
+      glGenFramebuffers( 1, &SceneFramebuffer );
+      glGenRenderbuffers( 2, SceneRenderbuffers );
+   }
+   glBindRenderbuffer( GL_RENDERBUFFER, SceneRenderbuffers[0] );
+   glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, MainCamera.Width, MainCamera.Height );
+   glBindRenderbuffer( GL_RENDERBUFFER, SceneRenderbuffers[1] );
+   glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, MainCamera.Width, MainCamera.Height );
+   glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+   glBindFramebuffer( GL_FRAMEBUFFER, SceneFramebuffer );
+   glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, SceneRenderbuffers[0] );
+   glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, SceneRenderbuffers[1] );
+   glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+}
+
+void VirtualFenceMakerGL::redraw()
+{
+   // the scissor also limits the clears in render, so the pixels outside keep the last frame
+   glBindFramebuffer( GL_FRAMEBUFFER, SceneFramebuffer );
+   if (!FullDamage) {
+      glEnable( GL_SCISSOR_TEST );
+      glScissor( DamageRect.x, DamageRect.y, DamageRect.z - DamageRect.x, DamageRect.w - DamageRect.y );
+   }
+   render();
+   glDisable( GL_SCISSOR_TEST );
+
+   glBindFramebuffer( GL_READ_FRAMEBUFFER, SceneFramebuffer );
+   glBindFramebuffer( GL_DRAW_FRAMEBUFFER, 0 );
+   glBlitFramebuffer(
+      0, 0, MainCamera.Width, MainCamera.Height,
+      0, 0, MainCamera.Width, MainCamera.Height,
+      OPENGL_COLOR_BUFFER_BIT, GL_NEAREST
+   );
+   glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+
+   FullDamage = false;
+   DamageRect = glm::ivec4(0);
+}
+
+void VirtualFenceMakerGL::postInputEvent(const InputEvent& event)
+{
+   // only a wheel step may be lost when the render thread is far behind, as the steps after it still move the fence;
+   // any other event waits for room, unless the render thread is gone and nobody would ever make it
+   while (!InputEvents.push( event )) {
+      if (event.EventType == InputEvent::Type::MOUSE_WHEEL || !RenderThreadRunning) return;
+      std::this_thread::yield();
+   }
+
+   // the lock orders the push before the check of a render thread about to wait, so no wake-up gets lost
+   { std::lock_guard<std::mutex> lock(InputMutex); }
+   InputCondition.notify_one();
+}
+
+void VirtualFenceMakerGL::waitForInputEvents()
+{
+   std::unique_lock<std::mutex> lock(InputMutex);
+   InputCondition.wait( lock, [this] { return !InputEvents.empty(); } );
+}
+
+void VirtualFenceMakerGL::processInputEvents()
+{
+   // a burst of wheel steps changes the clicked fence once, so its bounds are damaged before the first step and
+   // after the last one, and the frame is drawn once for all of them
+   bool wheel_burst = false;
+   const auto endWheelBurst = [this, &wheel_burst]()
+   {
+      GroundFence fence;
+      if (wheel_burst && getClickedFence( fence )) damageFence( fence );
+      wheel_burst = false;
+   };
+
+   InputEvent event{};
+   while (RenderThreadRunning && InputEvents.pop( event )) {
+      if (event.EventType == InputEvent::Type::MOUSE_WHEEL) {
+         GroundFence fence;
+         if (!wheel_burst && getClickedFence( fence )) damageFence( fence );
+         wheel_burst = true;
+         mousewheel( RenderWindow, event.X, event.Y, event.Mods );
+         continue;
+      }
+
+      endWheelBurst();
+      switch (event.EventType) {
+         case InputEvent::Type::KEY:
+            keyboard( RenderWindow, event.Code, 0, event.Action, event.Mods );
+            break;
+         case InputEvent::Type::MOUSE_BUTTON:
+            mouse( RenderWindow, event.Code, event.Action, event.Mods, event.X, event.Y );
+            break;
+         case InputEvent::Type::RESIZE:
+            reshape( RenderWindow, static_cast<int>(event.X), static_cast<int>(event.Y) );
+            break;
+         case InputEvent::Type::REFRESH:
+            refresh( RenderWindow );
+            break;
+         case InputEvent::Type::CLOSE:
+            cleanup( RenderWindow );
+            break;
+         default:
+            break;
+      }
+   }
+   endWheelBurst();
+}
+
+void VirtualFenceMakerGL::runRenderThread()
+{
+   glfwMakeContextCurrent( RenderWindow );
+
+   // nothing is drawn until an event changes the frame, so an idle window just sleeps in waitForInputEvents
+   damageAll();
+   while (RenderThreadRunning) {
+      processInputEvents();
+      if (!RenderThreadRunning) break;
+
+      if (FullDamage || (DamageRect.x < DamageRect.z && DamageRect.y < DamageRect.w)) {
+         redraw();
+         glfwSwapBuffers( RenderWindow );
+      }
+      waitForInputEvents();
+   }
+
+   glfwMakeContextCurrent( nullptr );
+   glfwPostEmptyEvent();
+}
+
 void VirtualFenceMakerGL::renderFence()
 {
    if (glfwWindowShouldClose( RenderWindow )) initialize();
-   
-   while (!glfwWindowShouldClose( RenderWindow )) {
-      render();
-      
-      glfwPollEvents();
-      glfwSwapBuffers( RenderWindow );
-   }
+
+   // the main thread keeps only the event loop that GLFW requires of it, so the input stays responsive
+   // even while the render thread captures or encodes a mask
+   glfwMakeContextCurrent( nullptr );
+   RenderThreadRunning = true;
+   std::thread render_thread(&VirtualFenceMakerGL::runRenderThread, this);
+   while (RenderThreadRunning) glfwWaitEvents();
+   render_thread.join();
+
+   glfwMakeContextCurrent( RenderWindow );
    glfwDestroyWindow( RenderWindow );
 }
\ No newline at end of file
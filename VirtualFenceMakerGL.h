@@ -9,34 +9,79 @@
 
 #pragma once
 
-#include "_Common.h"
+#include "IntegralFenceMask.h"
+#include "FenceBlobLabeler.h"
+#include "FenceMaskFile.h"
+#include "FenceMaskPyramid.h"
+#include "FenceRasterizer.h"
+#include "GroundScaleMap.h"
+#include "ObstacleBVH.h"
+#include "MeshFile.h"
+#include "MeshOptimizer.h"
+#include "FenceSpatialIndex.h"
+#include "InputEventQueue.h"
+
+#include <condition_variable>
+#include <mutex>
 
 class ShaderGL
 {
 public:
 	GLuint ShaderProgram;
 	GLint MVPLocation, ColorLocation, TextureLocation;
+	// linked programs are cached here under the hash of the driver strings and the sources
+	inline static std::string CacheDirectory = std::string(CMAKE_SOURCE_DIR) + "/shader_cache";
 
 	ShaderGL();
 
-	void setShader(const GLchar* const vertex_source, const GLchar* const fragment_source);
+	// loads the cached program or only starts compiling it, so that the driver compiles every program
+	// set before the first finishShader in parallel
+	void setShader(
+		const GLchar* const vertex_source,
+		const GLchar* const fragment_source,
+		const GLchar* const geometry_source = nullptr
+	);
+	// waits for the program, reports the compile and link errors, and caches the program compiled just now
+	bool finishShader();
+	bool isLoadedFromCache() const { return LoadedFromCache; }
+
+	// lets the driver compile on its own threads with GL_KHR_parallel_shader_compile or its ARB version if any
+	static bool enableParallelCompile();
+
+private:
+	GLuint VertexShader, FragmentShader, GeometryShader;
+	bool LoadedFromCache;
+	std::string CacheFilePath;
+
+	bool loadProgramBinary();
+	void saveProgramBinary() const;
+	static bool isCompiled(GLuint shader, const char* stage);
 };
 
 class ObjectGL
 {
-	std::vector<GLfloat> DataBuffer; // 3 for vertex and 2 for texture
+	std::vector<GLfloat> DataBuffer; // 3 for vertex and 2 for texture, released once uploaded
 
 	void prepareTexture2DFromFile(const std::string& file_name) const;
-	void prepareTexture(int n_bytes_per_vertex, const std::string& texture_file_name);
+	void prepareTexture(const std::string& texture_file_name);
 	void prepareVertexBuffer(int n_bytes_per_vertex);
+	void prepareQuantizedBuffers(
+		const std::vector<glm::vec3>& vertices,
+		const std::vector<glm::vec2>& textures,
+		const std::vector<uint>& indices
+	);
 	GLvoid* bufferOffset(int offset) const { return reinterpret_cast<GLvoid *>(offset); }
 
 public:
-	GLuint ObjVAO, ObjVBO;
+	GLuint ObjVAO, ObjVBO, ObjEBO;
 	GLenum DrawMode;
+	GLenum IndexType;
 	GLuint TextureID;
 	GLsizei VerticesCount;
+	GLsizei IndicesCount;
 	glm::vec3 Colors;
+	// maps the normalized 16-bit positions of indexed objects back to the original ones, and identity otherwise
+	glm::mat4 DequantizationMatrix;
 
 	ObjectGL();
 
@@ -53,11 +98,95 @@ public:
 		const std::vector<glm::vec2>& textures, 
 		const std::string& texture_file_name
 	);
+
+	// indexed triangles with positions quantized to normalized 16-bit in their bounding box, which should be
+	// drawn with glDrawElements and DequantizationMatrix applied before the view-projection
+	void setIndexedObject(
+		const glm::vec3& color,
+		const std::vector<glm::vec3>& vertices,
+		const std::vector<uint>& indices
+	);
+
+	// the texture coordinates are also quantized to normalized 16-bit, so they should lie in [0, 1]
+	void setIndexedObject(
+		const glm::vec3& color,
+		const std::vector<glm::vec3>& vertices,
+		const std::vector<glm::vec2>& textures,
+		const std::vector<uint>& indices,
+		const std::string& texture_file_name
+	);
+};
+
+// one vertex and index buffer shared by many small meshes, which are written once through persistent mappings and
+// drawn together by glMultiDrawElementsIndirect, where the shaders read the per-draw data at gl_BaseInstance
+class GeometryArenaGL
+{
+public:
+	struct Range
+	{
+		GLuint FirstIndex;
+		GLsizei IndexCount;
+	};
+
+	// std430 layout of the per-draw data in the shaders
+	struct DrawData
+	{
+		glm::mat4 ModelViewProjectionMatrix;
+		glm::vec4 Color;
+	};
+
+	GLuint ArenaVAO;
+
+	GeometryArenaGL();
+
+	// the storage is allocated once, so the meshes already in the arena never move
+	void create(GLsizei max_vertices, GLsizei max_indices, GLsizei max_draws_per_batch);
+	void destroy();
+	// the indices refer to the given vertices, and it returns false if the arena is full
+	bool allocate(Range& range, const std::vector<glm::vec3>& vertices, const std::vector<uint>& indices);
+	// the triangles recorded between beginDraws and endDraws are drawn with the program in use by then,
+	// in one multi-draw per full batch
+	void beginDraws();
+	void addDraw(const Range& range, const DrawData& data);
+	void endDraws();
+
+private:
+	struct DrawCommand
+	{
+		GLuint Count;
+		GLuint InstanceCount;
+		GLuint FirstIndex;
+		GLint BaseVertex;
+		GLuint BaseInstance;
+	};
+
+	// a batch is written while the GPU may still read the previous ones, so each batch slot has its own fence
+	static constexpr int BatchSlots = 3;
+
+	GLuint VertexBuffer, IndexBuffer, CommandBuffer, DrawDataBuffer;
+	glm::vec3* MappedVertices;
+	uint* MappedIndices;
+	DrawCommand* MappedCommands;
+	DrawData* MappedDrawData;
+	GLsizei MaxVertices, MaxIndices, MaxDraws;
+	GLsizei UsedVertices, UsedIndices;
+	int Slot;
+	GLsizei DrawCount;
+	GLsync SlotFences[BatchSlots];
+
+	void waitForSlot();
+	void submitDraws();
 };
 
 class VirtualFenceMakerGL
 {
 public:
+	inline static const glm::vec3 DefaultFenceColor{ 0.5f, 0.125f, 0.9f };
+	static constexpr int MaxVolumeLayers = 16;
+	// the fence outlines come in levels of 8, 16, ..., 1024 segments, so the coarsest level is still a fair circle
+	static constexpr int MinFenceSegments = 8;
+	static constexpr int FenceSegmentLevels = 8;
+
 	VirtualFenceMakerGL(float actual_width, float actual_height);
 	~VirtualFenceMakerGL();
 
@@ -75,6 +204,25 @@ public:
 		float camera_height_in_meter
 	);
 	void renderFence();
+	// replaces the flat ground with the heightmap terrain of the grid file, which spans the whole ground
+	bool loadTerrain(const std::string& file_path);
+	// static obstacles hiding the fences behind them, modelled in meters with y up from the flat ground
+	bool loadObstacles(const std::string& file_path);
+	const IntegralFenceMask& getIntegralFenceMask() const { return FenceMaskIntegral; }
+	const FenceBlobLabeler& getFenceBlobLabeler() const { return BlobLabeler; }
+	const FenceMaskPyramid& getFenceMaskPyramid() const { return MaskPyramid; }
+	const GroundScaleMap& getGroundScaleMap() const { return GroundScale; }
+	const TerrainHeightMap& getTerrain() const { return Terrain; }
+	const ObstacleBVH& getObstacleBVH() const { return ObstacleHierarchy; }
+	const glm::vec3& getFenceColor() const { return DefaultFenceColor; }
+	// object heights of the fence volume masks, at most MaxVolumeLayers of them
+	void setVolumeHeights(const std::vector<float>& heights);
+	// the largest distance in pixels the drawn fence outlines may fall inside the true circles
+	void setMaxFencePixelError(float max_pixel_error) { MaxFencePixelError = std::max( max_pixel_error, 0.01f ); }
+	// fences that stay where they are while another point is clicked, with centers on the ground surface
+	void setPinnedFences(const std::vector<GroundFence>& fences);
+	const std::vector<GroundFence>& getPinnedFences() const { return PinnedFences; }
+	PinholeCamera getPinholeCamera() const;
 
 private:
 	struct Camera
@@ -101,32 +249,104 @@ private:
 
 	glm::ivec2 ClickedPoint;
 	bool DrawFenceOnGroundOnly;
+	bool DrawFenceVolume;
+	bool DrawFenceAnalytically;
+	// the window is drawn again only where something changed since the last frame,
+	// where DamageRect holds the pixels [x0, x1) x [y0, y1) from the bottom unless the whole frame changed
+	bool FullDamage;
+	glm::ivec4 DamageRect;
+	// the frame is kept off the window, as the back buffer is undefined after a swap
+	GLuint SceneFramebuffer;
+	GLuint SceneRenderbuffers[2];
+	// the callbacks on the main thread only queue the events, which the render thread owning the context handles
+	InputEventQueue InputEvents;
+	std::mutex InputMutex;
+	std::condition_variable InputCondition;
+	std::atomic<bool> RenderThreadRunning;
 
-	uint8_t* FenceMask;
+	uint8_t* FenceMask; // top-down
+	IntegralFenceMask FenceMaskIntegral;
+	FenceBlobLabeler BlobLabeler;
+	FenceMaskPyramid MaskPyramid;
+	GroundScaleMap GroundScale;
+	TerrainHeightMap Terrain;
+	ObstacleBVH ObstacleHierarchy;
+	std::vector<GroundFence> PinnedFences;
+	FenceSpatialIndex PinnedFenceIndex;
 	float ActualGroundWidth; 
 	float ActualGroundHeight;
 	float FenceHeight;
 	float FenceRadius;
+	float MaxFencePixelError;
+	std::vector<float> VolumeHeights;
+	// the triangles of every segment level of the fence discs and volumes in FenceArena
+	GeometryArenaGL::Range FenceLevels[FenceSegmentLevels];
+	GeometryArenaGL::Range FenceVolumeLevels[FenceSegmentLevels];
 	Camera MainCamera;
 
 	ShaderGL GroundShader;
 	ShaderGL FenceShader;
+	ShaderGL FenceVolumeShader;
+	ShaderGL AnalyticFenceShader;
+	ShaderGL FenceBatchShader;
+	// the uniforms of AnalyticFenceShader besides the common ones, looked up once it is linked
+	struct {
+		GLint ScreenRect, ViewProjectionMatrix, InverseViewProjectionMatrix, CameraPosition, ViewportSize;
+		GLint FenceCenter, FenceRadius, WriteCoverage;
+	} AnalyticFenceLocations;
 	ObjectGL Ground;
-	ObjectGL Fence;
+	ObjectGL FenceQuad;
+	GeometryArenaGL FenceArena;
+	ObjectGL Obstacle;
 
 	bool getWorldPoint(glm::vec3& fence_center, float height_from_ground) const;
+	// the pinned fences whose volume up to height meets the frustum, followed by the clicked one if any
+	void getVisibleFences(std::vector<GroundFence>& fences, const ViewFrustum& frustum, float height) const;
+	bool getClickedFence(GroundFence& fence) const;
+	void pinFence();
 	void updateFenceHeight(double mouse_wheel_y_offset);
 	void updateFenceRadius(double mouse_wheel_y_offset);
 
-	void captureFenceMask() const;
+	void captureFenceMask();
+	void captureFenceCoverage(int samples);
+	void computeFenceCoverage(int samples_per_axis) const;
+	float getMaxVolumeHeight() const;
+	void writeFenceVolumeMasks(const std::vector<std::vector<uint8_t>>& masks) const;
+	void captureFenceVolumeMasks();
+	void computeFenceVolumeMasks() const;
 	void drawGround();
-	void drawFenceAtCenter(const glm::vec3& center);
+	void drawObstacles(bool depth_only);
+	void prepareObstacleOcclusion();
+	// the coarsest level whose outline stays within MaxFencePixelError, from the projected radius of the fence up to height
+	int getFenceSegmentLevel(const glm::vec3& center, float radius, float height) const;
+	// the normalized device rectangle covering the fence up to height, which is false if it falls outside the screen
+	bool getFenceScreenRect(glm::vec4& rect, const glm::vec3& center, float radius, float height) const;
+	// the fence drawn as its screen rectangle with every pixel tested against the circle on the plane of the center,
+	// where the coverage is written as the color instead of discarding the pixels outside if requested
+	void drawAnalyticFenceAtCenter(const glm::vec3& center, float radius, const glm::vec3& color, bool write_coverage);
+	// the fences on the ground and also at the fence height if with_tops, or their volumes up to the fence height
+	void drawFences(const std::vector<GroundFence>& fences, const glm::vec3& color, bool with_tops, bool as_volumes);
 	void render();
+	void damageAll();
+	// the fence as drawn with the current fence height, in any of the drawing modes
+	void damageFence(const GroundFence& fence);
+	void prepareSceneFramebuffer();
+	void redraw();
+	void postInputEvent(const InputEvent& event);
+	void waitForInputEvents();
+	void processInputEvents();
+	void runRenderThread();
 
 	void setFenceObject();
+	void setFenceVolumeObject();
+	void setFenceQuadObject();
 	void setGroundObject();
 	void setFenceShader();
+	void setFenceVolumeShader();
+	void setAnalyticFenceShader();
+	void setFenceBatchShader();
 	void setGroundShader();
+	void setShaders();
 	void registerCallbacks() const;
 	void initializeOpenGL();
 	void initialize();
@@ -135,14 +355,16 @@ private:
 	
 	void cleanup(GLFWwindow* window);
 	void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods);
-	void mouse(GLFWwindow* window, int button, int action, int mods);
-	void mousewheel(GLFWwindow* window, double xoffset, double yoffset);
+	void mouse(GLFWwindow* window, int button, int action, int mods, double x, double y);
+	void mousewheel(GLFWwindow* window, double xoffset, double yoffset, int mods);
 	void reshape(GLFWwindow* window, int width, int height);
+	void refresh(GLFWwindow* window);
 	void error(int error, const char* description) const;
 	static void cleanupWrapper(GLFWwindow* window);
 	static void keyboardWrapper(GLFWwindow* window, int key, int scancode, int action, int mods);
 	static void mouseWrapper(GLFWwindow* window, int button, int action, int mods);
 	static void mousewheelWrapper(GLFWwindow* window, double xoffset, double yoffset);
 	static void reshapeWrapper(GLFWwindow* window, int width, int height);
+	static void refreshWrapper(GLFWwindow* window);
 	static void errorWrapper(int error, const char* description);
 };
\ No newline at end of file
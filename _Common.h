@@ -21,6 +21,25 @@
 #include <sstream>
 #include <fstream>
 #include <chrono>
+#include <algorithm>
+#include <thread>
+#include <cstring>
+#include <cmath>
+#include <functional>
+
+#if defined(__AVX2__)
+#define USE_AVX2
+#endif
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define USE_F16C
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || defined(USE_AVX2)
+#define USE_SSE2
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #include "ProjectPath.h"
 
@@ -29,4 +48,35 @@ using uint = unsigned int;
 
 constexpr uint OPENGL_COLOR_BUFFER_BIT = 0x00004000u;
 constexpr uint OPENGL_DEPTH_BUFFER_BIT = 0x00000100u;
-constexpr uint OPENGL_STENCIL_BUFFER_BIT = 0x00000400u;
\ No newline at end of file
+constexpr uint OPENGL_STENCIL_BUFFER_BIT = 0x00000400u;
+
+inline int countBits(uint64_t bits)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+   return static_cast<int>(__popcnt64( bits ));
+#elif defined(_MSC_VER)
+   return static_cast<int>(__popcnt( static_cast<uint>(bits) ) + __popcnt( static_cast<uint>(bits >> 32) ));
+#else
+   return __builtin_popcountll( bits );
+#endif
+}
+
+template<typename Func>
+void parallelFor(int begin, int end, Func&& func)
+{
+   const int n = end - begin;
+   if (n <= 0) return;
+
+   const int n_threads = std::min( n, std::max( 1, static_cast<int>(std::thread::hardware_concurrency()) ) );
+   if (n_threads == 1) {
+      func( begin, end );
+      return;
+   }
+
+   std::vector<std::thread> workers;
+   const int chunk = (n + n_threads - 1) / n_threads;
+   for (int from = begin; from < end; from += chunk) {
+      workers.emplace_back( func, from, std::min( from + chunk, end ) );
+   }
+   for (auto& worker : workers) worker.join();
+}
\ No newline at end of file
@@ -8,10 +8,16 @@ message(STATUS ">> Path    : ${CMAKE_CXX_COMPILER}")
 if(MSVC)
    check_cxx_compiler_flag(/std:c++17 cxx_17)
    check_cxx_compiler_flag(/W4 high_warning_level)
+   check_cxx_compiler_flag(/arch:AVX2 avx2_support)
+   set(AVX2_FLAG /arch:AVX2)
 elseif(${CMAKE_CXX_COMPILER_ID} MATCHES Clang)
    check_cxx_compiler_flag(-std=c++17 cxx_17)
    check_cxx_compiler_flag(-Wall high_warning_level)
+   check_cxx_compiler_flag("-mavx2 -mf16c" avx2_support)
+   set(AVX2_FLAG -mavx2 -mf16c)
 elseif(${CMAKE_CXX_COMPILER_ID} MATCHES GNU)
    check_cxx_compiler_flag(-std=gnu++17 cxx_17)
    check_cxx_compiler_flag(-Wextra high_warning_level)
+   check_cxx_compiler_flag("-mavx2 -mf16c" avx2_support)
+   set(AVX2_FLAG -mavx2 -mf16c)
 endif()
\ No newline at end of file
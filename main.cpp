@@ -1,7 +1,647 @@
 #include "VirtualFenceMakerGL.h"
+#include "FenceMotionDetector.h"
+#include "FenceOverlayCompositor.h"
+#include "FenceMaskComparator.h"
+#include "FenceCropPlanner.h"
+#include "FenceMaskTensor.h"
+#include "FenceQPMap.h"
 
-int main()
+#include <filesystem>
+#include <cerrno>
+#include <limits>
+
+namespace
 {
+	bool getRawVideoFormat(RawVideoFormat& format, const std::string& name)
+	{
+		if (name == "grey") format = RawVideoFormat::GREY;
+		else if (name == "i420") format = RawVideoFormat::I420;
+		else if (name == "nv12") format = RawVideoFormat::NV12;
+		else return false;
+		return true;
+	}
+
+	// the whole argument has to be a number in range, where std::stoi would throw or take only its prefix
+	bool getIntegerArgument(int& value, const char* argument)
+	{
+		char* end = nullptr;
+		errno = 0;
+		const long number = std::strtol( argument, &end, 10 );
+		if (end == argument || *end != '\0' || errno == ERANGE ||
+		    number < std::numeric_limits<int>::min() || number > std::numeric_limits<int>::max()) return false;
+		value = static_cast<int>(number);
+		return true;
+	}
+
+	bool getFloatArgument(float& value, const char* argument)
+	{
+		char* end = nullptr;
+		errno = 0;
+		const float number = std::strtof( argument, &end );
+		if (end == argument || *end != '\0' || errno == ERANGE || !std::isfinite( number )) return false;
+		value = number;
+		return true;
+	}
+
+	std::vector<uint8_t> createBenchmarkFenceMask(int width, int height)
+	{
+		std::vector<uint8_t> fence_mask(static_cast<size_t>(width) * height, 0);
+		const float radius = 0.22f * static_cast<float>(height);
+		for (int f = 0; f < 3; ++f) {
+			const glm::vec2 center((f + 1) * width / 4.0f, height * 0.6f);
+			for (int y = 0; y < height; ++y) {
+				for (int x = 0; x < width; ++x) {
+					if (glm::distance( glm::vec2(x, y), center ) < radius) fence_mask[y * width + x] = static_cast<uint8_t>(f + 1);
+				}
+			}
+		}
+		return fence_mask;
+	}
+
+	int detectMotionInVideo(const std::string& video_path, const std::string& format_name, const std::string& mask_path)
+	{
+		RawVideoFormat format;
+		if (!getRawVideoFormat( format, format_name )) {
+			std::cout << "Unknown raw video format: " << format_name << "\n";
+			return EXIT_FAILURE;
+		}
+
+		int width, height;
+		std::vector<uint8_t> fence_mask;
+		if (!readFenceMask( fence_mask, width, height, mask_path )) {
+			std::cout << "Cannot read the fence mask: " << mask_path << "\n";
+			return EXIT_FAILURE;
+		}
+
+		FenceMotionDetector detector;
+		detector.setFenceMask( fence_mask.data(), width, height );
+		const std::vector<uint8_t>& labels = detector.getLabels();
+
+		const auto start = std::chrono::steady_clock::now();
+		const int n_frames = detector.processVideo(
+			video_path, format,
+			[&labels](int frame_index, const std::vector<float>& scores)
+			{
+				std::cout << "frame " << frame_index;
+				for (size_t i = 0; i < scores.size(); ++i) {
+					std::cout << " " << static_cast<int>(labels[i]) << ":" << std::fixed << std::setprecision( 4 ) << scores[i];
+				}
+				std::cout << "\n";
+			}
+		);
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		if (n_frames < 0) {
+			std::cout << "Cannot map the video: " << video_path << "\n";
+			return EXIT_FAILURE;
+		}
+		std::cout << n_frames << " frames, " << std::setprecision( 1 ) << n_frames / elapsed.count() << " fps\n";
+		return EXIT_SUCCESS;
+	}
+
+	double measureMotionDetection(FenceMotionDetector& detector, const std::vector<std::vector<uint8_t>>& frames, int n_frames)
+	{
+		std::vector<float> scores;
+		detector.reset();
+		detector.detect( scores, frames[0].data() );
+
+		const auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < n_frames; ++i) detector.detect( scores, frames[i % frames.size()].data() );
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		return n_frames / elapsed.count();
+	}
+
+	int benchmarkMotionDetection()
+	{
+		const std::vector<glm::ivec2> resolutions = { { 1920, 1080 }, { 3840, 2160 } };
+		const double camera_fps = 25.0;
+		for (const auto& resolution : resolutions) {
+			const int width = resolution.x;
+			const int height = resolution.y;
+			std::vector<std::vector<uint8_t>> frames(8, std::vector<uint8_t>(static_cast<size_t>(width) * height));
+			uint seed = 12345u;
+			for (auto& frame : frames) {
+				for (auto& pixel : frame) {
+					seed = seed * 1664525u + 1013904223u;
+					pixel = static_cast<uint8_t>(seed >> 24);
+				}
+			}
+
+			// three fences covering about 15% of the frame against the whole frame as one fence
+			const std::vector<uint8_t> fence_mask = createBenchmarkFenceMask( width, height );
+			const std::vector<uint8_t> full_mask(static_cast<size_t>(width) * height, 255);
+
+			FenceMotionDetector detector;
+			detector.setFenceMask( fence_mask.data(), width, height );
+			const double fenced_fps = measureMotionDetection( detector, frames, 200 );
+			detector.setFenceMask( full_mask.data(), width, height );
+			const double full_fps = measureMotionDetection( detector, frames, 200 );
+
+			std::cout << width << "x" << height << ": " << std::fixed << std::setprecision( 1 )
+				<< fenced_fps << " fps inside fences (" << fenced_fps / camera_fps << " streams at " << camera_fps << " fps), "
+				<< full_fps << " fps for the full frame\n";
+		}
+		return EXIT_SUCCESS;
+	}
+
+	int overlayFenceOnVideo(
+		const std::string& video_path,
+		const std::string& format_name,
+		const std::string& mask_path,
+		const std::string& output_path
+	)
+	{
+		RawVideoFormat format;
+		if (!getRawVideoFormat( format, format_name )) {
+			std::cout << "Unknown raw video format: " << format_name << "\n";
+			return EXIT_FAILURE;
+		}
+
+		int width, height;
+		std::vector<uint8_t> fence_mask;
+		if (!readFenceMask( fence_mask, width, height, mask_path )) {
+			std::cout << "Cannot read the fence mask: " << mask_path << "\n";
+			return EXIT_FAILURE;
+		}
+
+		MappedFile video;
+		std::ofstream output(output_path, std::ios::binary);
+		if (!video.open( video_path ) || !output.is_open()) {
+			std::cout << "Cannot open " << video_path << " or " << output_path << "\n";
+			return EXIT_FAILURE;
+		}
+
+		FenceOverlayCompositor compositor(VirtualFenceMakerGL::DefaultFenceColor);
+		compositor.setFenceMask( fence_mask.data(), width, height );
+
+		const size_t frame_size = getRawFrameSize( width, height, format );
+		const auto n_frames = static_cast<int>(video.size() / frame_size);
+		std::vector<uint8_t> frame(frame_size);
+		double compositing_time = 0.0;
+		for (int i = 0; i < n_frames; ++i) {
+			std::memcpy( frame.data(), video.data() + frame_size * i, frame_size );
+			const auto start = std::chrono::steady_clock::now();
+			compositor.composite( frame.data(), format );
+			const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			compositing_time += elapsed.count();
+			output.write( reinterpret_cast<const char*>(frame.data()), static_cast<std::streamsize>(frame_size) );
+		}
+		std::cout << n_frames << " frames, " << std::fixed << std::setprecision( 3 )
+			<< (n_frames > 0 ? compositing_time / n_frames : 0.0) << " ms per frame for compositing\n";
+		return EXIT_SUCCESS;
+	}
+
+	int benchmarkOverlay()
+	{
+		const int width = 3840;
+		const int height = 2160;
+		const std::vector<uint8_t> fence_mask = createBenchmarkFenceMask( width, height );
+		FenceOverlayCompositor compositor(VirtualFenceMakerGL::DefaultFenceColor);
+		compositor.setFenceMask( fence_mask.data(), width, height );
+		for (const auto format : { RawVideoFormat::NV12, RawVideoFormat::I420 }) {
+			std::vector<uint8_t> frame(getRawFrameSize( width, height, format ), 128);
+			compositor.composite( frame.data(), format );
+
+			const int n_frames = 200;
+			const auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < n_frames; ++i) compositor.composite( frame.data(), format );
+			const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			std::cout << (format == RawVideoFormat::NV12 ? "NV12 " : "I420 ") << width << "x" << height << ": "
+				<< std::fixed << std::setprecision( 3 ) << elapsed.count() / n_frames << " ms per frame\n";
+		}
+		return EXIT_SUCCESS;
+	}
+
+	int benchmarkFenceCoverage()
+	{
+		const PinholeCamera camera(3840, 2160, 2400.0f, 40.0f, 30.0f, 150.0f);
+		std::vector<GroundFence> fences;
+		for (int f = 0; f < 3; ++f) {
+			glm::vec3 center;
+			const glm::vec2 image_point((f + 1) * camera.Width / 4.0f, camera.Height * 0.7f);
+			if (camera.getWorldPoint( center, image_point, 0.0f )) fences.emplace_back( center, 20.0f, static_cast<uint8_t>(f + 1) );
+		}
+
+		FenceRasterizer rasterizer;
+		rasterizer.setCamera( camera );
+		std::vector<uint8_t> coverage;
+		for (const int samples_per_axis : { 1, 2, 4, 8 }) {
+			rasterizer.getCoverage( coverage, fences, samples_per_axis );
+
+			const int n_iterations = 20;
+			const auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < n_iterations; ++i) rasterizer.getCoverage( coverage, fences, samples_per_axis );
+			const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			std::cout << samples_per_axis * samples_per_axis << " samples per pixel at " << camera.Width << "x" << camera.Height << ": "
+				<< std::fixed << std::setprecision( 3 ) << elapsed.count() / n_iterations << " ms\n";
+		}
+		return EXIT_SUCCESS;
+	}
+
+	int benchmarkFenceCulling(int n_fences)
+	{
+		// fences all over a 10 km square around the camera, of which only a few hundred are in view
+		const PinholeCamera camera(1920, 1080, 1200.0f, 40.0f, 30.0f, 150.0f);
+		std::vector<GroundFence> fences;
+		for (int f = 0; f < n_fences; ++f) {
+			const float x = static_cast<float>(static_cast<long long>(f) * 7919 % 10007) - 5003.5f;
+			const float z = static_cast<float>(static_cast<long long>(f) * 104729 % 10009) - 5004.5f;
+			fences.emplace_back( glm::vec3(x, camera.CameraHeight, z), 20.0f, 255 );
+		}
+
+		FenceSpatialIndex index;
+		const auto build_start = std::chrono::steady_clock::now();
+		index.build( fences );
+		const std::chrono::duration<double, std::milli> build_time = std::chrono::steady_clock::now() - build_start;
+
+		const ViewFrustum frustum(camera);
+		std::vector<int> visible;
+		const int n_iterations = 100;
+		const auto query_start = std::chrono::steady_clock::now();
+		for (int i = 0; i < n_iterations; ++i) index.getVisibleFences( visible, frustum, 0.0f );
+		const std::chrono::duration<double, std::milli> query_time = std::chrono::steady_clock::now() - query_start;
+
+		std::vector<GroundFence> visible_fences;
+		for (const auto& f : visible) visible_fences.emplace_back( fences[f] );
+		FenceRasterizer rasterizer;
+		rasterizer.setCamera( camera );
+		std::vector<uint8_t> coverage;
+		const auto coverage_start = std::chrono::steady_clock::now();
+		rasterizer.getCoverage( coverage, visible_fences, 4 );
+		const std::chrono::duration<double, std::milli> coverage_time = std::chrono::steady_clock::now() - coverage_start;
+
+		std::cout << visible.size() << " of " << n_fences << " fences visible, index built in " << std::fixed << std::setprecision( 3 )
+			<< build_time.count() << " ms, frustum query in " << query_time.count() / n_iterations << " ms, coverage of the visible ones in "
+			<< coverage_time.count() << " ms\n";
+		return EXIT_SUCCESS;
+	}
+
+	int benchmarkTerrainLookup(const std::string& grid_path)
+	{
+		const glm::vec2 ground_extent(240.0f, 320.0f);
+		TerrainHeightMap terrain;
+		if (!grid_path.empty()) {
+			if (!terrain.load( grid_path, ground_extent )) {
+				std::cout << "Cannot read the terrain grid: " << grid_path << "\n";
+				return EXIT_FAILURE;
+			}
+		}
+		else {
+			const int size = 2049;
+			std::vector<float> elevations(static_cast<size_t>(size) * size);
+			for (int z = 0; z < size; ++z) {
+				for (int x = 0; x < size; ++x) {
+					elevations[z * size + x] = 10.0f * sinf( 0.01f * x ) * cosf( 0.013f * z ) + 2.0f * sinf( 0.2f * x + 0.3f * z );
+				}
+			}
+			terrain.setElevations( elevations.data(), size, size, ground_extent );
+		}
+
+		const PinholeCamera camera(3840, 2160, 2400.0f, 40.0f, 30.0f, 150.0f);
+		terrain.setGroundLevel( camera.CameraHeight );
+		std::vector<glm::vec3> ground_points;
+		terrain.getGroundPoints( ground_points, camera );
+
+		const int n_iterations = 5;
+		const auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < n_iterations; ++i) terrain.getGroundPoints( ground_points, camera );
+		const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		std::cout << terrain.getColumns() << "x" << terrain.getRows() << " terrain, " << camera.Width << "x" << camera.Height
+			<< " ground lookup: " << std::fixed << std::setprecision( 3 ) << elapsed.count() / n_iterations << " ms\n";
+		return EXIT_SUCCESS;
+	}
+
+	int benchmarkOcclusion(const std::string& mesh_path)
+	{
+		std::vector<glm::vec3> vertices;
+		std::vector<uint> indices;
+		const auto read_start = std::chrono::steady_clock::now();
+		if (!readMesh( vertices, indices, mesh_path )) {
+			std::cout << "Cannot read the obstacle mesh: " << mesh_path << "\n";
+			return EXIT_FAILURE;
+		}
+		const std::chrono::duration<double, std::milli> read_time = std::chrono::steady_clock::now() - read_start;
+
+		const PinholeCamera camera(1920, 1080, 1200.0f, 40.0f, 30.0f, 150.0f);
+		for (auto& vertex : vertices) vertex.y = camera.CameraHeight - vertex.y;
+		ObstacleBVH obstacles;
+		const auto build_start = std::chrono::steady_clock::now();
+		obstacles.build( vertices, indices );
+		const std::chrono::duration<double, std::milli> build_time = std::chrono::steady_clock::now() - build_start;
+
+		TerrainHeightMap flat_ground;
+		flat_ground.setGroundLevel( camera.CameraHeight );
+		std::vector<uint8_t> mask(static_cast<size_t>(camera.Width) * camera.Height, 255);
+		const auto occlusion_start = std::chrono::steady_clock::now();
+		obstacles.removeOccludedPixels( mask.data(), camera, flat_ground );
+		const std::chrono::duration<double, std::milli> occlusion_time = std::chrono::steady_clock::now() - occlusion_start;
+
+		const auto n_occluded = std::count( mask.begin(), mask.end(), 0 );
+		std::cout << vertices.size() << " vertices read in " << std::fixed << std::setprecision( 3 ) << read_time.count() << " ms, "
+			<< obstacles.getTriangleCount() << " triangles, " << obstacles.getNodeCount() << " nodes built in "
+			<< std::fixed << std::setprecision( 3 ) << build_time.count() << " ms, " << n_occluded << " of " << mask.size()
+			<< " ground pixels occluded in " << occlusion_time.count() << " ms\n";
+		return EXIT_SUCCESS;
+	}
+
+	int vectorizeFenceMask(const std::string& mask_path, const std::string& output_path, float tolerance_in_pixel)
+	{
+		int width, height;
+		std::vector<uint8_t> fence_mask;
+		if (!readFenceMask( fence_mask, width, height, mask_path )) {
+			std::cout << "Cannot read the fence mask: " << mask_path << "\n";
+			return EXIT_FAILURE;
+		}
+
+		std::vector<FencePolygon> polygons;
+		extractFenceContours( polygons, fence_mask.data(), width, height );
+		simplifyFenceContours( polygons, tolerance_in_pixel );
+		if (!writeFenceContours( polygons, width, height, output_path )) {
+			std::cout << "Cannot write the fence contours: " << output_path << "\n";
+			return EXIT_FAILURE;
+		}
+
+		size_t n_points = 0;
+		for (const auto& polygon : polygons) n_points += polygon.Points.size();
+		std::vector<uint8_t> data;
+		encodeFenceContours( data, polygons, width, height );
+		std::cout << polygons.size() << " polygons, " << n_points << " points, " << data.size() << " bytes\n";
+		return EXIT_SUCCESS;
+	}
+
+	int rasterizeFenceVector(const std::string& vector_path, int width, int height, const std::string& output_path)
+	{
+		int source_width, source_height;
+		std::vector<FencePolygon> polygons;
+		if (!readFenceContours( polygons, source_width, source_height, vector_path )) {
+			std::cout << "Cannot read the fence contours: " << vector_path << "\n";
+			return EXIT_FAILURE;
+		}
+
+		std::vector<uint8_t> fence_mask;
+		rasterizeFenceContours( fence_mask, polygons, source_width, source_height, width, height );
+		if (!writeFenceMask( fence_mask.data(), width, height, output_path )) {
+			std::cout << "Cannot write the fence mask: " << output_path << "\n";
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	int planFenceCrops(const std::string& mask_path, int crop_width, int crop_height, int overlap, int batch_size)
+	{
+		int width, height;
+		std::vector<uint8_t> fence_mask;
+		if (!readFenceMask( fence_mask, width, height, mask_path )) {
+			std::cout << "Cannot read the fence mask: " << mask_path << "\n";
+			return EXIT_FAILURE;
+		}
+
+		FenceCropPlanner planner;
+		planner.setCropSize( crop_width, crop_height, overlap );
+		planner.setBatchSize( batch_size );
+		planner.update( fence_mask.data(), width, height );
+
+		const std::vector<FenceCrop>& crops = planner.getCrops();
+		for (size_t i = 0; i < crops.size(); ++i) {
+			if (!crops[i].Active) continue;
+			std::cout << "batch " << i / batch_size << " slot " << i % batch_size << ": " << crops[i].X << " " << crops[i].Y << " "
+				<< planner.getCropWidth() << " " << planner.getCropHeight() << "\n";
+		}
+		const double crop_area = static_cast<double>(planner.getActiveCropCount()) * crop_width * crop_height;
+		std::cout << planner.getActiveCropCount() << " crops in " << planner.getBatchCount() << " batches cover "
+			<< std::fixed << std::setprecision( 1 ) << 100.0 * crop_area / (static_cast<double>(width) * height)
+			<< "% of the frame area\n";
+		return EXIT_SUCCESS;
+	}
+
+	int exportFenceMaskTensor(
+		const std::string& mask_path,
+		int tensor_width,
+		int tensor_height,
+		const std::string& element_type_name,
+		const std::string& output_path,
+		bool one_hot
+	)
+	{
+		int width, height;
+		std::vector<uint8_t> fence_mask;
+		if (!readFenceMask( fence_mask, width, height, mask_path )) {
+			std::cout << "Cannot read the fence mask: " << mask_path << "\n";
+			return EXIT_FAILURE;
+		}
+		if (element_type_name != "float32" && element_type_name != "float16") {
+			std::cout << "Unknown tensor element type: " << element_type_name << "\n";
+			return EXIT_FAILURE;
+		}
+
+		std::vector<uint8_t> labels;
+		if (one_hot) {
+			bool found[256] = { false, };
+			for (const auto& value : fence_mask) found[value] = true;
+			for (int label = 1; label < 256; ++label) {
+				if (found[label]) labels.emplace_back( static_cast<uint8_t>(label) );
+			}
+		}
+
+		const FenceTensorFormat format(
+			tensor_width, tensor_height,
+			element_type_name == "float16" ? TensorElementType::FLOAT16 : TensorElementType::FLOAT32,
+			one_hot ? TensorResampling::NEAREST : TensorResampling::BILINEAR
+		);
+		const int n_channels = one_hot ? static_cast<int>(labels.size()) : 1;
+		std::vector<uint8_t> tensor(getFenceTensorSize( format, n_channels ));
+		const auto start = std::chrono::steady_clock::now();
+		exportFenceTensor( tensor.data(), format, fence_mask.data(), width, height, labels, one_hot );
+		const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+		std::ofstream file(output_path, std::ios::binary);
+		file.write( reinterpret_cast<const char*>(tensor.data()), static_cast<std::streamsize>(tensor.size()) );
+		if (!file.good()) {
+			std::cout << "Cannot write the tensor: " << output_path << "\n";
+			return EXIT_FAILURE;
+		}
+		std::cout << n_channels << "x" << tensor_height << "x" << tensor_width << " " << element_type_name << " tensor in "
+			<< std::fixed << std::setprecision( 3 ) << elapsed.count() << " ms\n";
+		return EXIT_SUCCESS;
+	}
+
+	int writeFenceQPMap(
+		const std::string& mask_path,
+		int block_size,
+		const std::string& output_path,
+		int inside_qp_offset,
+		int outside_qp_offset,
+		float falloff_distance_in_pixel
+	)
+	{
+		int width, height;
+		std::vector<uint8_t> fence_mask;
+		if (!readFenceMask( fence_mask, width, height, mask_path )) {
+			std::cout << "Cannot read the fence mask: " << mask_path << "\n";
+			return EXIT_FAILURE;
+		}
+
+		FenceQPMap qp_map;
+		qp_map.setBlockSize( block_size );
+		qp_map.setQPOffsets( inside_qp_offset, outside_qp_offset, falloff_distance_in_pixel );
+		qp_map.build( fence_mask.data(), width, height );
+		if (!qp_map.writeQPOffsets( output_path )) {
+			std::cout << "Cannot write the QP map: " << output_path << "\n";
+			return EXIT_FAILURE;
+		}
+		std::cout << qp_map.getBlocksX() << "x" << qp_map.getBlocksY() << " blocks of " << qp_map.getBlockSize() << "x"
+			<< qp_map.getBlockSize() << " pixels\n";
+		return EXIT_SUCCESS;
+	}
+
+	bool printFenceMaskDifferences(const std::string& name, const std::vector<FenceMaskDifference>& differences)
+	{
+		bool identical = true;
+		for (const auto& difference : differences) {
+			if (difference.XorPixels == 0) continue;
+			identical = false;
+			std::cout << name << " fence " << static_cast<int>(difference.Label) << ": IoU " << std::fixed << std::setprecision( 5 )
+				<< difference.IoU << ", " << difference.XorPixels << " xor pixels, " << std::setprecision( 2 )
+				<< difference.MaxBoundaryDisplacement << " pixels of max boundary displacement\n";
+		}
+		return identical;
+	}
+
+	int compareFenceMaskFiles(const std::string& reference_path, const std::string& candidate_path, const std::string& diff_path)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		if (std::filesystem::is_directory( reference_path )) {
+			std::vector<FenceMaskComparison> comparisons;
+			compareFenceMaskDirectories( comparisons, reference_path, candidate_path, diff_path );
+
+			int n_identical = 0, n_failed = 0;
+			for (const auto& comparison : comparisons) {
+				if (!comparison.Compared) {
+					std::cout << comparison.Name << ": cannot be compared\n";
+					n_failed++;
+				}
+				else if (printFenceMaskDifferences( comparison.Name, comparison.Differences )) n_identical++;
+			}
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			std::cout << n_identical << " of " << comparisons.size() << " masks are identical, " << n_failed
+				<< " cannot be compared (" << std::setprecision( 2 ) << elapsed.count() << " s)\n";
+			return n_identical == static_cast<int>(comparisons.size()) ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+
+		int reference_width, reference_height, candidate_width, candidate_height;
+		std::vector<uint8_t> reference, candidate;
+		if (!readFenceMask( reference, reference_width, reference_height, reference_path ) ||
+		    !readFenceMask( candidate, candidate_width, candidate_height, candidate_path ) ||
+		    reference_width != candidate_width || reference_height != candidate_height) {
+			std::cout << "Cannot compare " << reference_path << " and " << candidate_path << "\n";
+			return EXIT_FAILURE;
+		}
+
+		std::vector<uint8_t> diff_image;
+		std::vector<FenceMaskDifference> differences;
+		compareFenceMasks( differences, &diff_image, reference.data(), candidate.data(), reference_width, reference_height );
+		if (!diff_path.empty()) writeFenceMask( diff_image.data(), reference_width, reference_height, diff_path );
+
+		const bool identical = printFenceMaskDifferences( candidate_path, differences );
+		if (identical) std::cout << "The masks are identical\n";
+		return identical ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const std::string mode = argc > 1 ? argv[1] : "";
+	if (mode == "--motion") {
+		if (argc < 5) {
+			std::cout << "Usage: " << argv[0] << " --motion <raw video> <grey|i420|nv12> <fence mask>\n";
+			return EXIT_FAILURE;
+		}
+		return detectMotionInVideo( argv[2], argv[3], argv[4] );
+	}
+	if (mode == "--motion-benchmark") return benchmarkMotionDetection();
+	if (mode == "--overlay") {
+		if (argc < 6) {
+			std::cout << "Usage: " << argv[0] << " --overlay <raw video> <i420|nv12|grey> <fence mask> <output raw video>\n";
+			return EXIT_FAILURE;
+		}
+		return overlayFenceOnVideo( argv[2], argv[3], argv[4], argv[5] );
+	}
+	if (mode == "--overlay-benchmark") return benchmarkOverlay();
+	if (mode == "--coverage-benchmark") return benchmarkFenceCoverage();
+	if (mode == "--culling-benchmark") {
+		int fence_count = 100000;
+		if (argc > 2 && !getIntegerArgument( fence_count, argv[2] )) {
+			std::cout << "Usage: " << argv[0] << " --culling-benchmark [fence count]\n";
+			return EXIT_FAILURE;
+		}
+		return benchmarkFenceCulling( std::max( fence_count, 1 ) );
+	}
+	if (mode == "--terrain-benchmark") return benchmarkTerrainLookup( argc > 2 ? argv[2] : "" );
+	if (mode == "--occlusion-benchmark") {
+		if (argc < 3) {
+			std::cout << "Usage: " << argv[0] << " --occlusion-benchmark <obstacle mesh>\n";
+			return EXIT_FAILURE;
+		}
+		return benchmarkOcclusion( argv[2] );
+	}
+	if (mode == "--compare") {
+		if (argc < 4) {
+			std::cout << "Usage: " << argv[0] << " --compare <reference mask or directory> <candidate mask or directory> [diff output]\n";
+			return EXIT_FAILURE;
+		}
+		return compareFenceMaskFiles( argv[2], argv[3], argc > 4 ? argv[4] : "" );
+	}
+	if (mode == "--plan-crops") {
+		int crop_width, crop_height, overlap, batch_size = 8;
+		if (argc < 6 || !getIntegerArgument( crop_width, argv[3] ) || !getIntegerArgument( crop_height, argv[4] ) ||
+		    !getIntegerArgument( overlap, argv[5] ) || (argc > 6 && !getIntegerArgument( batch_size, argv[6] )) ||
+		    crop_width <= 0 || crop_height <= 0) {
+			std::cout << "Usage: " << argv[0] << " --plan-crops <fence mask> <crop width> <crop height> <overlap> [batch size]\n";
+			return EXIT_FAILURE;
+		}
+		return planFenceCrops( argv[2], crop_width, crop_height, overlap, std::max( batch_size, 1 ) );
+	}
+	if (mode == "--tensor") {
+		int tensor_width, tensor_height;
+		if (argc < 7 || !getIntegerArgument( tensor_width, argv[3] ) || !getIntegerArgument( tensor_height, argv[4] ) ||
+		    tensor_width <= 0 || tensor_height <= 0) {
+			std::cout << "Usage: " << argv[0] << " --tensor <fence mask> <width> <height> <float32|float16> <output tensor> [one-hot]\n";
+			return EXIT_FAILURE;
+		}
+		return exportFenceMaskTensor(
+			argv[2], tensor_width, tensor_height, argv[5], argv[6], argc > 7 && std::string(argv[7]) == "one-hot"
+		);
+	}
+	if (mode == "--qp-map") {
+		int block_size, inside_qp_offset = -6, outside_qp_offset = 6;
+		float falloff = 128.0f;
+		if (argc < 5 || !getIntegerArgument( block_size, argv[3] ) ||
+		    (argc > 5 && !getIntegerArgument( inside_qp_offset, argv[5] )) ||
+		    (argc > 6 && !getIntegerArgument( outside_qp_offset, argv[6] )) ||
+		    (argc > 7 && !getFloatArgument( falloff, argv[7] ))) {
+			std::cout << "Usage: " << argv[0]
+				<< " --qp-map <fence mask> <16|32|64> <output map> [inside qp offset] [outside qp offset] [falloff in pixel]\n";
+			return EXIT_FAILURE;
+		}
+		return writeFenceQPMap( argv[2], block_size, argv[4], inside_qp_offset, outside_qp_offset, falloff );
+	}
+	if (mode == "--vectorize") {
+		float tolerance = 1.0f;
+		if (argc < 4 || (argc > 4 && !getFloatArgument( tolerance, argv[4] ))) {
+			std::cout << "Usage: " << argv[0] << " --vectorize <fence mask> <output vector> [tolerance in pixel]\n";
+			return EXIT_FAILURE;
+		}
+		return vectorizeFenceMask( argv[2], argv[3], tolerance );
+	}
+	if (mode == "--rasterize") {
+		int mask_width, mask_height;
+		if (argc < 6 || !getIntegerArgument( mask_width, argv[3] ) || !getIntegerArgument( mask_height, argv[4] ) ||
+		    mask_width <= 0 || mask_height <= 0) {
+			std::cout << "Usage: " << argv[0] << " --rasterize <fence vector> <width> <height> <output mask>\n";
+			return EXIT_FAILURE;
+		}
+		return rasterizeFenceVector( argv[2], mask_width, mask_height, argv[5] );
+	}
+
 	const float ground_width_in_meter = 320.0f;
 	const float ground_height_in_meter = 240.0f;
 
@@ -22,6 +662,13 @@ int main()
 		tilt_angle_in_degree, 
 		camera_height_in_meter
 	);
+	for (int i = 1; i < argc; i += 2) {
+		const std::string option = argv[i];
+		if (i + 1 < argc && option == "--terrain" && fence_maker.loadTerrain( argv[i + 1] )) continue;
+		if (i + 1 < argc && option == "--obstacles" && fence_maker.loadObstacles( argv[i + 1] )) continue;
+		std::cout << "Usage: " << argv[0] << " [--terrain <terrain grid>] [--obstacles <obstacle mesh>]\n";
+		return EXIT_FAILURE;
+	}
 	fence_maker.renderFence();
 
 	return 0;